@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+
+// --allocator-benchmark처럼 Vulkan 없이 돌아가는 검사/벤치마크 모드들이 같이 쓰는 시간 측정과 결과 출력
+//
+// 결과 줄은 "이름: 내용 -> ok" 혹은 "-> FAILED" 모양이고 하나라도 FAILED면 passed()가 false가 된다.
+//      BenchmarkReport report("job benchmark");
+//      double elapsedMs = BenchmarkReport::measure([&] { ... });
+//      report.line() << taskCount << " tasks in " << elapsedMs << " ms";
+//      report.result(passed);
+//      return report.passed();
+class BenchmarkReport {
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    explicit BenchmarkReport(const char* name, std::ostream& out = std::cout) : name(name), out(out) {}
+
+    // function을 한 번 실행하고 걸린 시간(ms)을 돌려준다.
+    template<typename Function>
+    static double measure(Function&& function) {
+        Clock::time_point start = Clock::now();
+        function();
+        return millisecondsSince(start);
+    }
+
+    static double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // 이름을 붙여서 줄을 시작한다. 결과가 없는 줄은 호출한 쪽이 "\n"으로 끝낸다.
+    std::ostream& line() {
+        out << name << ": ";
+        return out;
+    }
+
+    // line()으로 시작한 줄을 결과로 끝낸다. 실패했으면 failureDetail을 FAILED 뒤에 괄호로 붙인다.
+    bool result(bool passed, const std::string& failureDetail = std::string()) {
+        out << " -> " << (passed ? "ok" : "FAILED");
+        if (!passed && !failureDetail.empty()) {
+            out << " (" << failureDetail << ")";
+        }
+        out << "\n";
+        allPassed = allPassed && passed;
+        return passed;
+    }
+
+    bool passed() const {
+        return allPassed;
+    }
+
+private:
+    const char* name;
+    std::ostream& out;
+    bool allPassed = true;
+};
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+
+
+// 한 번 기록한 커맨드 버퍼를 그대로 다시 제출하기 위한 캐시
+//
+// 커맨드가 달라지는 건 그릴 대상(프레임버퍼 = swapchain 이미지), 화면 크기, 씬이 바뀔 때뿐인데 매 프레임
+// vkResetCommandBuffer + recordCommandBuffer를 하면 그리는 오브젝트 수에 비례하는 CPU 시간을 매번 쓰게 된다.
+// 그래서 (프레임 슬롯, swapchain 이미지)마다 커맨드 버퍼를 하나씩 두고 기록할 때의 Key를 같이 저장해둔다.
+// 다음에 같은 슬롯, 같은 이미지로 그릴 때 Key가 같으면 다시 기록하지 않고 그대로 제출한다.
+//
+// 프레임 슬롯마다 따로 두는 이유는 재사용 조건 때문이다. (슬롯, 이미지) 커맨드 버퍼는 항상 그 슬롯의 프레임에서만
+// 제출되니 drawFrame이 그 슬롯의 이전 프레임을 기다린 뒤에는 GPU가 이 커맨드 버퍼를 다 쓴 상태다. (SIMULTANEOUS_USE가 필요 없다)
+//
+// 프레임마다 바뀌는 데이터(인스턴스 transform 등)는 커맨드가 아니라 staging ring의 내용이라서 링 안의 오프셋만
+// 같으면 내용이 달라도 같은 커맨드 버퍼를 쓸 수 있다. 오프셋이 달라지면 Key가 달라져서 다시 기록된다.
+// 커맨드 버퍼는 처음 쓰일 때 할당한다. (swapchain 이미지 개수는 createSwapChain이 끝나야 알 수 있기 때문에)
+class CommandBufferCache {
+public:
+    // 이 값이 같으면 같은 커맨드가 기록된다.
+    struct Key {
+        uint64_t sceneVersion = 0; // 0은 "기록된 적 없음"으로 쓴다.
+        VkDeviceSize instanceOffset = 0; // 인스턴스 데이터를 바인딩한 링 안의 오프셋
+        VkDeviceSize indirectOffset = 0; // indirect 명령을 읽는 링 안의 오프셋
+
+        bool operator==(const Key& other) const {
+            return sceneVersion == other.sceneVersion && instanceOffset == other.instanceOffset && indirectOffset == other.indirectOffset;
+        }
+    };
+
+    void create(VkDevice device, VkCommandPool commandPool, uint32_t frameSlots) {
+        this->device = device;
+        this->commandPool = commandPool;
+        this->frameSlots = frameSlots;
+        entries.clear();
+        imageCount = 0;
+    }
+
+    // (slot, imageIndex)의 커맨드 버퍼를 돌려준다. needsRecord가 true면 호출하는 쪽이 key에 맞게 다시 기록해야 한다.
+    // vkBeginCommandBuffer가 암묵적으로 리셋해주기 때문에 vkResetCommandBuffer를 따로 부를 필요는 없다. (풀이 RESET_COMMAND_BUFFER_BIT일 때)
+    VkCommandBuffer acquire(uint32_t slot, uint32_t imageIndex, const Key& key, bool& needsRecord) {
+        if (imageIndex >= imageCount) {
+            grow(imageIndex + 1);
+        }
+
+        Entry& entry = entries[size_t(slot) * imageCount + imageIndex];
+        if (entry.commandBuffer == VK_NULL_HANDLE) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &entry.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate cached command buffer!");
+            }
+        }
+
+        needsRecord = key.sceneVersion == 0 || !(entry.key == key);
+        if (needsRecord) {
+            entry.key = key;
+            missCount++;
+        }
+        else {
+            hitCount++;
+        }
+        return entry.commandBuffer;
+    }
+
+    // 기록하다 실패했거나 이번 한 번만 쓸 커맨드를 기록했으면 다음에 재사용하지 않도록 지운다.
+    void forget(uint32_t slot, uint32_t imageIndex) {
+        if (imageIndex < imageCount) {
+            entries[size_t(slot) * imageCount + imageIndex].key = Key{};
+        }
+    }
+
+    // recreateSwapChain에서 프레임버퍼를 다시 만든 뒤에 부른다. 모든 커맨드 버퍼가 예전 프레임버퍼를 가리키고 있으니 전부 다시 기록한다.
+    // 이미지 개수가 바뀌었을 수도 있으니 배치도 다시 잡는다. 디바이스가 idle인 상태여야 한다.
+    void invalidate() {
+        release();
+        invalidationCount++;
+    }
+
+    void printStats(std::ostream& out) const {
+        uint64_t total = hitCount + missCount;
+        out << "command buffer cache: " << hitCount << " reused / " << total << " frames ("
+            << (total > 0 ? hitCount * 100.0 / total : 0.0) << "%), " << invalidationCount << " invalidations\n";
+    }
+
+    // 디바이스가 idle인 상태에서 부른다. 커맨드 풀을 파괴하기 전에 불러도 되고 풀과 같이 없어져도 된다.
+    void destroy() {
+        release();
+    }
+
+private:
+    struct Entry {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        Key key;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    uint32_t frameSlots = 0;
+    uint32_t imageCount = 0;
+    std::vector<Entry> entries; // [slot * imageCount + image]
+
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint32_t invalidationCount = 0;
+
+    // 이미지 개수가 늘면 배치가 바뀌니 기존 커맨드 버퍼를 새 자리로 옮긴다. (키도 그대로 유효하다)
+    void grow(uint32_t newImageCount) {
+        std::vector<Entry> grown(size_t(frameSlots) * newImageCount);
+        for (uint32_t slot = 0; slot < frameSlots; slot++) {
+            for (uint32_t image = 0; image < imageCount; image++) {
+                grown[size_t(slot) * newImageCount + image] = entries[size_t(slot) * imageCount + image];
+            }
+        }
+        entries.swap(grown);
+        imageCount = newImageCount;
+    }
+
+    void release() {
+        for (Entry& entry : entries) {
+            if (entry.commandBuffer != VK_NULL_HANDLE) {
+                vkFreeCommandBuffers(device, commandPool, 1, &entry.commandBuffer);
+            }
+        }
+        entries.clear();
+        imageCount = 0;
+    }
+};
@@ -0,0 +1,165 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <cstdint>
+
+
+// 물리 디바이스 하나에 대해 한 번만 조회해두는 큐 패밀리, surface 정보
+//
+// findQueueFamilies와 querySwapChainSupport는 isDeviceSuitable, createLogicalDevice, createSwapChain, createCommandPool에서
+// 그리고 recreateSwapChain때마다 불리는데, 매번 큐 패밀리와 포맷, present mode를 처음부터 다시 열거하고 있었다.
+// 큐 패밀리, 포맷, present mode는 디바이스와 surface가 같으면 바뀌지 않으니 처음 한 번만 조회해서 들고 있고,
+// 창 크기에 따라 바뀌는 surface capabilities(currentExtent 등)만 refreshSurfaceCapabilities로 다시 조회한다.
+struct DeviceCapabilities {
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::vector<VkBool32> presentSupport; // 큐 패밀리별 present 지원 여부
+
+    VkSurfaceCapabilitiesKHR surfaceCapabilities{};
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    // 역할별로 가장 알맞은 큐 패밀리
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // 가능하면 graphics, compute가 없는 전용 전송(DMA) 큐
+    std::optional<uint32_t> computeFamily; // 가능하면 graphics가 없는 async compute 큐
+};
+
+// 멀티스레드 초기화(StartupScheduler) 중에 여러 단계에서 동시에 조회할 수 있기 때문에 항상 복사본을 돌려준다.
+class DeviceCapabilityCache {
+public:
+    // surface가 VK_NULL_HANDLE이면(headless) surface 관련 조회는 건너뛰고 그래픽스 큐가 present 역할까지 맡는다.
+    DeviceCapabilities get(VkPhysicalDevice device, VkSurfaceKHR surface) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+
+        auto it = entries.find(device);
+        if (it == entries.end() || it->second.surface != surface) {
+            Entry entry;
+            entry.surface = surface;
+            entry.capabilities = query(device, surface);
+            it = entries.insert_or_assign(device, std::move(entry)).first;
+        }
+
+        return it->second.capabilities;
+    }
+
+    // 창 크기가 바뀌면 currentExtent, min/maxImageExtent가 달라지기 때문에 recreateSwapChain에서 호출한다.
+    void refreshSurfaceCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+
+        auto it = entries.find(device);
+        if (it == entries.end() || it->second.surface != surface || surface == VK_NULL_HANDLE) {
+            return; // 아직 조회한 적이 없으면 다음 get에서 새로 조회된다.
+        }
+
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &it->second.capabilities.surfaceCapabilities);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        entries.clear();
+    }
+
+private:
+    struct Entry {
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        DeviceCapabilities capabilities;
+    };
+
+    std::mutex cacheMutex;
+    std::map<VkPhysicalDevice, Entry> entries;
+
+    static DeviceCapabilities query(VkPhysicalDevice device, VkSurfaceKHR surface) {
+        DeviceCapabilities capabilities;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+        capabilities.queueFamilies.resize(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, capabilities.queueFamilies.data());
+
+        capabilities.presentSupport.resize(queueFamilyCount, VK_FALSE);
+        if (surface != VK_NULL_HANDLE) {
+            for (uint32_t i = 0; i < queueFamilyCount; i++) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &capabilities.presentSupport[i]);
+            }
+
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities.surfaceCapabilities);
+
+            uint32_t formatCount = 0;
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+            capabilities.formats.resize(formatCount);
+            if (formatCount != 0) {
+                vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, capabilities.formats.data());
+            }
+
+            uint32_t presentModeCount = 0;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+            capabilities.presentModes.resize(presentModeCount);
+            if (presentModeCount != 0) {
+                vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, capabilities.presentModes.data());
+            }
+        }
+
+        selectQueueFamilies(capabilities, surface != VK_NULL_HANDLE);
+        return capabilities;
+    }
+
+    // 첫 번째로 맞는 패밀리에서 멈추지 않고 역할별로 가장 알맞은 패밀리를 고른다.
+    static void selectQueueFamilies(DeviceCapabilities& capabilities, bool hasSurface) {
+        const auto& families = capabilities.queueFamilies;
+        auto has = [&](uint32_t i, VkQueueFlags flags) {
+            return families[i].queueCount > 0 && (families[i].queueFlags & flags) == flags;
+        };
+        auto lacks = [&](uint32_t i, VkQueueFlags flags) {
+            return (families[i].queueFlags & flags) == 0;
+        };
+        uint32_t count = static_cast<uint32_t>(families.size());
+
+        // graphics + present: 둘 다 되는 패밀리가 있으면 swapchain 이미지를 큐 사이에서 공유(CONCURRENT)하지 않아도 된다.
+        for (uint32_t i = 0; i < count; i++) {
+            if (has(i, VK_QUEUE_GRAPHICS_BIT) && (!hasSurface || capabilities.presentSupport[i])) {
+                capabilities.graphicsFamily = i;
+                capabilities.presentFamily = i;
+                break;
+            }
+        }
+        if (!capabilities.graphicsFamily.has_value()) {
+            for (uint32_t i = 0; i < count && !capabilities.graphicsFamily.has_value(); i++) {
+                if (has(i, VK_QUEUE_GRAPHICS_BIT)) {
+                    capabilities.graphicsFamily = i;
+                }
+            }
+            for (uint32_t i = 0; i < count && !capabilities.presentFamily.has_value(); i++) {
+                if (capabilities.presentSupport[i] && families[i].queueCount > 0) {
+                    capabilities.presentFamily = i;
+                }
+            }
+        }
+
+        // compute: graphics가 없는 패밀리 > graphics 패밀리
+        for (uint32_t i = 0; i < count && !capabilities.computeFamily.has_value(); i++) {
+            if (has(i, VK_QUEUE_COMPUTE_BIT) && lacks(i, VK_QUEUE_GRAPHICS_BIT)) {
+                capabilities.computeFamily = i;
+            }
+        }
+        if (!capabilities.computeFamily.has_value()) {
+            capabilities.computeFamily = capabilities.graphicsFamily;
+        }
+
+        // transfer: graphics, compute가 모두 없는 전용 패밀리 > compute 전용 패밀리 > graphics 패밀리
+        // graphics나 compute를 지원하는 패밀리는 TRANSFER_BIT가 없어도 전송 명령을 쓸 수 있다.
+        for (uint32_t i = 0; i < count && !capabilities.transferFamily.has_value(); i++) {
+            if (has(i, VK_QUEUE_TRANSFER_BIT) && lacks(i, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+                capabilities.transferFamily = i;
+            }
+        }
+        if (!capabilities.transferFamily.has_value()) {
+            capabilities.transferFamily = capabilities.computeFamily;
+        }
+    }
+};
@@ -0,0 +1,234 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+
+
+// 물리 디바이스 후보들에 점수를 매겨서 가장 좋은 GPU를 고르는 클래스
+//
+// 예전에는 isDeviceSuitable을 통과한 첫 번째 디바이스를 골랐기 때문에 노트북처럼 GPU가 두 개인 환경에서는
+// 내장 GPU나 lavapipe같은 소프트웨어 래스터라이저가 잡힐 수 있었다. (프레임 타임이 몇 배씩 차이난다)
+//
+// 점수는 대략 디바이스 종류 > device local 힙 크기 > limits, 선택 기능 순서로 영향이 크다.
+// 내장 GPU는 시스템 메모리를 device local 힙으로 보고하기 때문에 힙 크기 점수에 상한을 둬서
+// 어떤 경우에도 외장 GPU를 넘지 못하게 했다.
+//
+// 자동 선택이 마음에 들지 않으면 --device 옵션이나 VULKAN_DEVICE 환경 변수로 직접 고를 수 있다.
+// 값은 vkEnumeratePhysicalDevices 순서의 인덱스, deviceUUID(대시는 있어도 없어도 됨), 이름의 일부(대소문자 무시) 중 하나다.
+//      ex) VULKAN_DEVICE=1, VULKAN_DEVICE=nvidia, --device 6a1f...-...
+class DeviceSelector {
+public:
+    struct Candidate {
+        uint32_t index = 0; // vkEnumeratePhysicalDevices에서의 순서
+        VkPhysicalDevice device = VK_NULL_HANDLE;
+        VkPhysicalDeviceProperties properties{};
+        VkPhysicalDeviceFeatures features{};
+        uint8_t deviceUUID[VK_UUID_SIZE]{};
+        VkDeviceSize deviceLocalBytes = 0; // 가장 큰 device local 힙의 크기
+        bool suitable = false; // 앱이 필요로 하는 큐, 익스텐션, swapchain을 지원하는지
+        int64_t score = 0;
+    };
+
+    void addCandidate(VkPhysicalDevice device, bool suitable) {
+        Candidate candidate;
+        candidate.index = static_cast<uint32_t>(candidates.size());
+        candidate.device = device;
+        candidate.suitable = suitable;
+
+        VkPhysicalDeviceIDProperties idProperties{};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties2); // 인스턴스가 Vulkan 1.3으로 만들어지기 때문에 core로 쓸 수 있다.
+
+        candidate.properties = properties2.properties;
+        std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), candidate.deviceUUID);
+
+        vkGetPhysicalDeviceFeatures(device, &candidate.features);
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                candidate.deviceLocalBytes = std::max(candidate.deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+
+        candidate.score = suitable ? rate(candidate) : -1;
+        candidates.push_back(candidate);
+    }
+
+    // override가 비어있으면 가장 점수가 높은 디바이스를, 아니면 override와 일치하는 디바이스를 고른다.
+    // 후보 순위는 항상 로그로 남긴다.
+    VkPhysicalDevice select(const std::string& override) {
+        std::vector<const Candidate*> ranked;
+        for (const Candidate& candidate : candidates) {
+            ranked.push_back(&candidate);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+            [](const Candidate* a, const Candidate* b) { return a->score > b->score; });
+
+        const Candidate* selected = nullptr;
+        if (override.empty()) {
+            if (!ranked.empty() && ranked.front()->suitable) {
+                selected = ranked.front();
+            }
+        }
+        else {
+            for (const Candidate* candidate : ranked) {
+                if (matches(*candidate, override)) {
+                    selected = candidate;
+                    break;
+                }
+            }
+        }
+
+        printRanking(ranked, selected);
+
+        if (selected == nullptr) {
+            throw std::runtime_error(override.empty()
+                ? "failed to find a suitable GPU!"
+                : "failed to find a GPU matching \"" + override + "\"!");
+        }
+        if (!selected->suitable) {
+            throw std::runtime_error(std::string("requested GPU ") + selected->properties.deviceName + " is not suitable!");
+        }
+
+        return selected->device;
+    }
+
+    // --device가 없으면 VULKAN_DEVICE 환경 변수를 쓴다.
+    static std::string environmentOverride() {
+#ifdef _WIN32
+        char* value = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&value, &length, "VULKAN_DEVICE") != 0 || value == nullptr) {
+            return {};
+        }
+        std::string result = value;
+        free(value);
+        return result;
+#else
+        const char* value = std::getenv("VULKAN_DEVICE");
+        return value != nullptr ? value : "";
+#endif
+    }
+
+private:
+    std::vector<Candidate> candidates;
+
+    static int64_t rate(const Candidate& candidate) {
+        int64_t score = 0;
+
+        switch (candidate.properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   score += 10000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 4000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    score += 2000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            score += 0; break; // lavapipe, SwiftShader 등은 정말 아무것도 없을 때만
+        default:                                     score += 1000; break;
+        }
+
+        // 1 GiB당 100점, 최대 24 GiB까지 (= 2400점, 외장과 내장의 차이인 6000점보다 작다)
+        const VkDeviceSize gibibyte = 1024ull * 1024ull * 1024ull;
+        score += static_cast<int64_t>(std::min<VkDeviceSize>(candidate.deviceLocalBytes / gibibyte, 24)) * 100;
+
+        const VkPhysicalDeviceLimits& limits = candidate.properties.limits;
+        score += limits.maxImageDimension2D / 1024; // 보통 8~32점
+        score += limits.maxColorAttachments;
+        score += std::min<uint32_t>(limits.maxDrawIndirectCount, 1u << 20) >> 16; // 0~16점
+
+        const VkPhysicalDeviceFeatures& features = candidate.features;
+        if (features.multiDrawIndirect) score += 50;
+        if (features.drawIndirectFirstInstance) score += 25;
+        if (features.samplerAnisotropy) score += 25;
+        if (features.fullDrawIndexUint32) score += 25;
+        if (features.pipelineStatisticsQuery) score += 10;
+
+        if (VK_API_VERSION_MINOR(candidate.properties.apiVersion) >= 2 || VK_API_VERSION_MAJOR(candidate.properties.apiVersion) > 1) {
+            score += 100; // timeline semaphore 등 1.2 core 기능
+        }
+
+        return score;
+    }
+
+    static bool matches(const Candidate& candidate, const std::string& override) {
+        bool isIndex = !override.empty() && std::all_of(override.begin(), override.end(),
+            [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
+        if (isIndex) {
+            return override == std::to_string(candidate.index);
+        }
+
+        std::string uuid = uuidToString(candidate.deviceUUID);
+        if (normalizeUUID(override) == normalizeUUID(uuid)) {
+            return true;
+        }
+
+        return toLower(candidate.properties.deviceName).find(toLower(override)) != std::string::npos;
+    }
+
+    void printRanking(const std::vector<const Candidate*>& ranked, const Candidate* selected) const {
+        std::cout << "physical devices (best first):\n";
+        for (const Candidate* candidate : ranked) {
+            std::cout << (candidate == selected ? "  * " : "    ")
+                << "[" << candidate->index << "] " << candidate->properties.deviceName
+                << " (" << typeName(candidate->properties.deviceType) << ", "
+                << (candidate->deviceLocalBytes >> 20) << " MiB device local, uuid " << uuidToString(candidate->deviceUUID) << ") ";
+            if (candidate->suitable) {
+                std::cout << "score " << candidate->score << "\n";
+            }
+            else {
+                std::cout << "not suitable\n";
+            }
+        }
+    }
+
+    static const char* typeName(VkPhysicalDeviceType type) {
+        switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+        default: return "other";
+        }
+    }
+
+    // 8-4-4-4-12 형태로 출력한다.
+    static std::string uuidToString(const uint8_t (&uuid)[VK_UUID_SIZE]) {
+        static const char digits[] = "0123456789abcdef";
+        std::string result;
+        for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+            if (i == 4 || i == 6 || i == 8 || i == 10) {
+                result += '-';
+            }
+            result += digits[uuid[i] >> 4];
+            result += digits[uuid[i] & 0xf];
+        }
+        return result;
+    }
+
+    static std::string normalizeUUID(const std::string& uuid) {
+        std::string result;
+        for (char c : uuid) {
+            if (c != '-') {
+                result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return result;
+    }
+
+    static std::string toLower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+};
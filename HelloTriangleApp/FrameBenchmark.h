@@ -0,0 +1,225 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+
+// 프레임마다 CPU 기록 시간, 제출 시간, GPU 시간을 재서 JSON이나 CSV로 저장하는 벤치마크 기록기
+//
+// GPU 시간은 커맨드 버퍼의 처음과 끝에 쓴 타임스탬프 쿼리의 차이다. 프레임 슬롯(MAX_FRAMES_IN_FLIGHT)마다
+// 쿼리 두 개를 쓰고, 그 슬롯의 이전 프레임을 기다린 뒤(beginFrame)에 지난번 결과를 읽기 때문에 GPU를 멈춰 세우지 않는다.
+//      drawFrame: 프레임 타임라인 대기 -> beginFrame(slot) -> [recordBegin ... recordEnd] 기록 -> submit -> endFrame(slot, record, submit)
+// 처음 warmupFrames개의 프레임은 파이프라인 캐시, 드라이버 내부 할당 등이 자리잡는 구간이라 결과에서 뺀다.
+// 그래픽스 큐 패밀리가 타임스탬프를 지원하지 않으면(timestampValidBits == 0) GPU 시간은 -1로 기록한다.
+class FrameBenchmark {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sample {
+        uint64_t frame = 0;
+        double recordMs = 0.0;
+        double submitMs = 0.0;
+        double gpuMs = -1.0;
+    };
+
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameSlots,
+        uint32_t warmupFrames, uint32_t measuredFrames) {
+        this->device = device;
+        this->warmupFrames = warmupFrames;
+        this->measuredFrames = measuredFrames;
+        pending.assign(frameSlots, Pending{});
+        samples.clear();
+        samples.reserve(measuredFrames);
+        frameNumber = 0;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod; // 타임스탬프 1틱이 몇 ns인지
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+        uint32_t validBits = queueFamilyIndex < familyCount ? families[queueFamilyIndex].timestampValidBits : 0;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        if (validBits == 0 || timestampPeriod <= 0.0f) {
+            std::cerr << "frame benchmark: graphics queue has no timestamps, GPU time is not measured\n";
+            return;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = frameSlots * 2;
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    // 슬롯의 이전 프레임을 기다린 직후에 부른다. 지난번에 이 슬롯으로 그린 프레임의 GPU 시간을 읽어서 결과에 넣는다.
+    void beginFrame(uint32_t slot) {
+        collect(slot);
+    }
+
+    // 커맨드 버퍼를 시작한 직후, 렌더 패스 밖에서 부른다.
+    void recordBegin(VkCommandBuffer commandBuffer, uint32_t slot) {
+        if (queryPool == VK_NULL_HANDLE) {
+            return;
+        }
+        vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * 2);
+    }
+
+    // 커맨드 버퍼를 끝내기 직전, 렌더 패스 밖에서 부른다.
+    void recordEnd(VkCommandBuffer commandBuffer, uint32_t slot) {
+        if (queryPool == VK_NULL_HANDLE) {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * 2 + 1);
+    }
+
+    // 제출까지 끝난 뒤에 부른다. GPU 시간은 이 슬롯이 다시 돌아왔을 때 채워진다.
+    void endFrame(uint32_t slot, double recordMs, double submitMs) {
+        Pending& frame = pending[slot];
+        frame.active = true;
+        frame.sample.frame = frameNumber++;
+        frame.sample.recordMs = recordMs;
+        frame.sample.submitMs = submitMs;
+    }
+
+    // warmup과 측정할 프레임을 모두 제출했는지
+    bool isFinished() const {
+        return frameNumber >= uint64_t(warmupFrames) + measuredFrames;
+    }
+
+    // vkDeviceWaitIdle 뒤에 불러서 아직 읽지 않은 슬롯의 결과까지 모은다.
+    void finish() {
+        for (uint32_t slot = 0; slot < pending.size(); slot++) {
+            collect(slot);
+        }
+        std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.frame < b.frame; });
+    }
+
+    // 확장자가 .csv면 CSV, 그 밖에는 JSON으로 저장한다. label은 결과를 구분하기 위한 설정 문자열이다. ex) "indirect x10000"
+    void write(const std::string& path, const std::string& label) const {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "frame benchmark: failed to open " << path << "\n";
+            return;
+        }
+
+        bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        if (csv) {
+            file << "frame,record_ms,submit_ms,gpu_ms\n";
+            for (const Sample& sample : samples) {
+                file << sample.frame << "," << sample.recordMs << "," << sample.submitMs << "," << sample.gpuMs << "\n";
+            }
+        }
+        else {
+            file << "{\"label\":\"" << label << "\",\"warmupFrames\":" << warmupFrames << ",\"frames\":[\n";
+            for (size_t i = 0; i < samples.size(); i++) {
+                const Sample& sample = samples[i];
+                file << "{\"frame\":" << sample.frame << ",\"recordMs\":" << sample.recordMs << ",\"submitMs\":" << sample.submitMs
+                    << ",\"gpuMs\":" << sample.gpuMs << "}" << (i + 1 < samples.size() ? ",\n" : "\n");
+            }
+            file << "]}\n";
+        }
+
+        std::cout << "frame benchmark: wrote " << samples.size() << " frames to " << path << "\n";
+    }
+
+    // ex) frame benchmark (indirect x10000): 500 frames | record median 0.41 p99 0.62 ms | submit ... | gpu ...
+    void printSummary(std::ostream& out, const std::string& label) const {
+        out << "frame benchmark (" << label << "): " << samples.size() << " frames";
+        printStatistic(out, "record", [](const Sample& sample) { return sample.recordMs; });
+        printStatistic(out, "submit", [](const Sample& sample) { return sample.submitMs; });
+        printStatistic(out, "gpu", [](const Sample& sample) { return sample.gpuMs; });
+        out << "\n";
+    }
+
+    void destroy() {
+        if (queryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device, queryPool, nullptr);
+            queryPool = VK_NULL_HANDLE;
+        }
+    }
+
+    static double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+private:
+    struct Pending {
+        bool active = false; // 제출됐지만 아직 GPU 시간을 읽지 않은 프레임이 있는지
+        Sample sample;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    float timestampPeriod = 0.0f;
+    uint64_t timestampMask = 0;
+
+    uint32_t warmupFrames = 0;
+    uint32_t measuredFrames = 0;
+    uint64_t frameNumber = 0;
+    std::vector<Pending> pending;
+    std::vector<Sample> samples;
+
+    void collect(uint32_t slot) {
+        Pending& frame = pending[slot];
+        if (!frame.active) {
+            return;
+        }
+        frame.active = false;
+
+        if (queryPool != VK_NULL_HANDLE) {
+            uint64_t timestamps[2] = {};
+            // 이 슬롯의 프레임이 끝난 걸 기다린 뒤라 결과는 이미 준비돼 있다. WAIT_BIT는 혹시 모를 경우를 위한 것이다.
+            VkResult result = vkGetQueryPoolResults(device, queryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            if (result == VK_SUCCESS) {
+                uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask; // 카운터가 한 바퀴 돈 경우
+                frame.sample.gpuMs = ticks * double(timestampPeriod) / 1e6;
+            }
+        }
+
+        if (frame.sample.frame >= warmupFrames) {
+            samples.push_back(frame.sample);
+        }
+    }
+
+    template<typename Value>
+    void printStatistic(std::ostream& out, const char* name, Value value) const {
+        std::vector<double> values;
+        values.reserve(samples.size());
+        for (const Sample& sample : samples) {
+            if (value(sample) >= 0.0) {
+                values.push_back(value(sample));
+            }
+        }
+        if (values.empty()) {
+            out << " | " << name << " n/a";
+            return;
+        }
+
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double v : values) {
+            sum += v;
+        }
+        size_t p99 = std::min(values.size() - 1, static_cast<size_t>(std::ceil(values.size() * 0.99)) - 1);
+        out << " | " << name << " mean " << sum / values.size() << " median " << values[values.size() / 2]
+            << " p99 " << values[p99] << " ms";
+    }
+};
@@ -0,0 +1,143 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+
+// 프레임마다 fence를 기다리고 리셋하는 대신 그래픽스 큐의 타임라인 세마포어 하나로 프레임 수를 맞추는 도구
+//
+// N번째로 제출한 프레임은 끝날 때 타임라인을 N으로 signal한다. 값은 한 방향으로만 커지니
+//      N번째 프레임을 시작하기 전: 타임라인이 N - framesInFlight가 될 때까지 기다린다.
+// 이것만으로 슬롯(currentFrame)의 이전 제출이 끝났다는 게 보장된다. fence처럼 리셋할 필요가 없어서
+// 기다린 뒤에 제출하지 않고 돌아가도(OUT_OF_DATE) 다음에 같은 값을 다시 기다리면 그만이라 데드락이 생길 일이 없다.
+//      drawFrame: beginFrame() -> ... -> submit(signal: semaphore(), frameValue()) -> endFrame()
+//
+// 전송 큐는 자기 타임라인(TransferQueue)을 따로 쓴다. 타임라인 하나를 두 큐가 같이 signal하면
+// 두 큐가 끝나는 순서가 제출 순서와 달라졌을 때 값이 뒤로 가게 돼서 안 된다. 그래픽스 제출은 지금처럼 그 값을 기다린다.
+//
+// 디바이스가 아직 쓰고 있을 수 있는 리소스는 deferDestroy로 넘겨두면 지금 준비 중인 프레임이 끝난 뒤에 파괴된다.
+class FramePacer {
+public:
+    void create(VkDevice device, uint32_t framesInFlight) {
+        this->device = device;
+        this->framesInFlight = framesInFlight;
+        lastSubmitted = 0;
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame timeline semaphore!");
+        }
+    }
+
+    // 이번 프레임의 슬롯을 쓰던 프레임(framesInFlight개 전)이 끝날 때까지 기다리고, 끝난 프레임에 걸린 파괴를 실행한다.
+    // 지금까지 끝난 타임라인 값을 돌려준다.
+    uint64_t beginFrame() {
+        uint64_t value = frameValue();
+        if (value > framesInFlight) {
+            wait(value - framesInFlight);
+        }
+        uint64_t completed = completedValue();
+        collect(completed);
+        return completed;
+    }
+
+    // 지금 준비 중인 프레임이 끝날 때 signal할 값
+    uint64_t frameValue() const {
+        return lastSubmitted + 1;
+    }
+
+    // 제출이 성공한 뒤에 부른다. 제출하지 않고 돌아가면 부르지 않는다. (값이 currentFrame과 같이 움직여야 한다)
+    void endFrame() {
+        lastSubmitted++;
+    }
+
+    uint64_t completedValue() const {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &value);
+        return value;
+    }
+
+    // 타임라인이 value가 될 때까지 기다린다. 이미 지났으면 바로 돌아온다.
+    void wait(uint64_t value) {
+        if (completedValue() >= value) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            throw std::runtime_error("failed to wait for frame timeline!");
+        }
+        blockedWaits++;
+        blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 지금 준비 중인 프레임(frameValue)이 끝난 뒤에 destroy를 부른다.
+    void deferDestroy(std::function<void()> destroy) {
+        deferred.push_back({ frameValue(), std::move(destroy) });
+    }
+
+    VkSemaphore semaphore() const {
+        return timeline;
+    }
+
+    void printStats(std::ostream& out) const {
+        out << "frame pacer: " << lastSubmitted << " frames, blocked " << blockedWaits << " times ("
+            << blockedMs << " ms total, " << (blockedWaits > 0 ? blockedMs / blockedWaits : 0.0) << " ms per wait)\n";
+    }
+
+    // 마지막으로 제출한 프레임까지 기다리고 남은 파괴를 전부 실행한 뒤 세마포어를 파괴한다.
+    void destroy() {
+        if (timeline == VK_NULL_HANDLE) {
+            return;
+        }
+        wait(lastSubmitted);
+        collect(lastSubmitted);
+        for (Deferred& entry : deferred) { // 제출하지 않은 프레임에 걸린 것들
+            entry.destroy();
+        }
+        deferred.clear();
+        vkDestroySemaphore(device, timeline, nullptr);
+        timeline = VK_NULL_HANDLE;
+    }
+
+private:
+    struct Deferred {
+        uint64_t value = 0;
+        std::function<void()> destroy;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint32_t framesInFlight = 1;
+    uint64_t lastSubmitted = 0;
+    std::deque<Deferred> deferred; // value 순서대로 쌓인다.
+
+    uint64_t blockedWaits = 0;
+    double blockedMs = 0.0;
+
+    void collect(uint64_t completed) {
+        while (!deferred.empty() && deferred.front().value <= completed) {
+            Deferred entry = std::move(deferred.front());
+            deferred.pop_front();
+            entry.destroy();
+        }
+    }
+};
@@ -0,0 +1,842 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// TLSF(Two-Level Segregated Fit) 할당기
+//
+// Vulkan 객체를 전혀 모르는 순수한 CPU 알고리즘이다. [0, size) 범위의 오프셋만 나눠주고
+// 실제 VkDeviceMemory는 아래의 GpuAllocator가 블록 단위로 잡아서 이 클래스로 잘게 쪼갠다.
+//
+// 빈 블록들을 크기에 따라 2단계 버킷에 나눠 담는다.
+//      1단계(fl): 크기의 최상위 비트 위치 (2의 거듭제곱 구간)
+//      2단계(sl): 그 구간을 secondLevelCount(32)개로 균등하게 나눈 구간
+// 각 단계마다 비어있지 않은 버킷을 비트맵으로 들고 있어서 할당, 해제가 모두 O(1)이다.
+// 해제할 때는 물리적으로 인접한 빈 블록과 바로 합치기 때문에 빈 블록끼리 붙어있는 경우는 없다.
+class TlsfAllocator {
+public:
+    static const uint32_t invalidHandle = UINT32_MAX;
+
+    struct Allocation {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t handle = invalidHandle; // free에 넘겨줄 값
+    };
+
+    explicit TlsfAllocator(uint64_t size = 0) {
+        reset(size);
+    }
+
+    void reset(uint64_t size) {
+        blocks.clear();
+        unusedBlocks.clear();
+        firstLevelMap = 0;
+        for (uint32_t i = 0; i < firstLevelCount; i++) {
+            secondLevelMap[i] = 0;
+            for (uint32_t j = 0; j < secondLevelCount; j++) {
+                freeHeads[i][j] = invalidHandle;
+            }
+        }
+
+        totalSize = size;
+        usedSize = 0;
+        allocations = 0;
+        firstBlock = invalidHandle;
+
+        if (size != 0) {
+            firstBlock = newBlock();
+            blocks[firstBlock].offset = 0;
+            blocks[firstBlock].size = size;
+            insertFree(firstBlock);
+        }
+    }
+
+    // alignment는 2의 거듭제곱이어야 한다. 공간이 없으면 false를 돌려준다.
+    bool allocate(uint64_t size, uint64_t alignment, Allocation& allocation) {
+        if (size == 0 || size > totalSize) {
+            return false;
+        }
+        if (alignment == 0) {
+            alignment = 1;
+        }
+
+        // 대부분의 빈 블록은 이미 정렬돼 있으니 먼저 크기만으로 찾아보고, 정렬 때문에 안 들어가면
+        // 정렬 여유분까지 더해서 다시 찾는다. (두 번째는 찾기만 하면 반드시 들어간다)
+        uint32_t block = findFree(size);
+        if (block == invalidHandle || !fits(block, size, alignment)) {
+            block = alignment > 1 ? findFree(size + alignment - 1) : invalidHandle;
+            if (block == invalidHandle) {
+                return false;
+            }
+        }
+
+        removeFree(block);
+
+        uint64_t alignedOffset = alignUp(blocks[block].offset, alignment);
+        uint64_t padding = alignedOffset - blocks[block].offset;
+        if (padding != 0) {
+            // 앞쪽의 정렬 여유분은 별도의 빈 블록으로 떼어낸다.
+            // 빈 블록은 항상 이웃과 합쳐져 있으니 앞 블록은 사용중이고, 떼어낸 블록과 합칠 일은 없다.
+            uint32_t front = newBlock();
+            blocks[front].offset = blocks[block].offset;
+            blocks[front].size = padding;
+            linkBefore(front, block);
+            blocks[block].offset += padding;
+            blocks[block].size -= padding;
+            insertFree(front);
+        }
+
+        uint64_t remainder = blocks[block].size - size;
+        if (remainder != 0) {
+            uint32_t back = newBlock();
+            blocks[back].offset = blocks[block].offset + size;
+            blocks[back].size = remainder;
+            linkAfter(back, block);
+            blocks[block].size = size;
+            insertFree(back);
+        }
+
+        blocks[block].free = false;
+        usedSize += size;
+        allocations++;
+
+        allocation.offset = blocks[block].offset;
+        allocation.size = size;
+        allocation.handle = block;
+        return true;
+    }
+
+    void free(uint32_t handle) {
+        if (handle >= blocks.size() || blocks[handle].free || !blocks[handle].live) {
+            throw std::runtime_error("tlsf: freeing an invalid allocation!");
+        }
+
+        uint32_t block = handle;
+        usedSize -= blocks[block].size;
+        allocations--;
+        blocks[block].free = true;
+
+        uint32_t prev = blocks[block].prevPhysical;
+        if (prev != invalidHandle && blocks[prev].free) {
+            removeFree(prev);
+            blocks[prev].size += blocks[block].size;
+            unlink(block);
+            block = prev;
+        }
+
+        uint32_t next = blocks[block].nextPhysical;
+        if (next != invalidHandle && blocks[next].free) {
+            removeFree(next);
+            blocks[block].size += blocks[next].size;
+            unlink(next);
+        }
+
+        insertFree(block);
+    }
+
+    uint64_t size() const {
+        return totalSize;
+    }
+
+    uint64_t usedBytes() const {
+        return usedSize;
+    }
+
+    uint32_t allocationCount() const {
+        return allocations;
+    }
+
+    bool isEmpty() const {
+        return allocations == 0;
+    }
+
+    // 단편화를 볼 때 쓴다. 가장 큰 버킷 하나만 훑는다.
+    uint64_t largestFreeBlock() const {
+        if (firstLevelMap == 0) {
+            return 0;
+        }
+        uint32_t fl = highestBit(firstLevelMap);
+        uint32_t sl = highestBit(secondLevelMap[fl]);
+
+        uint64_t largest = 0;
+        for (uint32_t block = freeHeads[fl][sl]; block != invalidHandle; block = blocks[block].nextFree) {
+            largest = std::max(largest, blocks[block].size);
+        }
+        return largest;
+    }
+
+    // 내부 자료구조가 서로 맞는지 전부 확인한다. 느리기 때문에 디버깅, 벤치마크의 검증용이다.
+    bool validate() const {
+        uint64_t offset = 0;
+        uint64_t used = 0;
+        uint32_t usedCount = 0;
+        uint32_t freeCount = 0;
+        uint32_t prev = invalidHandle;
+
+        for (uint32_t block = firstBlock; block != invalidHandle; block = blocks[block].nextPhysical) {
+            const Block& current = blocks[block];
+            if (!current.live || current.offset != offset || current.size == 0 || current.prevPhysical != prev) {
+                return false;
+            }
+            if (current.free) {
+                if (prev != invalidHandle && blocks[prev].free) {
+                    return false; // 빈 블록끼리 붙어있으면 안된다.
+                }
+                if (!isInFreeList(block)) {
+                    return false;
+                }
+                freeCount++;
+            }
+            else {
+                used += current.size;
+                usedCount++;
+            }
+            offset += current.size;
+            prev = block;
+        }
+
+        if (offset != totalSize || used != usedSize || usedCount != allocations) {
+            return false;
+        }
+
+        uint32_t listedCount = 0;
+        for (uint32_t fl = 0; fl < firstLevelCount; fl++) {
+            for (uint32_t sl = 0; sl < secondLevelCount; sl++) {
+                bool listEmpty = freeHeads[fl][sl] == invalidHandle;
+                bool bitSet = (secondLevelMap[fl] & (1u << sl)) != 0;
+                if (listEmpty == bitSet) {
+                    return false;
+                }
+                for (uint32_t block = freeHeads[fl][sl]; block != invalidHandle; block = blocks[block].nextFree) {
+                    listedCount++;
+                }
+            }
+            if (((firstLevelMap >> fl) & 1) != (secondLevelMap[fl] != 0 ? 1u : 0u)) {
+                return false;
+            }
+        }
+
+        return listedCount == freeCount;
+    }
+
+private:
+    // 256바이트 미만은 8바이트 간격의 버킷 32개에 선형으로 담고, 그 이상은 2의 거듭제곱 구간을 32개로 나눈다.
+    static const uint32_t secondLevelBits = 5;
+    static const uint32_t secondLevelCount = 1u << secondLevelBits;
+    static const uint32_t smallBits = 8;
+    static const uint64_t smallSize = 1ull << smallBits;
+    static const uint32_t firstLevelCount = 64 - smallBits + 1;
+
+    struct Block {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t prevPhysical = invalidHandle;
+        uint32_t nextPhysical = invalidHandle;
+        uint32_t prevFree = invalidHandle;
+        uint32_t nextFree = invalidHandle;
+        bool free = true;
+        bool live = true; // 재사용 대기중인 노드면 false
+    };
+
+    // 노드는 vector에 인덱스로 들고 있어서 할당, 해제때 new/delete가 없다.
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedBlocks;
+    uint32_t firstBlock = invalidHandle;
+
+    uint64_t firstLevelMap = 0;
+    uint32_t secondLevelMap[firstLevelCount] = {};
+    uint32_t freeHeads[firstLevelCount][secondLevelCount];
+
+    uint64_t totalSize = 0;
+    uint64_t usedSize = 0;
+    uint32_t allocations = 0;
+
+    static uint32_t highestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+    }
+
+    static uint32_t lowestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+    }
+
+    static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+        if (size < smallSize) {
+            fl = 0;
+            sl = static_cast<uint32_t>(size / (smallSize / secondLevelCount));
+        }
+        else {
+            uint32_t bit = highestBit(size);
+            fl = bit - smallBits + 1;
+            sl = static_cast<uint32_t>(size >> (bit - secondLevelBits)) - secondLevelCount;
+        }
+    }
+
+    // size 이상인 빈 블록이 "반드시" 들어있는 가장 작은 버킷에서 블록을 찾는다.
+    uint32_t findFree(uint64_t size) const {
+        if (size < smallSize) {
+            size = alignUp(size, smallSize / secondLevelCount);
+        }
+        else {
+            uint64_t round = (1ull << (highestBit(size) - secondLevelBits)) - 1;
+            if (size > UINT64_MAX - round) {
+                return invalidHandle;
+            }
+            size += round;
+        }
+
+        uint32_t fl, sl;
+        mapping(size, fl, sl);
+        if (fl >= firstLevelCount) {
+            return invalidHandle;
+        }
+
+        uint32_t slMap = sl < secondLevelCount ? secondLevelMap[fl] & (~0u << sl) : 0;
+        if (slMap == 0) {
+            uint64_t flMap = fl + 1 < 64 ? firstLevelMap & (~0ull << (fl + 1)) : 0;
+            if (flMap == 0) {
+                return invalidHandle;
+            }
+            fl = lowestBit(flMap);
+            slMap = secondLevelMap[fl];
+        }
+        sl = lowestBit(slMap);
+
+        return freeHeads[fl][sl];
+    }
+
+    bool fits(uint32_t block, uint64_t size, uint64_t alignment) const {
+        uint64_t padding = alignUp(blocks[block].offset, alignment) - blocks[block].offset;
+        return padding + size <= blocks[block].size;
+    }
+
+    void insertFree(uint32_t block) {
+        uint32_t fl, sl;
+        mapping(blocks[block].size, fl, sl);
+
+        blocks[block].free = true;
+        blocks[block].prevFree = invalidHandle;
+        blocks[block].nextFree = freeHeads[fl][sl];
+        if (freeHeads[fl][sl] != invalidHandle) {
+            blocks[freeHeads[fl][sl]].prevFree = block;
+        }
+        freeHeads[fl][sl] = block;
+
+        firstLevelMap |= 1ull << fl;
+        secondLevelMap[fl] |= 1u << sl;
+    }
+
+    void removeFree(uint32_t block) {
+        uint32_t fl, sl;
+        mapping(blocks[block].size, fl, sl);
+
+        uint32_t prev = blocks[block].prevFree;
+        uint32_t next = blocks[block].nextFree;
+        if (prev != invalidHandle) {
+            blocks[prev].nextFree = next;
+        }
+        else {
+            freeHeads[fl][sl] = next;
+        }
+        if (next != invalidHandle) {
+            blocks[next].prevFree = prev;
+        }
+
+        if (freeHeads[fl][sl] == invalidHandle) {
+            secondLevelMap[fl] &= ~(1u << sl);
+            if (secondLevelMap[fl] == 0) {
+                firstLevelMap &= ~(1ull << fl);
+            }
+        }
+    }
+
+    bool isInFreeList(uint32_t target) const {
+        uint32_t fl, sl;
+        mapping(blocks[target].size, fl, sl);
+        for (uint32_t block = freeHeads[fl][sl]; block != invalidHandle; block = blocks[block].nextFree) {
+            if (block == target) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t newBlock() {
+        uint32_t block;
+        if (!unusedBlocks.empty()) {
+            block = unusedBlocks.back();
+            unusedBlocks.pop_back();
+            blocks[block] = Block{};
+        }
+        else {
+            block = static_cast<uint32_t>(blocks.size());
+            blocks.emplace_back();
+        }
+        return block;
+    }
+
+    void linkBefore(uint32_t block, uint32_t next) {
+        uint32_t prev = blocks[next].prevPhysical;
+        blocks[block].prevPhysical = prev;
+        blocks[block].nextPhysical = next;
+        blocks[next].prevPhysical = block;
+        if (prev != invalidHandle) {
+            blocks[prev].nextPhysical = block;
+        }
+        else {
+            firstBlock = block;
+        }
+    }
+
+    void linkAfter(uint32_t block, uint32_t prev) {
+        uint32_t next = blocks[prev].nextPhysical;
+        blocks[block].prevPhysical = prev;
+        blocks[block].nextPhysical = next;
+        blocks[prev].nextPhysical = block;
+        if (next != invalidHandle) {
+            blocks[next].prevPhysical = block;
+        }
+    }
+
+    // 합쳐져서 사라지는 블록을 물리 리스트에서 빼고 노드를 재사용 목록에 넣는다.
+    void unlink(uint32_t block) {
+        uint32_t prev = blocks[block].prevPhysical;
+        uint32_t next = blocks[block].nextPhysical;
+        if (prev != invalidHandle) {
+            blocks[prev].nextPhysical = next;
+        }
+        else {
+            firstBlock = next;
+        }
+        if (next != invalidHandle) {
+            blocks[next].prevPhysical = prev;
+        }
+
+        blocks[block].live = false;
+        unusedBlocks.push_back(block);
+    }
+};
+
+
+// GpuAllocator가 돌려주는 할당 정보
+struct GpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr; // HOST_VISIBLE 메모리면 영구적으로 매핑된 주소 (offset이 이미 더해져 있다)
+    uint32_t memoryType = 0;
+
+    uint32_t pool = UINT32_MAX; // UINT32_MAX면 dedicated 할당
+    uint32_t block = 0;
+    uint32_t handle = TlsfAllocator::invalidHandle;
+
+    bool isDedicated() const {
+        return pool == UINT32_MAX;
+    }
+};
+
+
+// VkDeviceMemory를 큰 블록으로 잡아서 TLSF로 나눠주는 디바이스 메모리 할당기
+//
+// 리소스마다 vkAllocateMemory를 부르면 드라이버 호출 비용이 매번 들고, 금방 maxMemoryAllocationCount(보통 4096)에 걸린다.
+// 메모리 타입마다 블록(기본 64 MiB)을 잡아두고 그 안에서 잘라 쓴다.
+//
+// bufferImageGranularity: 같은 VkDeviceMemory 안에서 linear 리소스(버퍼)와 optimal 이미지가 이 값보다 가까이 붙어있으면 안된다.
+// 메모리 타입마다 linear용 풀과 optimal용 풀을 따로 두면 한 블록 안에는 한 종류만 들어가니 신경쓸 필요가 없어진다.
+//
+// 블록 크기의 절반이 넘는 리소스나 드라이버가 원하는 리소스(VkMemoryDedicatedRequirements)는 전용 할당을 한다.
+class GpuAllocator {
+public:
+    enum class ResourceKind {
+        Linear, // 버퍼, linear 타일링 이미지
+        Optimal, // optimal 타일링 이미지
+    };
+
+    struct HeapStats {
+        VkDeviceSize heapSize = 0;
+        VkMemoryHeapFlags flags = 0;
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0; // 블록 안의 할당 + 전용 할당
+        VkDeviceSize reservedBytes = 0; // vkAllocateMemory로 잡은 전체 크기
+        VkDeviceSize usedBytes = 0; // 그 중 실제로 리소스에 나눠준 크기
+    };
+
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024) {
+        this->device = device;
+        this->preferredBlockSize = preferredBlockSize;
+
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+        pools.clear();
+        pools.resize(memoryProperties.memoryTypeCount * 2);
+        dedicatedCounts.assign(memoryProperties.memoryHeapCount, 0);
+        dedicatedBytes.assign(memoryProperties.memoryHeapCount, 0);
+        deviceAllocationCount = 0;
+    }
+
+    VkBuffer createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties, GpuAllocation& allocation) {
+        VkBuffer buffer;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.buffer = buffer;
+
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        vkGetBufferMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
+
+        try {
+            allocation = allocate(requirements.memoryRequirements, properties, ResourceKind::Linear,
+                dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation, &dedicatedInfo);
+        }
+        catch (...) {
+            vkDestroyBuffer(device, buffer, nullptr);
+            throw;
+        }
+
+        vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+        return buffer;
+    }
+
+    VkImage createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, GpuAllocation& allocation) {
+        VkImage image;
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkImageMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        vkGetImageMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
+
+        ResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+        try {
+            allocation = allocate(requirements.memoryRequirements, properties, kind,
+                dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation, &dedicatedInfo);
+        }
+        catch (...) {
+            vkDestroyImage(device, image, nullptr);
+            throw;
+        }
+
+        vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+        return image;
+    }
+
+    void destroyBuffer(VkBuffer buffer, GpuAllocation& allocation) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        free(allocation);
+    }
+
+    void destroyImage(VkImage image, GpuAllocation& allocation) {
+        vkDestroyImage(device, image, nullptr);
+        free(allocation);
+    }
+
+    // dedicatedInfo는 전용 할당을 할 때만 pNext로 붙는다.
+    GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind,
+        bool preferDedicated = false, const VkMemoryDedicatedAllocateInfo* dedicatedInfo = nullptr) {
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+
+        bool dedicated = preferDedicated || requirements.size > preferredBlockSize / 2;
+
+        // 조건에 맞는 메모리 타입을 순서대로 시도한다. 한 타입의 힙이 가득 차면 다음 타입으로 넘어간다.
+        for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+            if (!(requirements.memoryTypeBits & (1u << type))
+                || (memoryProperties.memoryTypes[type].propertyFlags & properties) != properties) {
+                continue;
+            }
+
+            GpuAllocation allocation;
+            bool allocated = dedicated
+                ? allocateDedicated(type, requirements.size, dedicatedInfo, allocation)
+                : allocateFromPool(type, kind, requirements.size, requirements.alignment, allocation);
+            if (allocated) {
+                return allocation;
+            }
+        }
+
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    void free(GpuAllocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+
+        if (allocation.isDedicated()) {
+            uint32_t heap = memoryProperties.memoryTypes[allocation.memoryType].heapIndex;
+            dedicatedCounts[heap]--;
+            dedicatedBytes[heap] -= allocation.size;
+            vkFreeMemory(device, allocation.memory, nullptr); // 매핑돼 있었으면 같이 풀린다.
+            deviceAllocationCount--;
+        }
+        else {
+            Pool& pool = pools[allocation.pool];
+            Block& block = *pool.blocks[allocation.block];
+            block.tlsf.free(allocation.handle);
+
+            // 빈 블록은 하나만 남겨두고 반환한다. (할당, 해제가 반복될 때 vkAllocateMemory를 계속 부르지 않도록)
+            if (block.tlsf.isEmpty() && countEmptyBlocks(pool) > 1) {
+                vkFreeMemory(device, block.memory, nullptr);
+                pool.blocks[allocation.block].reset();
+                deviceAllocationCount--;
+            }
+        }
+
+        allocation = GpuAllocation{};
+    }
+
+    // 할당받은 메모리가 HOST_COHERENT인지 등을 확인할 때 쓴다.
+    VkMemoryPropertyFlags memoryPropertyFlags(uint32_t memoryType) const {
+        return memoryProperties.memoryTypes[memoryType].propertyFlags;
+    }
+
+    std::vector<HeapStats> heapStats() {
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+
+        std::vector<HeapStats> stats(memoryProperties.memoryHeapCount);
+        for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+            stats[heap].heapSize = memoryProperties.memoryHeaps[heap].size;
+            stats[heap].flags = memoryProperties.memoryHeaps[heap].flags;
+            stats[heap].dedicatedCount = dedicatedCounts[heap];
+            stats[heap].allocationCount = dedicatedCounts[heap];
+            stats[heap].reservedBytes = dedicatedBytes[heap];
+            stats[heap].usedBytes = dedicatedBytes[heap];
+        }
+
+        for (uint32_t poolIndex = 0; poolIndex < pools.size(); poolIndex++) {
+            HeapStats& heapStats = stats[memoryProperties.memoryTypes[poolIndex / 2].heapIndex];
+            for (const auto& block : pools[poolIndex].blocks) {
+                if (block) {
+                    heapStats.blockCount++;
+                    heapStats.allocationCount += block->tlsf.allocationCount();
+                    heapStats.reservedBytes += block->tlsf.size();
+                    heapStats.usedBytes += block->tlsf.usedBytes();
+                }
+            }
+        }
+
+        return stats;
+    }
+
+    void printStats(std::ostream& out) {
+        std::vector<HeapStats> stats = heapStats();
+        for (uint32_t heap = 0; heap < stats.size(); heap++) {
+            const HeapStats& heapStats = stats[heap];
+            out << "gpu allocator: heap " << heap << ((heapStats.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "")
+                << " " << (heapStats.usedBytes >> 10) << " KiB used / " << (heapStats.reservedBytes >> 10) << " KiB reserved / "
+                << (heapStats.heapSize >> 20) << " MiB heap, " << heapStats.allocationCount << " allocations in "
+                << heapStats.blockCount << " blocks + " << heapStats.dedicatedCount << " dedicated\n";
+        }
+    }
+
+    // 남아있는 할당이 있어도 블록을 전부 반환한다. 리소스를 먼저 파괴한 뒤에 호출해야 한다.
+    void destroy() {
+        std::lock_guard<std::mutex> lock(allocatorMutex);
+
+        for (Pool& pool : pools) {
+            for (auto& block : pool.blocks) {
+                if (block) {
+                    vkFreeMemory(device, block->memory, nullptr);
+                }
+            }
+            pool.blocks.clear();
+        }
+        deviceAllocationCount = 0;
+    }
+
+private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* mapped = nullptr;
+        TlsfAllocator tlsf;
+    };
+
+    // 메모리 타입 * 2 + ResourceKind 마다 하나
+    struct Pool {
+        std::vector<std::unique_ptr<Block>> blocks; // 반환된 블록 자리는 nullptr로 남겨서 다른 할당의 block 인덱스가 바뀌지 않게 한다.
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDeviceSize preferredBlockSize = 0;
+    uint32_t maxAllocationCount = 0;
+    uint32_t deviceAllocationCount = 0; // 지금까지 살아있는 vkAllocateMemory 횟수
+
+    std::mutex allocatorMutex;
+    std::vector<Pool> pools;
+    std::vector<uint32_t> dedicatedCounts; // 힙마다
+    std::vector<VkDeviceSize> dedicatedBytes;
+
+    bool allocateFromPool(uint32_t type, ResourceKind kind, VkDeviceSize size, VkDeviceSize alignment, GpuAllocation& allocation) {
+        uint32_t poolIndex = type * 2 + (kind == ResourceKind::Optimal ? 1 : 0);
+        Pool& pool = pools[poolIndex];
+
+        TlsfAllocator::Allocation range;
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (pool.blocks[i] && pool.blocks[i]->tlsf.allocate(size, alignment, range)) {
+                fillAllocation(allocation, *pool.blocks[i], type, poolIndex, i, range);
+                return true;
+            }
+        }
+
+        // 힙이 작으면(ex. 256 MiB짜리 BAR 힙) 블록 하나가 힙을 다 차지하지 않도록 블록을 줄인다.
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[type].heapIndex].size;
+        VkDeviceSize blockSize = std::min(preferredBlockSize, std::max<VkDeviceSize>(heapSize / 8, size));
+
+        std::unique_ptr<Block> block = std::make_unique<Block>();
+        if (!allocateDeviceMemory(type, blockSize, nullptr, block->memory, block->mapped)) {
+            return false;
+        }
+        block->tlsf.reset(blockSize);
+
+        uint32_t blockIndex = static_cast<uint32_t>(pool.blocks.size());
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (!pool.blocks[i]) {
+                blockIndex = i;
+                break;
+            }
+        }
+        if (blockIndex == pool.blocks.size()) {
+            pool.blocks.push_back(std::move(block));
+        }
+        else {
+            pool.blocks[blockIndex] = std::move(block);
+        }
+
+        if (!pool.blocks[blockIndex]->tlsf.allocate(size, alignment, range)) {
+            return false; // 정렬 때문에 새 블록에도 안 들어가는 경우. 블록은 다음 할당에 쓰인다.
+        }
+        fillAllocation(allocation, *pool.blocks[blockIndex], type, poolIndex, blockIndex, range);
+        return true;
+    }
+
+    bool allocateDedicated(uint32_t type, VkDeviceSize size, const VkMemoryDedicatedAllocateInfo* dedicatedInfo, GpuAllocation& allocation) {
+        VkDeviceMemory memory;
+        void* mapped;
+        if (!allocateDeviceMemory(type, size, dedicatedInfo, memory, mapped)) {
+            return false;
+        }
+
+        uint32_t heap = memoryProperties.memoryTypes[type].heapIndex;
+        dedicatedCounts[heap]++;
+        dedicatedBytes[heap] += size;
+
+        allocation.memory = memory;
+        allocation.offset = 0;
+        allocation.size = size;
+        allocation.mapped = mapped;
+        allocation.memoryType = type;
+        allocation.pool = UINT32_MAX;
+        return true;
+    }
+
+    bool allocateDeviceMemory(uint32_t type, VkDeviceSize size, const void* pNext, VkDeviceMemory& memory, void*& mapped) {
+        if (maxAllocationCount != 0 && deviceAllocationCount >= maxAllocationCount) {
+            throw std::runtime_error("gpu allocator: maxMemoryAllocationCount exceeded!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = pNext;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = type;
+
+        VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+            return false; // 다른 메모리 타입으로 다시 시도한다.
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+        deviceAllocationCount++;
+
+        mapped = nullptr;
+        if (memoryProperties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            // 블록 전체를 한 번만 매핑해두고 계속 쓴다. (vkMapMemory도 드라이버 호출이라 매번 부르면 느리다)
+            if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+                vkFreeMemory(device, memory, nullptr);
+                deviceAllocationCount--;
+                throw std::runtime_error("failed to map device memory!");
+            }
+        }
+        return true;
+    }
+
+    static void fillAllocation(GpuAllocation& allocation, const Block& block, uint32_t type, uint32_t pool, uint32_t blockIndex,
+        const TlsfAllocator::Allocation& range) {
+        allocation.memory = block.memory;
+        allocation.offset = range.offset;
+        allocation.size = range.size;
+        allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+        allocation.memoryType = type;
+        allocation.pool = pool;
+        allocation.block = blockIndex;
+        allocation.handle = range.handle;
+    }
+
+    static uint32_t countEmptyBlocks(const Pool& pool) {
+        uint32_t count = 0;
+        for (const auto& block : pool.blocks) {
+            if (block && block->tlsf.isEmpty()) {
+                count++;
+            }
+        }
+        return count;
+    }
+};
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+#include "BenchmarkReport.h"
+
+
+// --allocator-benchmark: TLSF 할당기를 임의의 할당/해제 패턴으로 돌려보면서 시간을 재고, 끝난 뒤 결과가 맞는지 확인한다.
+// GPU가 없어도 돌아가기 때문에 할당 알고리즘을 고칠 때 이것부터 돌려보면 된다.
+namespace GpuAllocatorBenchmark {
+
+inline bool run() {
+    struct Scenario {
+        const char* name;
+        uint64_t minSize;
+        uint64_t maxSize;
+        uint32_t largePercent; // 이 확률로 maxSize * 64까지의 큰 할당을 섞는다.
+        uint32_t maxAlignmentBits; // 정렬은 1 ~ 2^maxAlignmentBits 중에서 고른다.
+        uint32_t allocatePercent;
+    };
+
+    const Scenario scenarios[] = {
+        { "small buffers", 64, 4096, 0, 8, 55 },
+        { "mixed buffers and images", 256, 65536, 2, 16, 50 },
+        { "steady-state churn", 16, 1 << 20, 1, 12, 50 },
+    };
+
+    const uint64_t arenaSize = 256ull * 1024 * 1024;
+    const uint32_t operationCount = 1000000;
+    BenchmarkReport report("allocator benchmark");
+
+    for (const Scenario& scenario : scenarios) {
+        TlsfAllocator allocator(arenaSize);
+        std::mt19937_64 random(1234);
+        std::vector<TlsfAllocator::Allocation> live;
+        std::vector<uint64_t> alignments;
+        uint32_t failedAllocations = 0;
+        uint64_t peakUsed = 0;
+
+        // 난수 생성 시간은 측정에서 빼기 위해 요청을 미리 만들어둔다.
+        struct Request { bool allocate; uint64_t size; uint64_t alignment; uint64_t pick; };
+        std::vector<Request> requests(operationCount);
+        for (Request& request : requests) {
+            request.allocate = random() % 100 < scenario.allocatePercent;
+            uint64_t maxSize = random() % 100 < scenario.largePercent ? scenario.maxSize * 64 : scenario.maxSize;
+            request.size = scenario.minSize + random() % (maxSize - scenario.minSize + 1);
+            request.alignment = 1ull << (random() % (scenario.maxAlignmentBits + 1));
+            request.pick = random();
+        }
+
+        double elapsedMs = BenchmarkReport::measure([&] {
+            for (const Request& request : requests) {
+                if (request.allocate || live.empty()) {
+                    TlsfAllocator::Allocation allocation;
+                    if (allocator.allocate(request.size, request.alignment, allocation)) {
+                        live.push_back(allocation);
+                        alignments.push_back(request.alignment);
+                        peakUsed = std::max(peakUsed, allocator.usedBytes());
+                    }
+                    else {
+                        failedAllocations++;
+                    }
+                }
+                else {
+                    size_t index = request.pick % live.size();
+                    allocator.free(live[index].handle);
+                    live[index] = live.back();
+                    live.pop_back();
+                    alignments[index] = alignments.back();
+                    alignments.pop_back();
+                }
+            }
+        });
+
+        // 검증: 내부 자료구조, 정렬, 겹치는 할당이 없는지
+        bool passed = allocator.validate();
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        for (size_t i = 0; i < live.size(); i++) {
+            passed = passed && live[i].offset % alignments[i] == 0 && live[i].offset + live[i].size <= arenaSize;
+            ranges.push_back({ live[i].offset, live[i].size });
+        }
+        std::sort(ranges.begin(), ranges.end());
+        for (size_t i = 1; i < ranges.size(); i++) {
+            passed = passed && ranges[i - 1].first + ranges[i - 1].second <= ranges[i].first;
+        }
+
+        uint64_t freeBytes = arenaSize - allocator.usedBytes();
+        double fragmentation = freeBytes > 0 ? 1.0 - static_cast<double>(allocator.largestFreeBlock()) / freeBytes : 0.0;
+
+        for (const TlsfAllocator::Allocation& allocation : live) {
+            allocator.free(allocation.handle);
+        }
+        passed = passed && allocator.validate() && allocator.isEmpty() && allocator.largestFreeBlock() == arenaSize;
+
+        report.line() << scenario.name << ": " << operationCount << " ops in " << elapsedMs << " ms ("
+            << elapsedMs * 1000000.0 / operationCount << " ns/op), peak " << (peakUsed >> 20) << " MiB, "
+            << failedAllocations << " failed, fragmentation " << fragmentation * 100.0 << "%";
+        report.result(passed);
+    }
+
+    return report.passed();
+}
+
+} // namespace GpuAllocatorBenchmark
@@ -9,23 +9,349 @@
 #include <vector>
 #include <cstring>
 #include <optional>
+#include <array>
 #include <set>
 #include <algorithm>
 #include <string>
-#include <fstream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <future>
 
 
 #include <glm/glm.hpp>
+
+#include "PipelineCache.h"
+#include "PipelineBuilder.h"
+#include "StartupProfiler.h"
+#include "StartupScheduler.h"
+#include "ShaderBlob.h"
+#include "ShaderLibrary.h"
+#include "DeviceSelector.h"
+#include "DeviceCapabilities.h"
+#include "TransferQueue.h"
+#include "GpuAllocator.h"
+#include "MeshBuffer.h"
+#include "StagingRing.h"
+#include "VertexLayout.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
+#include "MeshImporter.h"
+#include "FrameBenchmark.h"
+#include "CommandBufferCache.h"
+#include "ParallelRecorder.h"
+#include "JobSystem.h"
+#include "RenderGraph.h"
+#include "FramePacer.h"
+#include "LatencyProfile.h"
+#include "GpuAllocatorBenchmark.h"
+#include "MeshOptimizerBenchmark.h"
+#include "JobSystemBenchmark.h"
+#include "RenderGraphTest.h"
 /*
     여기부터
 
 */
 
-struct Vertex {
+// 원본 정점 데이터. 파일에서 읽거나 코드로 만든 float 데이터는 이 모양이다.
+struct SourceVertex {
     glm::vec2 pos;
     glm::vec3 color;
 };
 
+// GPU에 올라가는 정점. float 그대로면 20바이트인데 위치는 half, 색은 8비트 unorm으로 줄여서 8바이트다.
+// shader.vert는 여전히 vec2 inPosition, vec3 inColor로 받는다. (vertex fetch가 float로 풀어준다)
+struct Vertex {
+    VertexLayout::half2 pos;
+    VertexLayout::unorm8x4 color;
+};
+
+namespace VertexLayout {
+    // shader.vert의 layout(location = 0) inPosition, layout(location = 1) inColor와 대응된다.
+    template<> struct Traits<Vertex> {
+        static constexpr auto fields = VertexLayout::fields(
+            VERTEX_FIELD(Vertex, pos, 0),
+            VERTEX_FIELD(Vertex, color, 1));
+    };
+}
+
+static_assert(sizeof(Vertex) == 8, "Vertex should stay packed");
+
+// 인스턴스마다 읽는 데이터 (binding 1, VK_VERTEX_INPUT_RATE_INSTANCE)
+// 2D라서 mat4(64바이트) 대신 위치와 회전*크기만 half로 넣어 12바이트로 줄였다. 인스턴스가 많을수록 프레임마다 쓰는 양이 줄어든다.
+struct InstanceData {
+    VertexLayout::half4 transform; // xy: 위치, zw: (cos, sin) * scale
+    VertexLayout::unorm8x4 color; // 메시의 정점 색에 곱해진다.
+};
+
+namespace VertexLayout {
+    // instanced.vert의 layout(location = 2) inInstanceTransform, layout(location = 3) inInstanceColor와 대응된다.
+    template<> struct Traits<InstanceData> {
+        static constexpr auto fields = VertexLayout::fields(
+            VERTEX_FIELD(InstanceData, transform, 2),
+            VERTEX_FIELD(InstanceData, color, 3));
+    };
+}
+
+static_assert(sizeof(InstanceData) == 12, "InstanceData should stay packed");
+
+const std::vector<SourceVertex> sourceVertices = {
+    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
+};
+
+// float 원본을 Vertex로 압축한다. 필드마다 SIMD로 한 번에 변환한다.
+std::vector<Vertex> packVertices(const std::vector<SourceVertex>& source) {
+    std::vector<Vertex> packed(source.size());
+    std::vector<float> positions;
+    std::vector<float> colors;
+    positions.reserve(source.size() * 2);
+    colors.reserve(source.size() * 3);
+    for (const SourceVertex& vertex : source) {
+        positions.insert(positions.end(), { vertex.pos.x, vertex.pos.y });
+        colors.insert(colors.end(), { vertex.color.x, vertex.color.y, vertex.color.z });
+    }
+
+    VertexLayout::quantizeField(packed, &Vertex::pos, positions.data(), 2);
+    VertexLayout::quantizeField(packed, &Vertex::color, colors.data(), 3); // alpha는 1.0으로 채운다.
+    return packed;
+}
+
+const std::vector<uint16_t> indices = {
+    0, 1, 2, 2, 3, 0
+};
+// 사각형 하나를 삼각형 두 개로 그린다. 인덱스를 쓰면 겹치는 정점 두 개를 다시 넣지 않아도 된다.
+
+// 커맨드라인으로 넘겨받는 실행 옵션들
+// --headless: 디스플레이가 없는 환경(CI, 렌더 서버)에서 GLFW 윈도우, surface, swapchain 없이
+//             device가 소유한 VkImage에 offscreen으로 렌더링한다. lavapipe같은 software ICD로도 동작한다.
+//             ex) VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./HelloTriangleApp --headless --frames 1000
+// --frames N: headless 모드에서 렌더링할 프레임 수
+// --pipeline-cache path: 파이프라인 캐시를 저장하고 불러올 파일 경로
+// --pipeline-threads N: 파이프라인 컴파일에 사용할 워커 스레드 수 (기본값은 코어 수 - 1, 만들 파이프라인 수를 넘지 않는다)
+// --startup-trace path: 시작 단계별 소요 시간을 저장할 Chrome trace JSON 경로
+// --serial-startup: 시작 단계들을 예전처럼 하나의 스레드에서 순서대로 실행한다. (동시 초기화와 비교용)
+// --device index|name|uuid: 자동으로 고른 GPU 대신 사용할 물리 디바이스 (VULKAN_DEVICE 환경 변수보다 우선한다)
+// --allocator-benchmark: Vulkan을 초기화하지 않고 GpuAllocator가 쓰는 TLSF 알고리즘만 검증하고 속도를 잰 뒤 종료한다.
+// --mesh-benchmark: 큰 합성 메시들에 MeshOptimizer를 한 스레드, 여러 스레드(--pipeline-threads개)로 돌려보고 ACMR/ATVR과 시간을 출력한 뒤 종료한다.
+// --staging-ring-kib N: 프레임마다 쓸 수 있는 staging ring의 크기 (종료할 때 출력되는 high-water mark를 보고 정한다)
+// --mesh-cache path: 내장 메시를 GPU 버퍼 모양 그대로 저장해둘 파일 경로. 있으면 파싱 없이 매핑해서 올리고, 없으면 새로 만든다.
+//      주지 않으면 내장 메시는 캐시를 쓰지 않는다. (작업 디렉터리에 파일을 만들지 않는다)
+// --mesh path: 내장 사각형 대신 그릴 .obj, .gltf, .glb 파일. 캐시는 path.meshcache에 만들고 원본이 더 새로우면 다시 임포트한다.
+// --no-mesh-cache: 메시 캐시를 읽지도 쓰지도 않는다. (임포터 속도를 잴 때)
+// --instances N: 메시를 N개 인스턴스로 한 번의 드로우 콜에 그린다. 인스턴스 데이터는 프레임마다 staging ring에 쓴다. (0이면 인스턴싱 없이 하나)
+// --draw-benchmark separate|instanced|indirect: 메시 --benchmark-objects개를 오브젝트마다 드로우 콜 하나씩, 인스턴싱 한 번, indirect로 그리고
+//             --warmup-frames개를 버린 뒤 --frames개 프레임의 CPU 기록/제출 시간과 GPU 시간을 --benchmark-output(.json 또는 .csv)에 저장한다.
+//             ex) ./HelloTriangleApp --headless --draw-benchmark indirect --benchmark-objects 10000 --frames 500 --benchmark-output indirect.csv
+// --job-threads N: 프레임 작업(인스턴스 변환 갱신 등)을 나눠 실행할 JobSystem의 워커 스레드 수 (기본값은 코어 수 - 1, 0이면 메인 스레드만)
+// --render-graph-test: GPU 없이 RenderGraph로 여러 그래프를 컴파일해서 컬링, 배리어, 레이아웃, 메모리 별칭이 맞는지 검사하고 종료한다.
+// --job-benchmark: Vulkan을 초기화하지 않고 JobSystem과 std::async로 작은 작업들과 프레임 모양의 작업 그래프를 돌려 시간을 비교한 뒤 종료한다.
+// --no-command-cache: 커맨드 버퍼를 캐시하지 않고 매 프레임 다시 기록한다. (기록 비용을 잴 때)
+// --record-threads N: 오브젝트 드로우 콜을 N개 secondary command buffer로 나눠 JobSystem(--job-threads와 메인 스레드)에서 기록한다. (1이면 메인 스레드에서만)
+//             secondary는 매 프레임 다시 기록하므로 이 모드에서는 커맨드 버퍼 캐시를 쓰지 않는다.
+//             ex) ./HelloTriangleApp --headless --draw-benchmark separate --benchmark-objects 20000 --record-threads 4
+// --latency-profile low|balanced|throughput: in flight 프레임 수와 swapchain 이미지 수 (1프레임/minImageCount장, 2/+1, 3/+2. 기본값은 balanced)
+//             창 모드에서는 실행 중에 1, 2, 3 키로 바꿀 수 있고, 종료할 때 써본 프로파일마다 FPS와 입력에서 GPU 완료까지의 지연을 출력한다.
+// --latency-sweep: headless 모드에서 세 프로파일을 차례로 --frames개씩 그리고 프로파일마다 FPS와 지연을 출력한다.
+//             ex) ./HelloTriangleApp --headless --instances 10000 --frames 600 --latency-sweep
+// --shader-dir path: 실행 파일에 들어있는 셰이더 대신 path의 vert.spv, frag.spv를 읽는다. (다시 빌드하지 않고 셰이더를 고칠 때)
+// --instances와 --draw-benchmark의 오브젝트들을 어떻게 그릴지
+enum class DrawMode {
+    Instanced, // vkCmdDrawIndexed 한 번에 instanceCount = N
+    Separate, // 오브젝트마다 vkCmdDrawIndexed 한 번 (firstInstance로 인스턴스 데이터를 고른다)
+    Indirect, // 드로우 명령을 버퍼에 써두고 vkCmdDrawIndexedIndirect (multiDrawIndirect가 있으면 한 번)
+};
+
+static const char* drawModeName(DrawMode mode) {
+    switch (mode) {
+    case DrawMode::Separate: return "separate";
+    case DrawMode::Indirect: return "indirect";
+    default: return "instanced";
+    }
+}
+
+struct AppOptions {
+    bool headless = false;
+    uint32_t frameCount = 300;
+    uint32_t offscreenImageCount = 3; // swapchain의 이미지 개수처럼 offscreen 렌더 타겟을 몇 장 돌려쓸지
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    uint32_t pipelineThreadCount = WorkerPool::defaultThreadCount();
+    std::string startupTracePath = "startup_trace.json";
+    bool serialStartup = false;
+    std::string shaderDirectory; // 비어있으면 ShaderLibrary에 들어있는 SPIR-V를 쓴다.
+    std::string meshCachePath; // 비어 있으면 내장 메시는 캐시하지 않는다.
+    std::string meshPath; // 비어있으면 내장 사각형을 그린다.
+    bool useMeshCache = true;
+    uint32_t instanceCount = 0;
+    DrawMode drawMode = DrawMode::Instanced;
+    bool drawBenchmark = false;
+    uint32_t benchmarkObjectCount = 10000;
+    uint32_t warmupFrames = 60;
+    std::string benchmarkOutputPath = "draw_benchmark.json";
+    bool useCommandBufferCache = true;
+    uint32_t recordThreadCount = 1;
+    uint32_t jobThreadCount = WorkerPool::defaultThreadCount();
+    bool jobBenchmark = false;
+    bool renderGraphTest = false;
+    LatencyProfile::Mode latencyMode = LatencyProfile::Mode::Balanced;
+    bool latencySweep = false;
+    std::string deviceOverride; // 비어있으면 DeviceSelector가 점수로 고른다.
+    bool allocatorBenchmark = false;
+    bool meshBenchmark = false;
+    uint32_t stagingRingKiBPerFrame = 4096;
+};
+
+static AppOptions parseAppOptions(int argc, char** argv) {
+    AppOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--pipeline-cache" && i + 1 < argc) {
+            options.pipelineCachePath = argv[++i];
+        }
+        else if (arg == "--pipeline-threads" && i + 1 < argc) {
+            options.pipelineThreadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--startup-trace" && i + 1 < argc) {
+            options.startupTracePath = argv[++i];
+        }
+        else if (arg == "--serial-startup") {
+            options.serialStartup = true;
+        }
+        else if (arg == "--shader-dir" && i + 1 < argc) {
+            options.shaderDirectory = argv[++i];
+        }
+        else if (arg == "--mesh-cache" && i + 1 < argc) {
+            options.meshCachePath = argv[++i];
+        }
+        else if (arg == "--mesh" && i + 1 < argc) {
+            options.meshPath = argv[++i];
+        }
+        else if (arg == "--no-mesh-cache") {
+            options.useMeshCache = false;
+        }
+        else if (arg == "--instances" && i + 1 < argc) {
+            options.instanceCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--draw-benchmark" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "separate") {
+                options.drawMode = DrawMode::Separate;
+            }
+            else if (mode == "instanced") {
+                options.drawMode = DrawMode::Instanced;
+            }
+            else if (mode == "indirect") {
+                options.drawMode = DrawMode::Indirect;
+            }
+            else {
+                throw std::runtime_error("unknown draw benchmark mode: " + mode);
+            }
+            options.drawBenchmark = true;
+        }
+        else if (arg == "--benchmark-objects" && i + 1 < argc) {
+            options.benchmarkObjectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--warmup-frames" && i + 1 < argc) {
+            options.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--benchmark-output" && i + 1 < argc) {
+            options.benchmarkOutputPath = argv[++i];
+        }
+        else if (arg == "--no-command-cache") {
+            options.useCommandBufferCache = false;
+        }
+        else if (arg == "--record-threads" && i + 1 < argc) {
+            options.recordThreadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--job-threads" && i + 1 < argc) {
+            options.jobThreadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--job-benchmark") {
+            options.jobBenchmark = true;
+        }
+        else if (arg == "--render-graph-test") {
+            options.renderGraphTest = true;
+        }
+        else if (arg == "--latency-profile" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (!LatencyProfile::parse(name, options.latencyMode)) {
+                throw std::runtime_error("unknown latency profile: " + name);
+            }
+        }
+        else if (arg == "--latency-sweep") {
+            options.latencySweep = true;
+        }
+        else if (arg == "--device" && i + 1 < argc) {
+            options.deviceOverride = argv[++i];
+        }
+        else if (arg == "--allocator-benchmark") {
+            options.allocatorBenchmark = true;
+        }
+        else if (arg == "--mesh-benchmark") {
+            options.meshBenchmark = true;
+        }
+        else if (arg == "--staging-ring-kib" && i + 1 < argc) {
+            options.stagingRingKiBPerFrame = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (options.drawBenchmark) {
+        options.instanceCount = std::max(options.benchmarkObjectCount, 1u); // 오브젝트마다의 위치, 색은 인스턴스 데이터로 넘어간다.
+    }
+    if (options.latencySweep && (!options.headless || options.drawBenchmark)) {
+        throw std::runtime_error("--latency-sweep needs --headless and can't be combined with --draw-benchmark");
+        // 벤치마크의 타임스탬프 쿼리는 프레임 슬롯 수만큼 만들어두기 때문에 중간에 슬롯 수가 바뀌면 안 된다.
+    }
+
+    return options;
+}
+
+// 메시 파일을 임포트해서 화면에 맞게 xy 평면으로 옮기고 MeshOptimizer로 정리한다.
+// 셰이더가 아직 변환 행렬 없이 위치를 그대로 쓰기 때문에 바운딩 박스를 [-0.9, 0.9]에 맞춘다. (Vulkan의 y는 아래쪽이라 뒤집는다)
+static MeshOptimizer::Mesh<SourceVertex> importSourceMesh(const std::string& path, uint32_t threadCount) {
+    MeshImporter::ImportedMesh imported = MeshImporter::importFile(path, threadCount);
+    if (imported.indices.empty()) {
+        throw std::runtime_error("failed to import mesh: " + path + " has no triangles!");
+    }
+
+    glm::vec3 boundsMin = imported.positions[0];
+    glm::vec3 boundsMax = imported.positions[0];
+    for (const glm::vec3& position : imported.positions) {
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float extent = std::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y);
+    float scale = extent > 0.0f ? 1.8f / extent : 1.0f;
+
+    MeshOptimizer::Mesh<SourceVertex> mesh;
+    mesh.vertices.resize(imported.positions.size());
+    for (size_t i = 0; i < imported.positions.size(); i++) {
+        mesh.vertices[i].pos = glm::vec2((imported.positions[i].x - center.x) * scale, (center.y - imported.positions[i].y) * scale);
+        mesh.vertices[i].color = imported.colors[i];
+    }
+    mesh.indices = std::move(imported.indices);
+
+    auto positionOf = [](const SourceVertex& vertex) { return glm::vec3(vertex.pos.x, vertex.pos.y, 0.0f); };
+    MeshOptimizer::Report report = MeshOptimizer::optimize(mesh, positionOf, MeshOptimizer::Options{});
+    std::cout << "mesh importer: optimized in " << report.milliseconds << " ms, vertices " << report.verticesBefore << " -> "
+        << report.verticesAfter << ", ACMR " << report.before.acmr << " -> " << report.after.acmr << "\n";
+    return mesh;
+}
+
 VkResult CreateDeubgUtilMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
     const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func =
@@ -54,37 +380,40 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     }
 }
 
-static std::vector<char> readFile(const std::string& filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-
-    return buffer;
-}
-
  
 class HelloTriangleApplication {
 public:
+    explicit HelloTriangleApplication(const AppOptions& options)
+        : options(options), latencyProfile(LatencyProfile::fromMode(options.latencyMode)), framesInFlight(latencyProfile.framesInFlight) {}
+
     void run() {
-        initWindow();
-        initVulkan();
+        jobs.start(options.jobThreadCount);
+        if (options.serialStartup) {
+            if (!options.headless) {
+                startupProfiler.measure("initWindow", [&] { initWindow(); });
+            }
+            startupProfiler.measure("initVulkan", [&] { initVulkan(); });
+        }
+        else {
+            startupProfiler.measure("initConcurrently", [&] { initConcurrently(); });
+        }
+
         mainLoop();
         cleanup();
     }
 
 private:
 
-    GLFWwindow* window;
+    AppOptions options;
+    LatencyProfile latencyProfile; // 프레임 슬롯 수와 swapchain 깊이. applyLatencyProfile로 실행 중에 바꾼다.
+    uint32_t framesInFlight; // 처음엔 const int MAX_FRAMES_IN_FLIGHT = 2였다. (아래 Frames in flight 설명 참고)
+    LatencyMeter latencyMeter;
+    bool latencyProfileRequested = false; // 키 콜백이 요청하면 mainLoop가 프레임 사이에서 바꾼다.
+    LatencyProfile::Mode requestedLatencyMode = LatencyProfile::Mode::Balanced;
+    StartupProfiler startupProfiler; // initWindow, initVulkan의 각 단계가 얼마나 걸렸는지 기록
+    bool startupReported = false;
+
+    GLFWwindow* window = nullptr;
     VkInstance instance;
     // vulkan에선, debugmessenger마저 handle을 이용해 명시적으로 생성해주고 파괴해줘야 한다.
     // 이를 위해서 class멤버로 debugMessenger를 선언해줘야 한다.
@@ -92,13 +421,18 @@ private:
 
     // vulkan은 플랫폼에 독립적(agnostic)하기 때문에 glfw가 만든 windw에 바로 접근하지 못하고 window에 접근하기 위한
     // 별도의 surface레이어가 필요로 된다.
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE; // headless 모드에서는 만들지 않는다.
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews; // VkImageView의 각각의 element는 각각의 최종 output attachment와 대응된다.
 
+    // headless 모드에선 swapchain이 없기 때문에 swapChainImages를 우리가 직접 만든 VkImage로 채운다.
+    // swapchain 이미지와 달리 메모리도 직접 할당해줘야 하니 별도로 들고있는다.
+    std::vector<GpuAllocation> offscreenImageMemories;
+    uint32_t offscreenImageIndex = 0;
+
     // 파이프라인을 통해 uniform변수의 값을 바꿔주는 등의 셰이더, vertex 데이터 접근 가능
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
@@ -118,7 +452,8 @@ private:
     std::vector<VkSemaphore> imageAvailableSemaphores; // swapchain으로부터 이미지를 얻어왔다는 것에 대한 signal을 보내는 세마포어
     std::vector<VkSemaphore> renderFinishedSemaphores; // 렌더링이 끝났고 present가 가능하다는 것에 대한 signal을 보내는 세마포어
  
-    std::vector<VkFence> inFlightFences; // 한 번에 하나의 프레임만 렌더링 되도록 하는 세마포어
+    FramePacer framePacer; // 한 번에 framesInFlight개의 프레임만 렌더링 되도록 하는 타임라인 세마포어
+    // 처음엔 슬롯마다 fence(inFlightFences)를 뒀지만 제출할 때마다 리셋해야 하고 조기 리턴 시 데드락 위험이 있어서 바꿨다.
 
     bool framebufferResized = false;
 
@@ -130,6 +465,13 @@ private:
     const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
     const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+    std::vector<const char*> getRequiredDeviceExtensions() {
+        if (options.headless) {
+            return {}; // present를 하지 않으니 swapchain 익스텐션이 없는 device(ex. lavapipe 빌드에 따라)도 허용한다.
+        }
+        return deviceExtensions;
+    }
+
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 
 
@@ -139,11 +481,34 @@ private:
     // 생성만 되고 우리가 이에 대한 handle을 아직 가지고 있지 않기 때문에
     // 이를 명시적으로 가져와 줘야 한다.
     VkQueue presentQueue;
+    TransferQueue transferQueue; // 업로드 전용 큐, 전송 전용 큐 패밀리가 없으면 그래픽스 큐를 같이 쓴다.
+    GpuAllocator gpuAllocator; // 버퍼, 이미지 메모리는 전부 여기서 받는다.
+    MeshBuffer meshBuffer;
+    MeshCache meshCache;
+    StagingRing stagingRing; // 매 프레임 바뀌는 데이터를 올릴 때 쓰는 영구 매핑된 링 버퍼
+    FrameBenchmark frameBenchmark; // --draw-benchmark일 때만 만든다.
+    CommandBufferCache commandBufferCache; // 커맨드가 바뀌지 않은 프레임은 기록해둔 커맨드 버퍼를 그대로 제출한다.
+    uint64_t sceneVersion = 1; // 그릴 대상(메시, 파이프라인 등)이 바뀌면 markSceneDirty로 올린다.
+    ParallelRecorder parallelRecorder; // --record-threads가 2 이상일 때만 풀을 만든다. 기록은 jobs의 스레드들이 나눠 한다.
+    JobSystem jobs; // 프레임 안의 작은 작업들(인스턴스 변환 갱신 등)을 나눠 실행한다.
+    bool multiDrawIndirectEnabled = false; // vkCmdDrawIndexedIndirect 한 번에 drawCount > 1
+    bool drawIndirectFirstInstanceEnabled = false; // indirect 명령의 firstInstance != 0
+    uint32_t maxDrawIndirectCount = 1;
+    bool creationFeedbackEnabled = false; // VkPipelineCreationFeedbackCreateInfo를 체인에 붙여도 되는지 (1.3 core 혹은 익스텐션)
 
     VkPipeline graphicsPipeline;
+    VkPipeline instancedPipeline = VK_NULL_HANDLE; // --instances가 있을 때만 만든다.
+    ShaderBlob vertShaderCode; // --shader-dir이 있을 때만 loadShaderCode에서 매핑해두고 셰이더 모듈을 만든 뒤 매핑을 푼다.
+    ShaderBlob fragShaderCode;
+    ShaderBlob instancedVertShaderCode;
 
+    std::vector<InstanceData> instances; // 프레임마다 transform만 다시 채워서 링에 복사한다. 색은 처음 한 번만 채운다.
+    std::vector<float> instanceTransforms; // quantize 전의 float 값 (인스턴스마다 4개)
+    std::chrono::high_resolution_clock::time_point instanceClockStart;
+    PipelineCache pipelineCache; // 실행할 때마다 파이프라인을 처음부터 컴파일하지 않도록 디스크에 저장해두는 캐시
+    PipelineBuildService pipelineBuilder; // 파이프라인들을 워커 스레드에서 병렬로 컴파일해준다.
+    DeviceCapabilityCache capabilityCache; // 디바이스별 큐 패밀리, surface 조회 결과를 한 번만 조회해서 들고 있는다.
 
-    const int MAX_FRAMES_IN_FLIGHT = 2;
 
     uint32_t currentFrame = 0;
 
@@ -189,11 +554,16 @@ private:
     }
 
     std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        std::vector<const char*> extensions;
+
+        if (!options.headless) {
+            // headless 모드에선 glfwInit을 호출하지 않기 때문에 surface관련 익스텐션도 필요 없다.
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationlayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -229,14 +599,33 @@ private:
 
     void initWindow() {
 
+        startupProfiler.measure("glfwInit", [&] { initGlfw(); });
+        startupProfiler.measure("glfwCreateWindow", [&] { createWindow(); });
+
+    }
+
+    void initGlfw() {
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        
+    }
+
+    void createWindow() {
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
         glfwSetWindowUserPointer(window, this);
         glfwSetFramebufferSizeCallback(window, frameBufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+    }
 
+    // 1, 2, 3 키: low, balanced, throughput 지연 프로파일로 바꾼다. 콜백 안에서 리소스를 다시 만들지 않고 요청만 남겨둔다.
+    static void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+        if (action != GLFW_PRESS || key < GLFW_KEY_1 || key > GLFW_KEY_3) {
+            return;
+        }
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        const LatencyProfile::Mode modes[] = { LatencyProfile::Mode::Low, LatencyProfile::Mode::Balanced, LatencyProfile::Mode::Throughput };
+        app->requestedLatencyMode = modes[key - GLFW_KEY_1];
+        app->latencyProfileRequested = true;
     }
 
     // Chapter: Drawing a triangle -> Drawing -> Frames in flight -> Handling resizes explicitly
@@ -283,20 +672,89 @@ private:
     }
 
 #pragma region initVulkan
+    void initConcurrently() {
+        // initWindow와 initVulkan을 순서대로 실행하는 대신 각 단계가 실제로 필요로 하는 결과만 의존성으로 선언하고
+        // 서로 관계없는 단계들(윈도우 생성, 인스턴스 생성, SPIR-V 로딩, 파이프라인 캐시 로딩...)은 동시에 실행한다.
+        // GLFW의 윈도우 관련 함수를 부르는 단계는 메인 스레드에서 실행되도록 MainThread로 등록한다.
+        using Affinity = StartupScheduler::Affinity;
+        StartupScheduler scheduler;
+
+        std::vector<std::string> surfaceDependencies = { "createInstance" };
+
+        if (!options.headless) {
+            scheduler.addStage("glfwInit", {}, Affinity::MainThread, [&] { initGlfw(); });
+            scheduler.addStage("glfwCreateWindow", { "glfwInit" }, Affinity::MainThread, [&] { createWindow(); });
+            scheduler.addStage("createInstance", { "glfwInit" }, Affinity::AnyThread, [&] { createInstance(); });
+            // glfwGetRequiredInstanceExtensions는 glfwInit 이후에만 쓸 수 있기 때문에 인스턴스도 glfwInit은 기다린다.
+            scheduler.addStage("createSurface", { "glfwCreateWindow", "createInstance" }, Affinity::MainThread, [&] { createSurface(); });
+            surfaceDependencies = { "createSurface" };
+        }
+        else {
+            scheduler.addStage("createInstance", {}, Affinity::AnyThread, [&] { createInstance(); });
+        }
+
+        scheduler.addStage("loadShaderCode", {}, Affinity::AnyThread, [&] { loadShaderCode(); });
+        scheduler.addStage("setupDebugMessanger", { "createInstance" }, Affinity::AnyThread, [&] { setupDebugMessanger(); });
+        scheduler.addStage("pickPhysicalDevice", surfaceDependencies, Affinity::AnyThread, [&] { pickPhysicalDevice(); });
+        scheduler.addStage("createLogicalDevice", { "pickPhysicalDevice" }, Affinity::AnyThread, [&] { createLogicalDevice(); });
+        scheduler.addStage("createPipelineCache", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createPipelineCache(); });
+
+        if (options.headless) {
+            scheduler.addStage("createSwapChain", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createOffscreenTargets(); });
+        }
+        else {
+            scheduler.addStage("createSwapChain", { "createLogicalDevice" }, Affinity::MainThread, [&] { createSwapChain(); });
+            // choosSwapExtent에서 glfwGetFramebufferSize를 부르기 때문에 메인 스레드에서 실행한다.
+        }
+
+        scheduler.addStage("createImageViews", { "createSwapChain" }, Affinity::AnyThread, [&] { createImageViews(); });
+        scheduler.addStage("createRenderPass", { "createSwapChain" }, Affinity::AnyThread, [&] { createRenderPass(); });
+        scheduler.addStage("createGraphicsPipeline", { "createRenderPass", "createPipelineCache", "loadShaderCode" }, Affinity::AnyThread,
+            [&] { createGraphicsPipeline(); });
+        scheduler.addStage("createFrameBuffers", { "createImageViews", "createRenderPass" }, Affinity::AnyThread, [&] { createFrameBuffers(); });
+        scheduler.addStage("createCommandPool", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createCommandPool(); });
+        scheduler.addStage("createCommandBuffers", { "createCommandPool" }, Affinity::AnyThread, [&] { createCommandBuffers(); });
+        scheduler.addStage("createSyncObjects", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createSyncObjects(); });
+        scheduler.addStage("createInstances", {}, Affinity::AnyThread, [&] { createInstances(); });
+        scheduler.addStage("createStagingRing", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createStagingRing(instanceRingBytes()); });
+        scheduler.addStage("createMeshBuffers", { "createStagingRing" }, Affinity::AnyThread, [&] { createMeshBuffers(); });
+        if (options.drawBenchmark) {
+            scheduler.addStage("createFrameBenchmark", { "createLogicalDevice" }, Affinity::AnyThread, [&] { createFrameBenchmark(); });
+        }
+
+        scheduler.run(startupProfiler);
+    }
+
     void initVulkan() {
-        createInstance();
-        setupDebugMessanger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFrameBuffers();
-        createCommandPool();
-        createCommandBuffers();
-        createSyncObjects();
+        // 각 단계를 startupProfiler로 감싸서 어느 단계가 시작 시간을 잡아먹는지 기록한다.
+        startupProfiler.measure("createInstance", [&] { createInstance(); });
+        startupProfiler.measure("setupDebugMessanger", [&] { setupDebugMessanger(); });
+        if (!options.headless) {
+            startupProfiler.measure("createSurface", [&] { createSurface(); });
+        }
+        startupProfiler.measure("pickPhysicalDevice", [&] { pickPhysicalDevice(); });
+        startupProfiler.measure("createLogicalDevice", [&] { createLogicalDevice(); });
+        startupProfiler.measure("createPipelineCache", [&] { createPipelineCache(); });
+        if (options.headless) {
+            startupProfiler.measure("createOffscreenTargets", [&] { createOffscreenTargets(); });
+        }
+        else {
+            startupProfiler.measure("createSwapChain", [&] { createSwapChain(); });
+        }
+        startupProfiler.measure("createImageViews", [&] { createImageViews(); });
+        startupProfiler.measure("createRenderPass", [&] { createRenderPass(); });
+        startupProfiler.measure("loadShaderCode", [&] { loadShaderCode(); });
+        startupProfiler.measure("createGraphicsPipeline", [&] { createGraphicsPipeline(); });
+        startupProfiler.measure("createFrameBuffers", [&] { createFrameBuffers(); });
+        startupProfiler.measure("createCommandPool", [&] { createCommandPool(); });
+        startupProfiler.measure("createCommandBuffers", [&] { createCommandBuffers(); });
+        startupProfiler.measure("createSyncObjects", [&] { createSyncObjects(); });
+        startupProfiler.measure("createInstances", [&] { createInstances(); });
+        startupProfiler.measure("createStagingRing", [&] { createStagingRing(instanceRingBytes()); });
+        startupProfiler.measure("createMeshBuffers", [&] { createMeshBuffers(); });
+        if (options.drawBenchmark) {
+            startupProfiler.measure("createFrameBenchmark", [&] { createFrameBenchmark(); });
+        }
 
         // VkDeviceMemory: 그냥 V-RAM에 메모리를 할당하는 것
         // VkImage: 해당 메모리를 어떻게 swapchain의 이미지로 사용하는지에 대한
@@ -309,41 +767,192 @@ private:
 
     }
 
+    void createPipelineCache() {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        // 캐시 헤더의 vendorID, deviceID, pipelineCacheUUID와 비교해서 다른 GPU나 드라이버가 만든 캐시는 버린다.
+
+        pipelineCache.create(device, deviceProperties, options.pipelineCachePath);
+    }
+
+    // 그리는 커맨드가 달라지는 변경(메시, 파이프라인, 오브젝트 수 등)을 한 뒤에 부른다. 캐시된 커맨드 버퍼가 전부 다시 기록된다.
+    void markSceneDirty() {
+        sceneVersion++;
+    }
+
+    void createMeshBuffers() {
+        markSceneDirty(); // 지금은 시작할 때 한 번뿐이지만 메시를 다시 올리는 경로가 생기면 여기서 캐시가 무효화된다.
+        std::string cachePath = options.meshPath.empty() ? options.meshCachePath : options.meshPath + ".meshcache";
+        bool useMeshCache = options.useMeshCache && !cachePath.empty(); // 내장 메시는 --mesh-cache를 줬을 때만 캐시한다.
+
+        std::vector<Vertex> builtinVertices;
+        uint64_t expectedContentHash = 0;
+        if (options.meshPath.empty()) {
+            builtinVertices = packVertices(sourceVertices);
+            expectedContentHash = MeshCache::contentHash(builtinVertices, indices);
+            // 내장 메시는 비교할 원본 파일이 없으니 sourceVertices나 indices를 고치면 해시가 달라져서 예전 캐시를 버린다.
+        }
+
+        if (useMeshCache && isMeshCacheFresh(cachePath)
+            && meshCache.load<Vertex>(cachePath, meshBuffer, gpuAllocator, transferQueue, stagingRing, expectedContentHash)) {
+            return;
+        }
+
+        if (options.meshPath.empty()) {
+            const std::vector<Vertex>& packed = builtinVertices;
+            meshBuffer.upload(gpuAllocator, transferQueue, packed, indices);
+            if (useMeshCache) {
+                MeshCache::write(cachePath, packed, indices); // 다음 실행부터는 압축과 변환 없이 파일에서 바로 올린다.
+            }
+            // 전송 큐에 복사만 제출하고 기다리지 않는다. 첫 프레임이 타임라인 세마포어로 복사 완료를 기다린다.
+            return;
+        }
+
+        MeshOptimizer::Mesh<SourceVertex> imported = importSourceMesh(options.meshPath, options.pipelineThreadCount);
+        std::vector<Vertex> packed = packVertices(imported.vertices);
+
+        if (packed.size() <= std::numeric_limits<uint16_t>::max()) {
+            std::vector<uint16_t> shortIndices(imported.indices.begin(), imported.indices.end());
+            meshBuffer.upload(gpuAllocator, transferQueue, packed, shortIndices);
+            if (useMeshCache) {
+                MeshCache::write(cachePath, packed, shortIndices);
+            }
+        }
+        else {
+            meshBuffer.upload(gpuAllocator, transferQueue, packed, imported.indices);
+            if (useMeshCache) {
+                MeshCache::write(cachePath, packed, imported.indices);
+            }
+        }
+    }
+
+    // 임포트한 메시의 캐시는 원본 파일보다 나중에 만들어졌을 때만 쓴다. (원본을 고치면 다시 임포트한다)
+    bool isMeshCacheFresh(const std::string& cachePath) {
+        if (options.meshPath.empty()) {
+            return true; // 내장 메시는 Vertex가 바뀌면 layout 해시로, 데이터가 바뀌면 content 해시로 MeshCache가 걸러낸다.
+        }
+
+        std::error_code error;
+        auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+        if (error) {
+            return false;
+        }
+        auto sourceTime = std::filesystem::last_write_time(options.meshPath, error);
+        return !error && cacheTime >= sourceTime;
+    }
+
+    // 인스턴스 데이터(와 indirect 명령)가 프레임마다 링에서 차지하는 바이트 수. 옵션만으로 정해진다.
+    VkDeviceSize instanceRingBytes() const {
+        VkDeviceSize instanceBytes = VkDeviceSize(options.instanceCount) * sizeof(InstanceData);
+        if (options.drawMode == DrawMode::Indirect) {
+            instanceBytes += VkDeviceSize(options.instanceCount) * sizeof(VkDrawIndexedIndirectCommand) + 4; // +4: Indirect 정렬
+        }
+        return instanceBytes;
+    }
+
+    // instanceBytes: 프레임마다 링에서 잘라 쓸 인스턴스 데이터의 크기. 그만큼 프레임 구간을 늘려둔다.
+    void createStagingRing(VkDeviceSize instanceBytes) {
+        stagingRing.create(physicalDevice, device, gpuAllocator, transferQueue,
+            VkDeviceSize(options.stagingRingKiBPerFrame) * 1024 + instanceBytes, framesInFlight);
+    }
+
+    void createFrameBenchmark() {
+        if (options.drawMode == DrawMode::Indirect && !drawIndirectFirstInstanceEnabled) {
+            throw std::runtime_error("indirect draw benchmark needs the drawIndirectFirstInstance feature!");
+        }
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        frameBenchmark.create(physicalDevice, device, indices.graphicsFamily.value(), framesInFlight, options.warmupFrames, options.frameCount);
+    }
+
+    // 벤치마크 결과를 저장하고 요약을 출력한다. vkDeviceWaitIdle 뒤에 부른다.
+    void reportDrawBenchmark() {
+        std::string label = std::string(drawModeName(options.drawMode)) + " x" + std::to_string(options.instanceCount);
+        frameBenchmark.finish();
+        frameBenchmark.write(options.benchmarkOutputPath, label);
+        frameBenchmark.printSummary(std::cout, label);
+    }
+
+    // 인스턴스마다 색을 정해둔다. 위치와 회전은 writeInstances에서 프레임마다 바뀐다.
+    void createInstances() {
+        instances.resize(options.instanceCount);
+        instanceTransforms.resize(size_t(options.instanceCount) * 4);
+
+        std::vector<float> colors(size_t(options.instanceCount) * 3);
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> channel(0.3f, 1.0f);
+        for (float& color : colors) {
+            color = channel(random);
+        }
+        VertexLayout::quantizeField(instances, &InstanceData::color, colors.data(), 3);
+        instanceClockStart = std::chrono::high_resolution_clock::now();
+    }
+
+    // 인스턴스들을 격자에 놓고 제자리에서 돌리면서 이번 프레임의 링 구간에 쓴다. 인스턴스가 몇 개든 드로우 콜은 하나다.
+    // 링이 가득 차면 invalid slice를 돌려준다.
+    StagingRing::Slice writeInstances() {
+        uint32_t count = options.instanceCount;
+        uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        float cell = 2.0f / columns;
+        float scale = cell * 0.5f; // 내장 사각형은 한 칸의 절반, 임포트한 메시는 한 칸의 0.9를 차지한다.
+        float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - instanceClockStart).count();
+
+        // 인스턴스마다 독립이라 조각으로 나눠 JobSystem에 넘기고 메인 스레드도 기다리는 동안 같이 계산한다.
+        JobSystem::Counter transformsDone;
+        jobs.parallelFor(&transformsDone, count, 1024, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                float angle = seconds + i * 0.37f;
+                float* transform = &instanceTransforms[size_t(i) * 4];
+                transform[0] = -1.0f + cell * (i % columns + 0.5f);
+                transform[1] = -1.0f + cell * (i / columns + 0.5f);
+                transform[2] = std::cos(angle) * scale;
+                transform[3] = std::sin(angle) * scale;
+            }
+        });
+        jobs.wait(transformsDone);
+        VertexLayout::quantizeField(instances, &InstanceData::transform, instanceTransforms.data(), 4);
+
+        VkDeviceSize bytes = instances.size() * sizeof(InstanceData);
+        StagingRing::Slice slice = stagingRing.allocate(bytes, StagingRing::Usage::Vertex);
+        if (slice.isValid()) {
+            std::memcpy(slice.data, instances.data(), static_cast<size_t>(bytes));
+            // 매핑된 메모리는 write-combined인 경우가 많아서 CPU 쪽 배열에서 다 만든 뒤 앞에서부터 한 번에 복사한다.
+            // (quantizeField가 필드마다 띄엄띄엄 쓰는 것을 매핑된 메모리에 바로 하면 느리다)
+        }
+        return slice;
+    }
+
     void createSyncObjects() {
         // 현재 우리는 3가지 기능이 필요합니다.
         // swapchain으로부터 이미지를 얻어왔다는 것에 대한 signal을 보내는 세마포어
         // 렌더링이 끝났고 present가 가능하다는 것에 대한 signal을 보내는 세마포어
-        // 한 번에 하나의 프레임만 렌더링 되도록 하는 세마포어
+        // 한 번에 하나의 프레임만 렌더링 되도록 하는 세마포어 (지금은 framePacer의 타임라인 세마포어)
         // 클래스 멤버로 선언해 줍시다.
 
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        imageAvailableSemaphores.resize(framesInFlight);
+        renderFinishedSemaphores.resize(framesInFlight);
 
         VkSemaphoreCreateInfo semaphoreInfo{};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (size_t i = 0; i < framesInFlight; i++) {
 
             if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create semaphores!");
             }
         }
         // 위 코드들은 항상 나오던 방식대로 작동하니 설명하지 않겠습니다.
 
+        framePacer.create(device, framesInFlight);
+        // fence는 처음 기다릴 때 멈추지 않도록 SIGNALED로 만들어야 했지만 타임라인은 framesInFlight개까지는 기다리지 않으니 필요 없다.
+
 
 
     }
 
     void createCommandBuffers() {
 
-        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        commandBuffers.resize(framesInFlight);
 
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -359,7 +968,10 @@ private:
         if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate command buffers!");
         }
-
+        // 위 커맨드 버퍼들은 캐시를 끄거나 한 번만 쓸 커맨드를 기록할 때 쓰고, 재사용할 커맨드 버퍼는 캐시가 따로 할당한다.
+        commandBufferCache.create(device, commandPool, framesInFlight);
+        parallelRecorder.create(device, findQueueFamilies(physicalDevice).graphicsFamily.value(), framesInFlight,
+            options.recordThreadCount, jobs);
 
     }
     
@@ -495,6 +1107,9 @@ private:
         // VK_IMAGE_LAYOUT_UNDEFINED는 이전 이미지가 어떤 레이아웃이든 신경쓰지 않는다는 것이다.
         // 근데 그렇다고 clear를 한다는 의미는 아니다.
         colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        if (options.headless) {
+            colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; // present하지 않고 readback할 수 있는 상태로 둔다.
+        }
         // render pass가 끝나면 자동적으로 전환할 레이아웃을 결정
         // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR는 present에 바로 사용될 수 있는 layout이며
         // 이를 finalLayout으로 설정하면 렌더링 이후에 스왑체인을 이용해 렌더링된 이미지가 바로 출력될 수 있게 해준다.
@@ -586,12 +1201,22 @@ private:
 
     }
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("vert.spv");
-        auto fragShaderCode = readFile("frag.spv"); //SPIR-V byte code를 읽어오고
+    void loadShaderCode() {
+        if (options.shaderDirectory.empty()) {
+            return; // 실행 파일에 들어있는 SPIR-V를 쓰니 읽을 파일이 없다.
+        }
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        vertShaderCode.load(options.shaderDirectory + "/vert.spv");
+        fragShaderCode.load(options.shaderDirectory + "/frag.spv"); //SPIR-V byte code를 메모리에 매핑하고
+        if (options.instanceCount > 0) {
+            instancedVertShaderCode.load(options.shaderDirectory + "/instanced_vert.spv");
+        }
+        // 파일 I/O는 device와 아무 관계가 없으니 별도의 단계로 떼어내서 인스턴스, 디바이스 생성과 동시에 읽어둔다.
+    }
+
+    void createGraphicsPipeline() {
+        VkShaderModule vertShaderModule = createShaderModule("vert.spv", vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule("frag.spv", fragShaderCode);
         // 파이프라인에 셰이더 코드를 넘겨주기 위해서는 이것을 Shader module으로 감싼 object를 넘겨줘야만 한다.
 
 
@@ -637,10 +1262,14 @@ private:
             // 2. Attribute discription: vertex shader로 보내지는 attribute의 type, 바인딩을 로드하기 위한 오프셋
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
+        // 정점 구조체의 필드로부터 컴파일 타임에 만들어진다. (VertexLayout.h)
+        constexpr auto bindingDescription = VertexLayout::bindingDescription<Vertex>(0);
+        constexpr auto attributeDescriptions = VertexLayout::attributeDescriptions<Vertex>(0);
+
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
         // pVertexBindingDescriptions 랑 pVertexAttributeDescriptions멤버는 struct array에 대한 포인터이다.
         // 그리고 앞서 말했던 것처럼 load할 vertex data들의 detail에 대한 정보를 담고있다.
 
@@ -812,58 +1441,103 @@ private:
 
 
         
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = nullptr; // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-
-        pipelineInfo.layout = pipelineLayout;
-
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        // 파이프라인 state를 description에 복사해서 파이프라인 빌드 서비스에 넘겨준다.
+        // 위에서 채운 create info들이 가리키는 배열을 그대로 옮겨 담는다. (포인터는 이 함수가 끝나면 무효가 되니까)
+        // 실제 VkGraphicsPipelineCreateInfo는 워커 스레드에서 description의 필드들을 가리키도록 다시 조립된다.
+        // 파이프라인 permutation이 여러 개가 되면 description을 여러 개 만들어 한 번에 submit하면 코어 수만큼 동시에 컴파일된다.
+        GraphicsPipelineDesc pipelineDesc;
+        pipelineDesc.name = "graphicsPipeline";
+        pipelineDesc.shaderStages.assign(std::begin(shaderStages), std::end(shaderStages));
+        pipelineDesc.vertexBindings.assign(vertexInputInfo.pVertexBindingDescriptions,
+            vertexInputInfo.pVertexBindingDescriptions + vertexInputInfo.vertexBindingDescriptionCount);
+        pipelineDesc.vertexAttributes.assign(vertexInputInfo.pVertexAttributeDescriptions,
+            vertexInputInfo.pVertexAttributeDescriptions + vertexInputInfo.vertexAttributeDescriptionCount);
+        pipelineDesc.inputAssembly = inputAssembly;
+        pipelineDesc.viewport = *viewportState.pViewports;
+        pipelineDesc.scissor = *viewportState.pScissors;
+        pipelineDesc.rasterizer = rasterizer;
+        pipelineDesc.multisampling = multisampling;
+        pipelineDesc.colorBlendAttachments = { colorBlendAttachment };
+        pipelineDesc.colorBlending = colorBlending;
+        pipelineDesc.dynamicStates.assign(dynamicState.pDynamicStates, dynamicState.pDynamicStates + dynamicState.dynamicStateCount);
+
+        pipelineDesc.layout = pipelineLayout;
+
+        pipelineDesc.renderPass = renderPass;
+        pipelineDesc.subpass = 0;
         // 해당 파이프라인이 어떤 렌더패스를 쓰고 거기서도 어떤 서브패스를 사용할지 결정
         // 이 파이프라인은 렌더패스와 in, out 폼이 호환돼야 함
 
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-        pipelineInfo.basePipelineIndex = -1; // Optional
         // 파이프라인은 이미 존재하는 파이프라인에서 derived된 파이프라인을 생성 할 수 있다(상속처럼)
         // 기능에 많은 공통점이 있을 때 파이프라인을 셋업하고 교체하는 과정이 저렴해집니다.
         // basePipelineHandle으로 핸들을 넘겨줘서 생성할 수도 있고 basePipelineIndex를 이용해 인덱스로
         // 생성하려고 하는 다른 파이프라인을 참조할 수도 있습니다.
         // VkGraphicsPipelineCreateInfo에서 VK_PIPELINE_CREATE_DERIVATIVE_BIT플래그가 활성화 돼있으면 기능 사용 가능
 
+        std::vector<GraphicsPipelineDesc> pipelineDescs = { pipelineDesc };
+        VkShaderModule instancedVertShaderModule = VK_NULL_HANDLE;
+        if (options.instanceCount > 0) {
+            // 인스턴싱 파이프라인은 정점 셰이더와 binding 1만 다르다. 같이 submit하면 두 파이프라인이 동시에 컴파일된다.
+            instancedVertShaderModule = createShaderModule("instanced_vert.spv", instancedVertShaderCode);
+            constexpr auto instanceBinding = VertexLayout::bindingDescription<InstanceData>(1, VK_VERTEX_INPUT_RATE_INSTANCE);
+            constexpr auto instanceAttributes = VertexLayout::attributeDescriptions<InstanceData>(1);
+
+            GraphicsPipelineDesc instancedDesc = pipelineDesc;
+            instancedDesc.name = "instancedPipeline";
+            instancedDesc.shaderStages[0].module = instancedVertShaderModule;
+            instancedDesc.vertexBindings.push_back(instanceBinding);
+            instancedDesc.vertexAttributes.insert(instancedDesc.vertexAttributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+            pipelineDescs.push_back(instancedDesc);
+        }
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
+        // 빌드 서비스는 만들 파이프라인이 정해진 여기서 시작한다. 파이프라인 수보다 많은 워커는 할 일이 없으니 그 수를 넘기지 않는다.
+        pipelineBuilder.start(device, &pipelineCache,
+            std::min(options.pipelineThreadCount, static_cast<uint32_t>(pipelineDescs.size())), creationFeedbackEnabled);
+        auto pipelines = pipelineBuilder.submit(pipelineDescs);
+        graphicsPipeline = pipelines[0].get();
+        if (pipelines.size() > 1) {
+            instancedPipeline = pipelines[1].get();
         }
+        // 빌드 서비스 내부에서는 vkCreateGraphicsPipelines를 호출한다.
         // vkCreateGraphicsPipelines함수는 multiple파이프라인을 생성하는 것이 목표라 파라미터가 좀 더 많음
-        // VK_NULL_HANDLE 인자가 들어간 두 번째 파라미터는 VkPipelineCache오브젝트를 레퍼런스함
+        // 두 번째 파라미터는 VkPipelineCache오브젝트를 레퍼런스함
         // 파이프라인 캐시는 파이프라인 생성에 관한 데이터 재사용/저장에 사용될 수 있고 심지어는 캐시가 파일로
         // 저장되면 프로그램 넘어서도 도움을 줄 수 있음.
         // 이건 파이프라인 생성속도를 상당히 높여줄 수 있음
+        // 셰이더 모듈은 future를 받은 뒤(컴파일이 끝난 뒤)에야 파괴할 수 있다.
 
 
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
+        if (instancedVertShaderModule != VK_NULL_HANDLE) {
+            vkDestroyShaderModule(device, instancedVertShaderModule, nullptr);
+        }
+        vertShaderCode.release();
+        fragShaderCode.release();
+        instancedVertShaderCode.release();
         // SPIR-V byte code를 GPU에 맞는 machine code로 바꾸기 위해선 파이프라인이 만들어져야 한다.
         // 그 말인 즉슨, 파이프라인이 만들어지면 이미 machine code가 생겨 shaderModule은 필요가 없어진다. 
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
+    // --shader-dir로 읽어둔 파일이 있으면 그것을 쓰고 없으면 실행 파일에 들어있는 셰이더를 이름으로 찾는다.
+    VkShaderModule createShaderModule(const char* name, const ShaderBlob& blob) {
+        if (blob.isLoaded()) {
+            return createShaderModule(blob.code(), blob.size());
+        }
+
+        const ShaderLibrary::EmbeddedShader* shader = ShaderLibrary::find(name);
+        if (shader == nullptr) {
+            throw std::runtime_error(std::string("failed to find embedded shader ") + name + "!");
+        }
+        return createShaderModule(shader->code, shader->size);
+    }
+
+    VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize) {
         VkShaderModuleCreateInfo createInfo{};
 
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        createInfo.codeSize = codeSize;
+        createInfo.pCode = code; // 매핑된 페이지나 실행 파일 안의 배열을 그대로 넘기기 때문에 중간 버퍼로의 복사가 없다.
 
         VkShaderModule shaderModule;
         if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -883,6 +1557,16 @@ private:
             vkDestroyImageView(device, swapChainImageViews[i], nullptr);
         }
 
+        if (options.headless) {
+            for (size_t i = 0; i < swapChainImages.size(); i++) {
+                gpuAllocator.destroyImage(swapChainImages[i], offscreenImageMemories[i]);
+            }
+            // swapchain 이미지는 swapchain이 소유하지만 offscreen 이미지는 우리가 직접 해제해줘야 한다.
+            swapChainImages.clear();
+            offscreenImageMemories.clear();
+            return;
+        }
+
         vkDestroySwapchainKHR(device, swapChain, nullptr);
     }
 
@@ -916,9 +1600,13 @@ private:
 
         cleanupSwapChain();
 
+        capabilityCache.refreshSurfaceCapabilities(physicalDevice, surface);
+        // 창 크기가 바뀌면 currentExtent가 달라지니 surface capabilities만 다시 조회한다. (포맷, present mode, 큐 패밀리는 그대로)
+
         createSwapChain();
         createImageViews();
         createFrameBuffers();
+        commandBufferCache.invalidate(); // 캐시된 커맨드 버퍼들은 방금 파괴한 프레임버퍼와 예전 extent로 기록돼 있다.
         // 다음으론 우리는 스왑체인 자체를 다시 만들어줘야 합니다.
         // 이미지뷰도 다시 만들어야 합니다. 왜냐면 이미지뷰는 스왑체인 이미지에 기반하니까요
         // 마지막으로, 프레임버퍼는 직접적으로 스왑체인 이미지에 의존하기에 다시 만들어줘야 합니다.
@@ -1016,9 +1704,11 @@ private:
         VkExtent2D extent = choosSwapExtent(swapChainSupport.capabilities);
 
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + latencyProfile.extraSwapchainImages;
         // image가 min만큼만 있으면 driver가 internal operation을 완료할 때까지 기다려야만 렌더할 image를 얻어올 수 있기 때문에
-        // 적어도 minimage보다 많아야 한다. 
+        // 적어도 minimage보다 많아야 한다. (balanced 프로파일의 +1)
+        // low 프로파일은 그 대기를 감수하고 min만큼만 만들어서 화면에 나가기 전에 쌓이는 이미지를 줄이고,
+        // throughput 프로파일은 +2장을 만들어서 present engine이 늦어져도 CPU와 GPU가 멈추지 않게 한다.
 
 
         if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
@@ -1098,6 +1788,41 @@ private:
 
     }
 
+    void createOffscreenTargets() {
+        // headless 모드에선 swapchain 대신 device-local VkImage 여러 장을 직접 만들고 돌려가며 렌더링한다.
+        // 이후의 createImageViews, createFrameBuffers, recordCommandBuffer는 swapChainImages를 그대로 쓰기 때문에
+        // 이 함수가 swapChainImages, swapChainImageFormat, swapChainExtent만 채워주면 나머지 경로는 그대로 재사용된다.
+        swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        swapChainExtent = { WIDTH, HEIGHT };
+
+        uint32_t imageCount = std::max<uint32_t>(options.offscreenImageCount, framesInFlight);
+        // in flight인 프레임이 아직 쓰고 있는 이미지를 덮어쓰지 않으려면 적어도 framesInFlight장은 있어야 한다.
+
+        swapChainImages.resize(imageCount);
+        offscreenImageMemories.resize(imageCount);
+
+        for (size_t i = 0; i < imageCount; i++) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = swapChainImageFormat;
+            imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            // 나중에 결과를 읽어갈 수 있도록 TRANSFER_SRC도 같이 켜둔다.
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            swapChainImages[i] = gpuAllocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenImageMemories[i]);
+            // 이미지마다 vkAllocateMemory를 부르지 않고 GpuAllocator의 블록에서 잘라 쓴다.
+        }
+
+        offscreenImageIndex = 0;
+    }
+
     void createSurface() {
         if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
             throw std::runtime_error("failed to create window surface");
@@ -1116,25 +1841,14 @@ private:
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
         SwapChainSupportDetails details;
 
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+        DeviceCapabilities capabilities = capabilityCache.get(device, surface);
         // surface와 physicalDevice로부터 가능한 기능들을 불러온다.
         // 모든 support query function들은 device와 surface를 파라미터로 가진다. 스왑체인에서 매우 중요하기 때문이다.
+        // 포맷과 present mode는 처음 조회할 때 한 번만 열거하고, capabilities는 recreateSwapChain에서 갱신된다.
 
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-
-        if (formatCount!= 0) {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-        } // 어떤 포맷으로 색을 저장하는지 ex)R8G8B8, 그리고 어떤 colorSpace를 가졌는지 저장 ex) LINEAR_EXT
-
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
-
-        if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
-        }// MAILBOX_KHR, FIFO_KHR 등의 present mode를 정의하는 enum
+        details.capabilities = capabilities.surfaceCapabilities;
+        details.formats = capabilities.formats; // 어떤 포맷으로 색을 저장하는지 ex)R8G8B8, 그리고 어떤 colorSpace를 가졌는지 저장 ex) LINEAR_EXT
+        details.presentModes = capabilities.presentModes; // MAILBOX_KHR, FIFO_KHR 등의 present mode를 정의하는 enum
 
         return details;
     }
@@ -1143,7 +1857,8 @@ private:
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.graphicsFamily.value() };
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
+        // 패밀리가 겹치면 set이 알아서 하나로 합쳐준다. (같은 패밀리에 대해 VkDeviceQueueCreateInfo를 두 번 넘기면 안된다)
         float queuePriority = 1.0f;
 
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -1155,18 +1870,44 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
         VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        // 둘 다 없어도 되지만 있으면 DrawMode::Indirect가 오브젝트 N개를 드로우 콜 하나로 그린다.
+        multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        drawIndirectFirstInstanceEnabled = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        maxDrawIndirectCount = multiDrawIndirectEnabled ? std::max(deviceProperties.limits.maxDrawIndirectCount, 1u) : 1;
         
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineFeatures.timelineSemaphore = VK_TRUE; // 전송 큐 -> 그래픽스 큐 handoff에 쓴다. (isDeviceSuitable에서 지원 여부를 확인함)
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &timelineFeatures;
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
         createInfo.pEnabledFeatures = &deviceFeatures;
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        auto requiredDeviceExtensions = getRequiredDeviceExtensions();
+        bool externalMemoryHostEnabled = MeshCache::isExternalMemoryHostSupported(physicalDevice);
+        if (externalMemoryHostEnabled) {
+            requiredDeviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME); // 없어도 되지만 있으면 MeshCache가 파일을 복사 없이 올린다.
+        }
+        creationFeedbackEnabled = PipelineBuildService::isCreationFeedbackCore(physicalDevice);
+        if (!creationFeedbackEnabled && PipelineBuildService::isCreationFeedbackExtensionSupported(physicalDevice)) {
+            requiredDeviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+            creationFeedbackEnabled = true;
+        }
+        // 1.2 디바이스에서는 익스텐션이 있을 때만 파이프라인 캐시 hit/miss를 알 수 있다. 없으면 생성 시간만 남긴다.
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
 
         if (enableValidationlayers) {
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -1187,6 +1928,13 @@ private:
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
 
+        VkQueue uploadQueue;
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &uploadQueue);
+        transferQueue.create(device, uploadQueue, indices.transferFamily.value(), indices.graphicsFamily.value());
+
+        gpuAllocator.create(physicalDevice, device);
+        meshCache.create(physicalDevice, device, externalMemoryHostEnabled);
+        // 전송 패밀리가 그래픽스 패밀리와 같으면 uploadQueue는 graphicsQueue와 같은 핸들이다.
     }
 
     void createInstance() {
@@ -1290,23 +2038,23 @@ private:
         vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
         
 
+        // 첫 번째로 조건을 만족하는 디바이스를 고르는 대신 모든 후보에 점수를 매겨서 가장 좋은 것을 고른다.
+        DeviceSelector selector;
         for (const auto& device : devices) {
-
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-
-                VkPhysicalDeviceProperties deviceProp;
-                vkGetPhysicalDeviceProperties(physicalDevice, &deviceProp);
-                std::cout<< "Selected device: " << deviceProp.deviceName << "\n";
-
-                break;
-            }
+            selector.addCandidate(device, isDeviceSuitable(device));
         }
 
-        if (physicalDevice == VK_NULL_HANDLE) {
-            throw std::runtime_error("failed to find a suitable GPU!");
-        }
+        std::string deviceOverride = options.deviceOverride.empty() ? DeviceSelector::environmentOverride() : options.deviceOverride;
+        physicalDevice = selector.select(deviceOverride); // 조건에 맞는 디바이스가 없으면 예외를 던진다.
 
+        VkPhysicalDeviceProperties deviceProp;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProp);
+        std::cout<< "Selected device: " << deviceProp.deviceName << "\n";
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        std::cout << "queue families: graphics " << indices.graphicsFamily.value() << ", present " << indices.presentFamily.value()
+            << ", transfer " << indices.transferFamily.value() << (indices.transferFamily != indices.graphicsFamily ? " (dedicated)" : "")
+            << ", compute " << indices.computeFamily.value() << (indices.computeFamily != indices.graphicsFamily ? " (async)" : "") << "\n";
     }
 
 
@@ -1316,6 +2064,8 @@ private:
         std::optional<uint32_t> presentFamily;
         // drawing command와 presentation의 큐 패밀리는 겹치지 않기 때문에 
         // 별도의 기능을 하는 새로운 큐를 만들 필요가 있다.
+        std::optional<uint32_t> transferFamily; // 전용 전송 큐가 없으면 compute나 graphics 패밀리와 같다.
+        std::optional<uint32_t> computeFamily; // async compute 큐가 없으면 graphics 패밀리와 같다.
 
         bool isComplete() {
 
@@ -1328,39 +2078,13 @@ private:
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
         QueueFamilyIndices indices;
 
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
-        int i = 0;
-
-
-        for (const auto& queueFamily : queueFamilies) {
-
-
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                indices.graphicsFamily = i;
-            }
-
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-
-            if (presentSupport) {
-                indices.presentFamily = i;
-            }
-
-
-            if (indices.isComplete()) {
-                break;
-            }
-
-
-
-            i++;
-        }
-
+        // 큐 패밀리 열거와 역할별 선택은 DeviceCapabilityCache가 디바이스마다 한 번만 한다.
+        // headless 모드에서는 surface가 없으니 present를 할 일도 없다. 그래픽스 큐가 present 큐 역할까지 맡은 것으로 친다.
+        DeviceCapabilities capabilities = capabilityCache.get(device, options.headless ? VK_NULL_HANDLE : surface);
+        indices.graphicsFamily = capabilities.graphicsFamily;
+        indices.presentFamily = capabilities.presentFamily;
+        indices.transferFamily = capabilities.transferFamily;
+        indices.computeFamily = capabilities.computeFamily;
 
         return indices;
 
@@ -1374,12 +2098,33 @@ private:
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
         bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        if (options.headless) {
+            swapChainAdequate = true;
+        }
+        else if (extensionsSupported) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate;
+        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportsTimelineSemaphore(device);
+    }
+
+    bool supportsTimelineSemaphore(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (VK_API_VERSION_MAJOR(properties.apiVersion) == 1 && VK_API_VERSION_MINOR(properties.apiVersion) < 2) {
+            return false; // 1.2 core로 쓰기 때문에 1.1 이하 디바이스는 제외한다.
+        }
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return timelineFeatures.timelineSemaphore == VK_TRUE;
     }
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -1389,7 +2134,8 @@ private:
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        auto requiredDeviceExtensions = getRequiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
 
         for (const auto& extension : availableExtensions) {
             requiredExtensions.erase(extension.extensionName);
@@ -1556,14 +2302,54 @@ private:
     //
 
 
+    void reportStartup() {
+        // 첫 프레임을 submit한 시점까지를 time-to-first-frame으로 기록하고 시작 구간 전체를 내보낸다.
+        startupReported = true;
+        startupProfiler.recordSinceStart("timeToFirstFrame");
+        startupProfiler.printSummary(std::cout);
+        startupProfiler.writeChromeTrace(options.startupTracePath);
+        gpuAllocator.printStats(std::cout);
+    }
+
     void mainLoop() {
+        latencyMeter.beginProfile(latencyProfile, static_cast<uint32_t>(swapChainImages.size()));
+        if (options.headless) {
+            if (options.latencySweep) {
+                for (LatencyProfile::Mode mode : { LatencyProfile::Mode::Low, LatencyProfile::Mode::Balanced, LatencyProfile::Mode::Throughput }) {
+                    applyLatencyProfile(mode);
+                    headlessLoop();
+                }
+            }
+            else {
+                headlessLoop();
+            }
+            latencyMeter.finishProfile();
+            latencyMeter.printReport(std::cout);
+            if (options.drawBenchmark) {
+                reportDrawBenchmark();
+            }
+            return;
+        }
 
-        while (!glfwWindowShouldClose(window)) {
+        while (!glfwWindowShouldClose(window) && !(options.drawBenchmark && frameBenchmark.isFinished())) {
             glfwPollEvents();
+            if (latencyProfileRequested) {
+                latencyProfileRequested = false;
+                applyLatencyProfile(requestedLatencyMode);
+            }
             drawFrame();
+
+            if (!startupReported) {
+                reportStartup();
+            }
         }
         
         vkDeviceWaitIdle(device);
+        latencyMeter.finishProfile();
+        latencyMeter.printReport(std::cout);
+        if (options.drawBenchmark) {
+            reportDrawBenchmark(); // 창을 먼저 닫으면 그때까지의 프레임만 저장된다.
+        }
         // 이러한 부류의 함수들은 아주 기초적으로 동기화를 실행하기 위해 실행되는 함수들이죠.
         // 이제 프로그램이 윈도우를 아무 문제없이 닫아내는 것을 볼 수 있습니다!
 
@@ -1638,7 +2424,143 @@ private:
 
     }
 
+    // 실행 중에 지연 프로파일을 바꾼다. 프레임 슬롯 수만큼 만들어둔 것들(세마포어, 타임라인, 커맨드 버퍼, 녹화용 풀, 링 구간)을
+    // 새 슬롯 수로 다시 만들고 swapchain(또는 offscreen 이미지)도 새 이미지 수로 다시 만든다.
+    // 디바이스를 idle로 만들고 하니 프로파일을 바꾸는 프레임 하나는 끊긴다.
+    void applyLatencyProfile(LatencyProfile::Mode mode) {
+        if (options.drawBenchmark) {
+            std::cerr << "latency profile can't change during a draw benchmark\n";
+            return;
+        }
+
+        vkDeviceWaitIdle(device);
+        latencyMeter.finishProfile();
+        destroyFrameResources();
+
+        latencyProfile = LatencyProfile::fromMode(mode);
+        framesInFlight = latencyProfile.framesInFlight;
+        currentFrame = 0;
+
+        createSyncObjects();
+        createCommandBuffers();
+        stagingRing.resize(gpuAllocator, framesInFlight);
+        if (options.headless) {
+            cleanupSwapChain();
+            createOffscreenTargets();
+            createImageViews();
+            createFrameBuffers();
+        }
+        else {
+            recreateSwapChain(); // extraSwapchainImages가 바뀌었으니 createSwapChain이 이미지 수를 다시 정한다.
+        }
+
+        std::cout << "latency profile: " << latencyProfile.name() << " (" << framesInFlight << " frames in flight, "
+            << swapChainImages.size() << " images)\n";
+        latencyMeter.beginProfile(latencyProfile, static_cast<uint32_t>(swapChainImages.size()));
+    }
+
+    // 프레임 슬롯 수만큼 만든 것들을 파괴한다. 디바이스가 idle인 상태에서 부른다.
+    void destroyFrameResources() {
+        framePacer.destroy();
+        for (size_t i = 0; i < imageAvailableSemaphores.size(); i++) {
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+        }
+        imageAvailableSemaphores.clear();
+        renderFinishedSemaphores.clear();
+
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+        commandBuffers.clear();
+        commandBufferCache.destroy();
+        parallelRecorder.destroy();
+    }
+
+    void headlessLoop() {
+        // 윈도우가 없으니 이벤트를 처리할 필요도 없이 정해진 프레임 수만큼만 그리고 끝낸다.
+        // vkDeviceWaitIdle까지 포함해서 재야 GPU(혹은 lavapipe의 CPU 래스터라이저)가 실제로 일을 끝낸 시간이 나온다.
+        auto startTime = std::chrono::high_resolution_clock::now();
+        uint32_t totalFrames = options.frameCount + (options.drawBenchmark ? options.warmupFrames : 0);
+
+        for (uint32_t frame = 0; frame < totalFrames; frame++) {
+            drawFrame();
+
+            if (!startupReported) {
+                reportStartup();
+            }
+        }
+
+        vkDeviceWaitIdle(device);
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+        std::cout << "headless: " << totalFrames << " frames in " << elapsedMs << " ms ("
+            << (elapsedMs > 0.0 ? totalFrames * 1000.0 / elapsedMs : 0.0) << " fps)\n";
+    }
+
+    // 이번 프레임이 전송 큐의 업로드를 기다렸으면 그 프레임이 끝난 뒤에 업로드 원본(staging 버퍼, import한 캐시 파일)을 정리한다.
+    // 프레임이 기다린 값까지의 복사는 그때 전부 끝나 있으니 매 프레임 전송 큐를 확인하지 않아도 된다. 제출이 성공한 뒤 endFrame 전에 부른다.
+    void releaseUploadSourcesAfterFrame(const TransferQueue::Handoff& handoff) {
+        if (handoff.waitValue == 0) {
+            return;
+        }
+        framePacer.deferDestroy([this]() {
+            meshBuffer.releaseStaging(gpuAllocator, transferQueue);
+            meshCache.releaseSource(transferQueue);
+        });
+    }
+
+    void drawHeadlessFrame() {
+        // swapchain이 없으니 vkAcquireNextImageKHR 대신 offscreen 이미지를 순서대로 돌려쓴다.
+        // 이미지가 준비됐다는 세마포어도, present를 기다리는 세마포어도 필요 없고 프레임 타임라인만으로 충분하다.
+        latencyMeter.frameCompleted(framePacer.beginFrame()); // 끝난 프레임에 미뤄둔 업로드 원본 정리도 여기서 실행된다.
+        stagingRing.beginFrame(currentFrame); // 이 프레임 슬롯의 이전 제출이 끝났으니 링 구간을 재활용한다.
+        if (options.drawBenchmark) {
+            frameBenchmark.beginFrame(currentFrame); // 지난번 이 슬롯으로 그린 프레임의 GPU 시간을 읽는다.
+        }
+
+        uint32_t imageIndex = offscreenImageIndex;
+        offscreenImageIndex = (offscreenImageIndex + 1) % static_cast<uint32_t>(swapChainImages.size());
+
+        TransferQueue::Handoff handoff = transferQueue.takeHandoff();
+
+        double recordMs = 0.0;
+        latencyMeter.frameStarted(framePacer.frameValue()); // 인스턴스 애니메이션 시계를 읽기 직전
+        VkCommandBuffer commandBuffer = prepareCommandBuffer(imageIndex, handoff, recordMs);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        QueueSync sync;
+        if (handoff.waitValue != 0) {
+            sync.add(transferQueue.semaphore(), handoff.dstStageMask, handoff.waitValue); // 아직 끝나지 않은 업로드
+        }
+        sync.addSignal(framePacer.semaphore(), framePacer.frameValue());
+        // 바이너리 세마포어는 누군가 기다려주지 않으면 다시 signal 할 수 없기 때문에 프레임 타임라인만 signal한다.
+        sync.apply(submitInfo);
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        FrameBenchmark::Clock::time_point submitStart = FrameBenchmark::Clock::now();
+        stagingRing.flush(); // 이번 프레임에 링에 쓴 데이터를 한 번에 flush (coherent 메모리면 아무것도 안함)
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+        releaseUploadSourcesAfterFrame(handoff);
+        framePacer.endFrame();
+        if (options.drawBenchmark) {
+            frameBenchmark.endFrame(currentFrame, recordMs, FrameBenchmark::millisecondsSince(submitStart));
+        }
+
+        currentFrame = (currentFrame + 1) % framesInFlight;
+    }
+
     void drawFrame() {
+        if (options.headless) {
+            drawHeadlessFrame();
+            return;
+        }
 
         // 드디어 drawFrame의 시작입니다! 지금까지는 전부 그리기를 위한 사전 작업이었고 드디어 그리기를 시작합니다.
         // 지금까지만 해도 정말 힘겨운 여정이었는데 이제 겨우 시작이라니... 하지만 걱정마세요. 
@@ -1646,7 +2568,11 @@ private:
         // 가능한 하드웨어의 기능들을 모두 외부로 노출했기에 사전작업이 복잡했을 뿐이지 실제 렌더링 작업으로 가면
         // 생각보다 별 일 없습니다. 아마도...요?
         
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        latencyMeter.frameCompleted(framePacer.beginFrame()); // 끝난 프레임에 미뤄둔 업로드 원본 정리도 여기서 실행된다.
+        stagingRing.beginFrame(currentFrame); // 이 프레임 슬롯의 이전 제출이 끝났으니 링 구간을 재활용한다.
+        if (options.drawBenchmark) {
+            frameBenchmark.beginFrame(currentFrame); // 지난번 이 슬롯으로 그린 프레임의 GPU 시간을 읽는다.
+        }
         // 우선, 우리는 두 개의 프레임이 동시에 렌더링 되길 원하지 않기에 그리기를 시작하기 전에 
         // 펜스를 이용해 이전 프레임이 끝날 때까지 기다려 주도록 하겠습니다.
         // 만약 그리려고 할 때 이전 프레임의 렌더링이 이미 끝났으면 기다리지 않고 바로 넘어가겠죠.
@@ -1655,6 +2581,9 @@ private:
         // 네 번째의 VK_TRUE는 우리가 array의 모든 펜스를 기다리겠다는 뜻입니다. 지금의 경우에는 어차피 fence가 한개니
         // 큰 의미는 없겠네요.
         // 해당 함수는 또한, fence를 기다리는 최대치인 timeout을 정할 수 있는데 이를 UINT64_MAX로 지정하면 timeout을 없앨 수 있죠
+        //
+        // 지금은 fence 대신 framePacer의 타임라인 세마포어를 씁니다. N번째 프레임은 끝날 때 타임라인을 N으로 signal하니
+        // 이 슬롯을 마지막으로 쓴 프레임(N - framesInFlight)의 값까지만 기다리면 됩니다. (vkWaitSemaphores)
         
         // vkQueuePresentKHR함수의 result를 통해 reacreateSwapChain을 했더라도 여전히 남아있는 문제가 있습니다.
         // 지금같은 경우에 데드락이 걸릴 수도 있거든요? 코드를 디버깅 해보면 어플리케이션이 vkWaitForFences함수에서 데드락이 걸리는
@@ -1670,6 +2599,8 @@ private:
         // 이렇게 해서, 만약 return이 일찍 일어나도 펜스는 여전히 signaled상태라서 같은 펜스 오브젝트를 활용하는 다음 시간까지
         // 데드락이 걸리는 일은 없겠죠
         // 
+        // 타임라인 세마포어로 바꾼 지금은 리셋이라는 게 없어서 이 문제 자체가 생기지 않습니다. 일찍 리턴하면 framePacer.endFrame을
+        // 부르지 않으니 다음 drawFrame은 같은 값을 다시 기다리고, 그 값은 이미 지났으니 바로 넘어갑니다.
         //
 
         // 펜스 설정을 모두 마친 이후 drawFrame 내에서 해야 할 다음 일은, 스왑체인으로부터 이미지를 얻어오는 것입니다.
@@ -1700,7 +2631,7 @@ private:
         //
 
 
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        // (타임라인 세마포어는 리셋하지 않습니다. 아래는 fence를 쓰던 때의 설명입니다)
         // fence를 기다리는 것이 끝났다면 이전 프레임의 렌더링이 완료됐다는 뜻이므로, 이젠 이번 프레임을 그리기 시작해야 함으로
         // 이번 프레임을 위한 펜스를 새롭게 지정해줍시다. 근데, 작업을 계속하기 전에, 우리 코드에 좀 기겁할만한 점이 있습니다.
         // 우리가 처음 drawFrame() 을 호출할 때, 곧바로 inFlightFence가 signaled되기를 기다립니다.
@@ -1717,10 +2648,14 @@ private:
 
         // imageIndex를 얻어온 이후, command buffer에 해야 할 일들을 기록하겠습니다.
         // 우선, vkResetCommandBuffer 함수를 불러 기록이 가능하게 해줍니다.
-        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-        // 두 번째 파라미터는 VkCommandBufferResetFlagBits 라는 flag인데 지금은 딱히 특별한 설정을 해주지 않을거라 0으로 남깁니다.
-        // 이제, recordCommandBuffer를 이용해 우리가 원하는 command를 기록해줍시다.
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex); // commandBuffer는 핸들값이기에 그냥 넘겨줘도 됨
+        TransferQueue::Handoff handoff = transferQueue.takeHandoff();
+        // 전송 큐에 제출된 업로드가 있으면 이번 프레임이 그 업로드를 기다리고, 소유권을 넘겨받는 acquire 배리어를 기록한다.
+
+        double recordMs = 0.0;
+        latencyMeter.frameStarted(framePacer.frameValue()); // 인스턴스 애니메이션 시계를 읽기 직전
+        VkCommandBuffer commandBuffer = prepareCommandBuffer(imageIndex, handoff, recordMs);
+        // prepareCommandBuffer 안에서 vkResetCommandBuffer로 기록이 가능하게 해준 뒤 recordCommandBuffer로 우리가 원하는 command를 기록합니다.
+        // 같은 swapchain 이미지에 같은 장면을 그리는 거라면 전에 기록해둔 커맨드 버퍼를 그대로 돌려주고 기록을 건너뜁니다.
         // 기록을 완료하면, 이제 커맨드 버퍼를 GPU에 전송 할 수 있습니다.
         // (해당 함수는 우리가 전에 직접 정의해준 함수입니다)
 
@@ -1728,13 +2663,12 @@ private:
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-
-
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        QueueSync sync;
+        sync.add(imageAvailableSemaphores[currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        if (handoff.waitValue != 0) {
+            sync.add(transferQueue.semaphore(), handoff.dstStageMask, handoff.waitValue);
+            // 업로드를 기다리는 건 타임라인 세마포어라서 바이너리 세마포어와 같이 기다리려면 VkTimelineSemaphoreSubmitInfo가 필요하다.
+        }
         // 위 세개의 파라미터는 실행이 시작하기 전에 어느 세마포어의 어느 스테이지에 파이프라인이 대기할지를 기술합니다.
         // image에 color를 쓰는 작업이 가능할 때까지 기다리고 싶기 때문에
         // VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT라고 지정해 color attachment에 쓰기를 수행하는 단계를 기다리도록 지정합니다.
@@ -1742,26 +2676,36 @@ private:
         // 이 말을 이론적으로 본다면, "이미지가 아직 available하지 않아도 vertex shader는 이미시작할 수도 있다는 뜻입니다."(중요)
         // waitStages[] 의 각각의 요소들은 pWaitSemaphore와 대응되죠.
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        submitInfo.pCommandBuffers = &commandBuffer;
         // 다음 두 버퍼는, execution을 위해 어느 버퍼가 전송될지를 결정합니다. 우리는 우선 단순히 single command buffer
         // 만 사용하니 이것만 보내도록 하겠습니다.
 
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]}; // present가 기다릴 바이너리 세마포어
+        sync.addSignal(signalSemaphores[0]);
+        sync.addSignal(framePacer.semaphore(), framePacer.frameValue());
+        sync.apply(submitInfo);
         // signalSemaphoreCount랑 pSignalSemaphores파라미터는 커맨드 버퍼의 동작이 끝나면
         // 어느 세마포어에 시그널을 보낼지 정의합니다.
-        // 우리의 경우에, renderFinishSemaphore를 사용합니다.
+        // 우리의 경우에, renderFinishSemaphore와 다음 프레임들이 기다릴 프레임 타임라인을 사용합니다.
+        // sync.apply가 wait, signal 세마포어와 타임라인 값을 한 번에 submitInfo에 채워줍니다.
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+        FrameBenchmark::Clock::time_point submitStart = FrameBenchmark::Clock::now();
+        stagingRing.flush(); // 이번 프레임에 링에 쓴 데이터를 한 번에 flush (coherent 메모리면 아무것도 안함)
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        releaseUploadSourcesAfterFrame(handoff);
+        framePacer.endFrame();
+        if (options.drawBenchmark) {
+            frameBenchmark.endFrame(currentFrame, recordMs, FrameBenchmark::millisecondsSince(submitStart));
+        }
         // 이제 command buffer를 graphics queue로 보내줍니다.
         // 해당 함수는 submitInfo를 array로 받아올 수 있기 때문에 workload가 훨씬 클 때 효율적입니다.
         // 똑같은 VkSubmitInfo로 여러 commandBuffer를 보내줄 수도 있지만 다른 vkSubmitInfo로 여로 commandBuffer를 보내줄 수도 있는거죠
-        // 마지막 inFlightFence는 커맨드 버퍼의 execution이 끝났을 때, 어느 fence에게 signal을 줄 지에 대해 정해줍니다.
-        // 이를 통해서, 다음프레임에 CPU는 커맨드를 기록하기 전에 커맨드버퍼의 실행이 끝내길 기다릴겁니다!
+        // 마지막 파라미터는 커맨드 버퍼의 execution이 끝났을 때, 어느 fence에게 signal을 줄 지에 대해 정해줍니다.
+        // 지금은 프레임 타임라인을 signal하니 fence는 필요 없습니다. 다음프레임에 CPU는 커맨드를 기록하기 전에 그 값을 기다릴겁니다!
         
 
 
@@ -1845,13 +2789,72 @@ private:
 
 
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % framesInFlight;
         // 당연히 프레임이 끝났으면 매 번 다음 프레임값으로 갱신해주는 것도 잊으면 안되겠죠 
 
     }
 
+    // 이번 프레임에 링에 쓴 데이터의 위치. 커맨드 버퍼는 이 슬라이스들을 가리키도록 기록된다.
+    struct FrameData {
+        StagingRing::Slice instances;
+        StagingRing::Slice indirectCommands;
+        bool complete = true; // 링이 가득 차서 못 쓴 데이터가 있으면 false. 그런 프레임의 커맨드는 캐시하지 않는다.
+    };
+
+    // 프레임마다 바뀌는 데이터를 링에 쓴다. 커맨드 버퍼를 캐시에서 재사용하는 프레임도 데이터는 매번 새로 써야 하므로 기록과 분리했다.
+    FrameData writeFrameData() {
+        FrameData frameData;
+        if (options.instanceCount == 0) {
+            return frameData;
+        }
+        frameData.instances = writeInstances();
+        if (options.drawMode == DrawMode::Indirect) {
+            frameData.indirectCommands = writeIndirectCommands(options.instanceCount);
+            frameData.complete = frameData.indirectCommands.isValid();
+        }
+        frameData.complete = frameData.complete && frameData.instances.isValid();
+        return frameData;
+    }
+
+    // 이번 프레임에 제출할 커맨드 버퍼를 준비한다. 같은 (슬롯, 이미지)로 같은 장면을 그린 적이 있으면 캐시의 커맨드 버퍼를 그대로 쓰고
+    // 아니면 다시 기록한다. 업로드의 acquire 배리어가 들어가는 프레임은 그 한 번만 필요한 커맨드라 슬롯 전용 커맨드 버퍼에 따로 기록한다.
+    VkCommandBuffer prepareCommandBuffer(uint32_t imageIndex, const TransferQueue::Handoff& handoff, double& recordMs) {
+        FrameBenchmark::Clock::time_point recordStart = FrameBenchmark::Clock::now();
+        FrameData frameData = writeFrameData();
+
+        bool cacheable = options.useCommandBufferCache && frameData.complete && !recordsInParallel()
+            && handoff.bufferAcquires.empty() && handoff.imageAcquires.empty();
+        // 여러 스레드로 기록할 때는 primary가 매 프레임 리셋되는 secondary들을 실행하기 때문에 primary만 재사용할 수 없다.
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+        bool needsRecord = true;
+        if (cacheable) {
+            CommandBufferCache::Key key;
+            key.sceneVersion = sceneVersion;
+            key.instanceOffset = frameData.instances.offset;
+            key.indirectOffset = frameData.indirectCommands.offset;
+            commandBuffer = commandBufferCache.acquire(currentFrame, imageIndex, key, needsRecord);
+        }
+        else {
+            vkResetCommandBuffer(commandBuffer, 0);
+        }
+
+        if (needsRecord) {
+            try {
+                recordCommandBuffer(commandBuffer, imageIndex, handoff, frameData); // commandBuffer는 핸들값이기에 그냥 넘겨줘도 됨
+            }
+            catch (...) {
+                if (cacheable) {
+                    commandBufferCache.forget(currentFrame, imageIndex);
+                }
+                throw;
+            }
+        }
+        recordMs = FrameBenchmark::millisecondsSince(recordStart);
+        return commandBuffer;
+    }
+
     // commandBuffer파라미터를 해당 함수에 패스해서 쓰기를 시작할거임
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, const TransferQueue::Handoff& handoff, const FrameData& frameData) {
 
 
         VkCommandBufferBeginInfo beginInfo{}; // 커맨드 버퍼에 쓰기 위해선 해당 struct를 만들어 줘야함
@@ -1871,6 +2874,12 @@ private:
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
+        if (options.drawBenchmark) {
+            frameBenchmark.recordBegin(commandBuffer, currentFrame);
+        }
+        TransferQueue::recordAcquireBarriers(commandBuffer, handoff);
+        // 전송 전용 큐에서 올라온 리소스의 소유권을 넘겨받는다. 배리어는 렌더 패스 밖에서 기록해야 한다.
+
         // vkCmdBeginRenderPass로 렌더패스를 시작하면 그리기를 시작한다.
         // 렌더패스는 VkRenderPassBeginInfo구조체로 시작할 수 있다.
         VkRenderPassBeginInfo renderPassInfo{};
@@ -1887,14 +2896,47 @@ private:
         renderPassInfo.clearValueCount = 1;
         renderPassInfo.pClearValues = &clearColor;
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        bool parallel = recordsInParallel();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
         // 이러면 이제 렌더패스가 시작된다. command를 record하는 함수들은 전부 vkCmd prefix가 붙는다.
         // 그리고 전부 void를 리턴한다. => 실제 recording이 끝날 때까진 에러가 생기지 않기때문에
         // VK_SUBPASS_CONTENTS_INLINE: 렌더패스 커맨드가 primary command buffer에 임베드 되고 secondary command buffer는 쓰지 않음
         // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: 렌더 패스 command가 secondary command buffer에서 실행됨
+        // 이 경우 렌더 패스 안에서는 vkCmdExecuteCommands 말고 다른 명령을 기록할 수 없다.
+
+        if (parallel) {
+            recordParallelDraws(commandBuffer, swapChainFrameBuffers[imageIndex], frameData);
+        }
+        else {
+            recordDrawState(commandBuffer);
+            if (options.instanceCount > 0) {
+                recordObjectDraws(commandBuffer, frameData, 0, options.instanceCount);
+            }
+            else {
+                meshBuffer.draw(commandBuffer);
+            }
+            // 정점 버퍼와 인덱스 버퍼를 바인딩하고 vkCmdDrawIndexed로 그린다.
+            // indexCount: 인덱스의 개수, instanceCount: instanced rendering을 위해 사용. --instances가 없으면 1
+            // firstIndex, vertexOffset, firstInstance: 버퍼 안에서 어디부터 읽을지. 지금은 전부 0
+        }
+
+
+        vkCmdEndRenderPass(commandBuffer);
+        if (options.drawBenchmark) {
+            frameBenchmark.recordEnd(commandBuffer, currentFrame);
+        }
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
 
+    bool recordsInParallel() const {
+        return parallelRecorder.isEnabled() && options.instanceCount > 0;
+    }
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    // 파이프라인, 뷰포트, 시저, 메시 버퍼를 바인딩한다. secondary command buffer는 primary의 상태를 물려받지 않아서 조각마다 부른다.
+    void recordDrawState(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, options.instanceCount > 0 ? instancedPipeline : graphicsPipeline);
         // 두 번째 파라미터를 통해 파이프라인이 그래픽스용인지 compute shade용인지 기술해줌
         // 파이프라인에 커맨드 버퍼를 바인딩해줌
 
@@ -1916,45 +2958,123 @@ private:
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
 
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-        // vertexCount: vertex의 개수가 몇 개인지
-        // instanceCount: instanced rendering을 위해 사용. 지금은 안쓰니까 1
-        // firstVertex: vulkan은 opencl과 같이 spir-v를 쓰기 때문에 in변수의 이름을 지정해서
-        //              데이터가 전송되는 것이 아닌 gl_vertexIndex를 이용해 직접 접근함
-        // firstInstance: instanced rendering을 위해 쓰임. gl_InstanceIndex가 최소값임
+        meshBuffer.bind(commandBuffer);
+    }
+
+    // 오브젝트들을 --record-threads개의 조각으로 나눠 secondary에 기록하고 primary에서 실행한다.
+    // 조각마다 드로우 상태를 다시 바인딩하는 비용이 있으니 조각 하나가 너무 작아지지 않게 한다.
+    // 각 조각은 recordDrawState와 recordObjectDraws만 부르는데 둘 다 읽기만 하는 함수라서 여러 스레드에서 불러도 된다.
+    void recordParallelDraws(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, const FrameData& frameData) {
+        const uint32_t minimumDrawsPerThread = 256;
+        const std::vector<VkCommandBuffer>& secondaries = parallelRecorder.record(currentFrame, renderPass, 0, framebuffer,
+            options.instanceCount, minimumDrawsPerThread, [&](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+                recordDrawState(secondary);
+                recordObjectDraws(secondary, frameData, first, count);
+            });
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    }
 
 
-        vkCmdEndRenderPass(commandBuffer);
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+
+
+    // --instances, --draw-benchmark의 오브젝트 중 [firstObject, firstObject + objectCount)를 그린다. 오브젝트마다의 위치와 색은
+    // binding 1의 인스턴스 데이터에 있고 몇 번째 오브젝트인지는 firstInstance로 고르기 때문에 세 방식 모두 같은 파이프라인,
+    // 같은 데이터로 같은 그림을 그린다. 범위를 나눠 여러 커맨드 버퍼에 기록해도 결과가 같다.
+    void recordObjectDraws(VkCommandBuffer commandBuffer, const FrameData& frameData, uint32_t firstObject, uint32_t objectCount) {
+        const StagingRing::Slice& instanceSlice = frameData.instances;
+        if (!instanceSlice.isValid()) {
+            return; // 링이 가득 찬 프레임은 오브젝트를 그리지 않는다. (종료할 때 printStats의 overflow로 보인다)
+        }
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceSlice.buffer, &instanceSlice.offset);
+
+        switch (options.drawMode) {
+        case DrawMode::Separate:
+            for (uint32_t i = firstObject; i < firstObject + objectCount; i++) {
+                meshBuffer.draw(commandBuffer, 1, i); // 오브젝트마다 드로우 콜 하나. CPU 비용이 오브젝트 수에 비례한다.
+            }
+            break;
+        case DrawMode::Indirect:
+            recordIndirectDraws(commandBuffer, frameData.indirectCommands, firstObject, objectCount);
+            break;
+        default:
+            meshBuffer.draw(commandBuffer, objectCount, firstObject);
+            break;
         }
     }
 
+    // 드로우 명령들을 링에 쓴다. GPU 컬링이 붙으면 이 버퍼를 컴퓨트 셰이더가 채우게 된다.
+    // 컬링 결과는 프레임마다 바뀌니 여기서도 프레임마다 다시 쓴다.
+    StagingRing::Slice writeIndirectCommands(uint32_t objectCount) {
+        StagingRing::Slice commandSlice = stagingRing.allocate(VkDeviceSize(objectCount) * sizeof(VkDrawIndexedIndirectCommand),
+            StagingRing::Usage::Indirect);
+        if (!commandSlice.isValid()) {
+            return commandSlice;
+        }
+
+        auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(commandSlice.data);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            commands[i] = { meshBuffer.getIndexCount(), 1, 0, 0, i };
+        }
+        return commandSlice;
+    }
 
+    // writeIndirectCommands로 쓴 명령 중 [firstObject, firstObject + objectCount)를 vkCmdDrawIndexedIndirect로 그린다.
+    void recordIndirectDraws(VkCommandBuffer commandBuffer, const StagingRing::Slice& commandSlice, uint32_t firstObject, uint32_t objectCount) {
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        if (!commandSlice.isValid()) {
+            return;
+        }
+
+        // multiDrawIndirect가 없으면 maxDrawIndirectCount가 1이라 명령마다 한 번씩 부르게 된다.
+        for (uint32_t first = firstObject; first < firstObject + objectCount; first += maxDrawIndirectCount) {
+            uint32_t count = std::min(firstObject + objectCount - first, maxDrawIndirectCount);
+            vkCmdDrawIndexedIndirect(commandBuffer, commandSlice.buffer, commandSlice.offset + VkDeviceSize(first) * stride, count, stride);
+        }
+    }
 
 
 #pragma endregion
 
     void cleanup() {
 
+        framePacer.printStats(std::cout);
+        framePacer.destroy(); // 마지막 프레임까지 기다리고 미뤄둔 파괴를 실행한다.
+
         cleanupSwapChain();
 
 
         vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        if (instancedPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, instancedPipeline, nullptr);
+        }
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
         vkDestroyRenderPass(device, renderPass, nullptr);
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (size_t i = 0; i < framesInFlight; i++) {
             vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
             vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
         }
 
         
         // Command buffer는 cmannd buffer가 없어질 때 자동으로 없어지기 때문에 별도로 commandBuffer를 없애줄
         // 필요가 없음. 실제로 없애주는 vkDestroyCommandBuffer함수도 없음
+        commandBufferCache.printStats(std::cout);
+        commandBufferCache.destroy();
+        parallelRecorder.destroy();
         vkDestroyCommandPool(device, commandPool, nullptr);
+        meshBuffer.destroy(gpuAllocator);
+        meshCache.destroy();
+        frameBenchmark.destroy();
+        stagingRing.printStats(std::cout);
+        stagingRing.destroy(gpuAllocator);
+        transferQueue.destroy();
+        gpuAllocator.destroy();
+
+        pipelineBuilder.stop();
+        jobs.stop();
+        pipelineCache.save();
+        pipelineCache.destroy();
 
         vkDestroyDevice(device, nullptr);
 
@@ -1963,22 +3083,43 @@ private:
         }
 
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!options.headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
         vkDestroyInstance(instance, nullptr);
 
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        if (!options.headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
 
     }
 
 
 };
 
-int main()
+int main(int argc, char** argv)
 {
-    HelloTriangleApplication app;
-
     try {
+        AppOptions options = parseAppOptions(argc, argv);
+        if (options.allocatorBenchmark) {
+            return GpuAllocatorBenchmark::run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (options.meshBenchmark) {
+            // 합성 메시는 xy 평면의 격자고, 색은 격자 좌표로 정한다.
+            auto makeVertex = [](float u, float v) { return SourceVertex{ { u * 2.0f - 1.0f, v * 2.0f - 1.0f }, { u, v, 1.0f - u } }; };
+            auto positionOf = [](const SourceVertex& vertex) { return glm::vec3(vertex.pos.x, vertex.pos.y, 0.0f); };
+            bool passed = MeshOptimizerBenchmark::run<SourceVertex>(options.pipelineThreadCount, makeVertex, positionOf);
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (options.jobBenchmark) {
+            return JobSystemBenchmark::run(options.jobThreadCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (options.renderGraphTest) {
+            return RenderGraphTest::run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        HelloTriangleApplication app(options);
         app.run();
     }
     catch (const std::exception e) {
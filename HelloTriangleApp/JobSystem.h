@@ -0,0 +1,291 @@
+﻿#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+
+// 스레드마다 작업 덱을 하나씩 두고 일이 없는 스레드가 다른 스레드의 덱에서 훔쳐오는(work stealing) 작업 스케줄러
+//
+// WorkerPool은 큐 하나를 모든 스레드가 같이 쓰기 때문에 작은 작업을 많이 넣으면 그 큐의 락에서 스레드들이 부딪힌다.
+// 여기서는 작업을 넣은 스레드의 덱 뒤에 넣고 자기 덱은 뒤에서(최근에 넣은 것부터, 캐시에 남아 있을 가능성이 높다) 꺼낸다.
+// 자기 덱이 비었을 때만 다른 덱의 앞에서(오래된 것부터) 훔쳐오니 락이 덱마다 나뉘어 있고 대부분 주인 스레드만 잡는다.
+//
+// 작업 사이의 의존성은 Counter로 표현한다.
+//      JobSystem::Counter transformsDone, cullingDone;
+//      jobs.parallelFor(&transformsDone, count, 1024, updateTransforms);       // 변환 갱신 작업 여러 개
+//      jobs.run(&cullingDone, cull, &transformsDone);                          // transformsDone이 0이 된 뒤에 실행
+//      jobs.wait(cullingDone);                                                 // 기다리는 동안 이 스레드도 작업을 실행한다.
+// wait는 기다리는 스레드를 재우지 않고 남은 작업을 같이 실행하기 때문에 메인 스레드도 일꾼 하나로 쓰인다.
+// 워커도 아니고 start를 부른 스레드도 아닌 스레드가 작업을 넣으면 0번(메인 스레드) 덱으로 들어간다.
+class JobSystem {
+public:
+    // 아직 끝나지 않은 작업 수. run에 넘긴 카운터는 작업이 끝날 때 1씩 줄어든다.
+    // 이 카운터에 걸린 작업(의존하는 작업)들은 0이 되는 순간 스케줄된다.
+    // 걸린 작업이 남아 있는 동안에는 카운터를 다시 쓰면 안 된다. (wait가 끝난 뒤에 다시 쓴다)
+    class Counter {
+    public:
+        bool isDone() const {
+            return pending.load(std::memory_order_acquire) == 0;
+        }
+
+    private:
+        friend class JobSystem;
+        std::atomic<uint32_t> pending{ 0 };
+        std::mutex continuationMutex;
+        std::vector<std::function<void()>> continuations; // 0이 되면 push할 작업들
+    };
+
+    JobSystem() = default;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem() {
+        stop();
+    }
+
+    // workerCount개의 워커 스레드를 띄운다. 0이면 작업은 wait를 부른 스레드에서만 실행된다.
+    // start를 부른 스레드가 0번 덱의 주인(메인 스레드)이 된다.
+    void start(uint32_t workerCount) {
+        stopping = false;
+        queues.clear();
+        for (uint32_t i = 0; i < workerCount + 1; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        threadSlot() = { this, 0 };
+
+        for (uint32_t i = 1; i <= workerCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    // 남은 작업까지 다 실행한 뒤에 워커를 정리한다.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        if (threadSlot().owner == this) {
+            threadSlot() = {};
+        }
+    }
+
+    // job을 실행한다. signal이 있으면 끝날 때 1 줄이고, dependency가 있으면 dependency가 0이 된 뒤에 스케줄한다.
+    // 작업이 던진 예외는 삼켜지지 않고 다음 wait에서 다시 던져진다. (처음 것 하나만)
+    template<typename Function>
+    void run(Counter* signal, Function&& function, Counter* dependency = nullptr) {
+        if (signal != nullptr) {
+            signal->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::function<void()> job = [this, signal, function = std::forward<Function>(function)]() mutable {
+            execute(function, signal);
+        };
+
+        if (dependency != nullptr) {
+            std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+            if (!dependency->isDone()) {
+                dependency->continuations.push_back(std::move(job));
+                return;
+            }
+            // 락을 잡기 전에 이미 0이 됐으면 release가 continuations를 비운 뒤라서 바로 넣는다.
+        }
+        push(std::move(job));
+    }
+
+    // [0, count)를 grain개씩 잘라서 function(begin, end)를 작업으로 나눠 실행한다. 작업은 signal에 묶인다.
+    template<typename Function>
+    void parallelFor(Counter* signal, uint32_t count, uint32_t grain, Function function, Counter* dependency = nullptr) {
+        grain = std::max(grain, 1u);
+        for (uint32_t begin = 0; begin < count; begin += grain) {
+            uint32_t end = std::min(count, begin + grain);
+            run(signal, [function, begin, end] { function(begin, end); }, dependency);
+        }
+    }
+
+    // counter가 0이 될 때까지 남은 작업을 같이 실행하면서 기다린다. (help while waiting)
+    // 실행할 게 없으면 다른 스레드가 의존성을 풀어주길 기다리며 양보한다.
+    void wait(Counter& counter) {
+        uint32_t index = currentQueueIndex();
+        while (!counter.isDone()) {
+            if (!runOne(index)) {
+                std::this_thread::yield();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(counter.continuationMutex); // 카운터를 0으로 만든 작업이 락을 놓을 때까지 (release 참고)
+        }
+
+        std::exception_ptr failure;
+        {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            std::swap(failure, firstFailure);
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    uint32_t threadCount() const {
+        return static_cast<uint32_t>(workers.size()) + 1;
+    }
+
+    uint64_t stealCount() const {
+        return steals.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Queue { // 이웃한 덱의 락끼리 같은 캐시 라인을 쓰지 않도록
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    struct ThreadSlot {
+        const JobSystem* owner = nullptr;
+        uint32_t index = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // [0]: 메인 스레드, [1..]: 워커
+    std::vector<std::thread> workers;
+    std::atomic<uint32_t> queuedJobs{ 0 }; // 덱들에 들어 있는 작업 수. 워커를 재울지 정할 때만 쓴다.
+    std::atomic<uint32_t> sleepingWorkers{ 0 };
+    std::atomic<uint64_t> steals{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    bool stopping = false;
+
+    std::mutex failureMutex;
+    std::exception_ptr firstFailure;
+
+    static ThreadSlot& threadSlot() {
+        static thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    uint32_t currentQueueIndex() const {
+        const ThreadSlot& slot = threadSlot();
+        return slot.owner == this ? slot.index : 0;
+    }
+
+    template<typename Function>
+    void execute(Function& function, Counter* signal) {
+        try {
+            function();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!firstFailure) {
+                firstFailure = std::current_exception();
+            }
+        }
+        if (signal != nullptr) {
+            release(*signal);
+        }
+    }
+
+    // 카운터를 1 줄이고 0이 됐으면 걸려 있던 작업들을 스케줄한다.
+    // 마지막 작업은 락 안에서 0으로 만든다. 기다리던 쪽은 0을 본 뒤 이 락을 한 번 거쳐가고 나서야 카운터를 없앨 수 있으니(wait 참고)
+    // 락을 푼 뒤에는 카운터를 건드리지 않는 한 이미 없어진 카운터를 쓰는 일이 없다.
+    void release(Counter& counter) {
+        uint32_t value = counter.pending.load(std::memory_order_relaxed);
+        while (value > 1) {
+            if (counter.pending.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter.continuationMutex);
+            if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                ready.swap(counter.continuations); // 그 사이에 작업이 더 붙었으면 아직 0이 아니니 그대로 둔다.
+            }
+        }
+        for (auto& job : ready) {
+            push(std::move(job));
+        }
+    }
+
+    void push(std::function<void()> job) {
+        Queue& queue = *queues[currentQueueIndex()];
+        queuedJobs.fetch_add(1); // 덱에 넣기 전에 올려야 꺼낸 쪽이 먼저 줄여서 0 아래로 내려가는 일이 없다.
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        if (sleepingWorkers.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex); // 워커가 조건을 확인한 뒤 잠들기 전 사이에 깨우면 놓치기 때문에
+            sleepCondition.notify_one();
+        }
+    }
+
+    // 자기 덱의 뒤에서 하나 꺼내고, 비었으면 다른 덱들의 앞에서 훔쳐온다.
+    bool runOne(uint32_t index) {
+        std::function<void()> job;
+        {
+            Queue& own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+            }
+        }
+
+        for (size_t offset = 1; !job && offset < queues.size(); offset++) {
+            Queue& victim = *queues[(index + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                steals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (!job) {
+            return false;
+        }
+        queuedJobs.fetch_sub(1);
+        job();
+        return true;
+    }
+
+    void workerLoop(uint32_t index) {
+        threadSlot() = { this, index };
+        while (true) {
+            if (runOne(index)) {
+                continue;
+            }
+
+            // 바로 잠들면 작업이 조금씩 들어오는 프레임 중에 깨우는 비용이 커서 조금 양보하며 더 찾아본다.
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; spin++) {
+                std::this_thread::yield();
+                found = queuedJobs.load() > 0;
+            }
+            if (found) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers.fetch_add(1);
+            sleepCondition.wait(lock, [this] { return stopping || queuedJobs.load() > 0; });
+            sleepingWorkers.fetch_sub(1);
+            if (stopping && queuedJobs.load() == 0) {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,136 @@
+﻿#pragma once
+
+#include <vector>
+#include <future>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "JobSystem.h"
+#include "BenchmarkReport.h"
+
+
+// --job-benchmark: 수 마이크로초짜리 작은 작업들을 JobSystem과 std::async로 돌려서 작업 하나를 띄우는 비용을 비교한다.
+// 1) 서로 독립인 작업 taskCount개, 2) 프레임마다 변환 갱신 -> 컬링 -> 기록(합산)으로 이어지는 작업 그래프
+// 결과는 한 스레드로 계산한 값과 같아야 한다.
+namespace JobSystemBenchmark {
+
+inline bool run(uint32_t workerCount) {
+    const uint32_t taskCount = 20000;
+    const uint32_t frameCount = 200;
+    const uint32_t objectCount = 10000;
+    const uint32_t grain = 256;
+    BenchmarkReport report("job benchmark");
+
+    auto work = [](uint32_t i) {
+        float x = i * 0.001f;
+        for (int k = 0; k < 256; k++) {
+            x = x * 0.999f + std::sin(x);
+        }
+        return x;
+    };
+
+    std::vector<float> expected(taskCount);
+    double serialMs = BenchmarkReport::measure([&] {
+        for (uint32_t i = 0; i < taskCount; i++) {
+            expected[i] = work(i);
+        }
+    });
+
+    std::vector<float> asyncResults(taskCount);
+    double asyncMs = BenchmarkReport::measure([&] {
+        std::vector<std::future<void>> futures;
+        futures.reserve(taskCount);
+        for (uint32_t i = 0; i < taskCount; i++) {
+            futures.push_back(std::async(std::launch::async, [&, i] { asyncResults[i] = work(i); }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    });
+
+    JobSystem jobs;
+    jobs.start(workerCount);
+    std::vector<float> jobResults(taskCount);
+    double jobMs = BenchmarkReport::measure([&] {
+        JobSystem::Counter done;
+        for (uint32_t i = 0; i < taskCount; i++) {
+            jobs.run(&done, [&, i] { jobResults[i] = work(i); });
+        }
+        jobs.wait(done);
+    });
+
+    report.line() << taskCount << " tasks | serial " << serialMs << " ms | std::async " << asyncMs << " ms ("
+        << asyncMs * 1000.0 / taskCount << " us/task) | jobs " << jobMs << " ms (" << jobMs * 1000.0 / taskCount << " us/task, "
+        << jobs.threadCount() << " threads, " << jobs.stealCount() << " steals)";
+    report.result(asyncResults == expected && jobResults == expected);
+
+    // 프레임 하나: 오브젝트 변환을 grain개씩 갱신하고, 다 끝나면 grain개씩 컬링하고, 다 끝나면 보이는 것만 합산한다.
+    std::vector<float> positions(objectCount);
+    std::vector<uint8_t> visible(objectCount);
+    auto updateTransforms = [&](uint32_t frame, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            positions[i] = std::sin(frame * 0.01f + i * 0.37f);
+        }
+    };
+    auto cull = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            visible[i] = positions[i] > -0.5f;
+        }
+    };
+    auto record = [&] {
+        double sum = 0.0;
+        for (uint32_t i = 0; i < objectCount; i++) {
+            sum += visible[i] ? positions[i] : 0.0;
+        }
+        return sum;
+    };
+
+    std::vector<double> expectedSums(frameCount);
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        updateTransforms(frame, 0, objectCount);
+        cull(0, objectCount);
+        expectedSums[frame] = record();
+    }
+
+    std::vector<double> asyncSums(frameCount);
+    double asyncGraphMs = BenchmarkReport::measure([&] {
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            std::vector<std::future<void>> stage;
+            for (uint32_t begin = 0; begin < objectCount; begin += grain) {
+                stage.push_back(std::async(std::launch::async, [&, frame, begin] { updateTransforms(frame, begin, std::min(objectCount, begin + grain)); }));
+            }
+            for (auto& future : stage) {
+                future.get();
+            }
+            stage.clear();
+            for (uint32_t begin = 0; begin < objectCount; begin += grain) {
+                stage.push_back(std::async(std::launch::async, [&, begin] { cull(begin, std::min(objectCount, begin + grain)); }));
+            }
+            for (auto& future : stage) {
+                future.get();
+            }
+            asyncSums[frame] = std::async(std::launch::async, record).get();
+        }
+    });
+
+    std::vector<double> jobSums(frameCount);
+    double jobGraphMs = BenchmarkReport::measure([&] {
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            JobSystem::Counter transformsDone, cullingDone, recordDone;
+            jobs.parallelFor(&transformsDone, objectCount, grain, [&, frame](uint32_t begin, uint32_t end) { updateTransforms(frame, begin, end); });
+            jobs.parallelFor(&cullingDone, objectCount, grain, cull, &transformsDone);
+            jobs.run(&recordDone, [&, frame] { jobSums[frame] = record(); }, &cullingDone);
+            jobs.wait(recordDone);
+        }
+    });
+    jobs.stop();
+
+    report.line() << "frame graph " << frameCount << " frames x " << objectCount << " objects | std::async "
+        << asyncGraphMs / frameCount << " ms/frame | jobs " << jobGraphMs / frameCount << " ms/frame";
+    report.result(asyncSums == expectedSums && jobSums == expectedSums);
+
+    return report.passed();
+}
+
+} // namespace JobSystemBenchmark
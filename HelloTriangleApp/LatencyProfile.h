@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+// 지연 시간과 처리량 사이의 어느 지점을 고를지 정하는 설정
+//
+// in flight 프레임이 많고 swapchain 이미지가 많을수록 CPU가 GPU보다 멀리 앞서 갈 수 있어서 어느 한쪽이 잠깐 느려져도
+// 다른 쪽이 놀지 않는다(처리량). 대신 CPU가 입력을 읽고 나서 그 프레임이 화면에 나올 때까지 앞에 쌓인 프레임만큼 더 기다린다(지연).
+//      low: 1프레임, swapchain은 minImageCount장  -> CPU가 GPU를 기다리는 시간이 늘지만 입력이 가장 빨리 보인다.
+//      balanced: 2프레임, minImageCount + 1장       -> 원래 설정
+//      throughput: 3프레임, minImageCount + 2장     -> CPU와 GPU가 서로를 기다리는 일이 가장 적다.
+struct LatencyProfile {
+    enum class Mode {
+        Low,
+        Balanced,
+        Throughput,
+    };
+
+    Mode mode = Mode::Balanced;
+    uint32_t framesInFlight = 2;
+    uint32_t extraSwapchainImages = 1; // minImageCount에 더할 장 수 (maxImageCount를 넘으면 잘린다)
+
+    static LatencyProfile fromMode(Mode mode) {
+        switch (mode) {
+        case Mode::Low:
+            return { mode, 1, 0 };
+        case Mode::Throughput:
+            return { mode, 3, 2 };
+        default:
+            return { Mode::Balanced, 2, 1 };
+        }
+    }
+
+    // "low", "balanced", "throughput" 중 하나가 아니면 false
+    static bool parse(const std::string& name, Mode& mode) {
+        for (Mode candidate : { Mode::Low, Mode::Balanced, Mode::Throughput }) {
+            if (name == modeName(candidate)) {
+                mode = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static const char* modeName(Mode mode) {
+        switch (mode) {
+        case Mode::Low:
+            return "low";
+        case Mode::Throughput:
+            return "throughput";
+        default:
+            return "balanced";
+        }
+    }
+
+    const char* name() const {
+        return modeName(mode);
+    }
+};
+
+
+// 프로파일마다 FPS와 입력에서 GPU 완료까지의 지연 시간을 재는 기록기
+//
+// 프레임의 입력(애니메이션 시계 등)은 커맨드를 기록하면서 읽으니 기록 직전에 frameStarted(value)를 부르고,
+// 매 프레임 FramePacer.beginFrame이 알려준 완료된 타임라인 값으로 frameCompleted를 부르면 그 값까지의 프레임들의 지연이 기록된다.
+//      frameCompleted(beginFrame()) -> (acquire) -> frameStarted(frameValue()) -> 기록, 제출
+// 화면에 실제로 나온 시각은 VK_KHR_present_wait 같은 확장이 있어야 알 수 있어서 여기서는 그 프레임의 렌더링이 끝난 걸
+// CPU가 확인한 시각까지를 잰다. CPU가 기다리지 않고 지나간 프레임은 다음 프레임에야 확인되니 그만큼 길게(상한으로) 잡힌다.
+class LatencyMeter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        std::string profile;
+        uint32_t framesInFlight = 0;
+        uint32_t imageCount = 0;
+        uint64_t frames = 0;
+        double fps = 0.0;
+        double meanMs = 0.0;
+        double medianMs = 0.0;
+        double p99Ms = 0.0;
+    };
+
+    // 이전 프로파일을 끝내고(finishProfile) 새로 재기 시작한다.
+    void beginProfile(const LatencyProfile& profile, uint32_t imageCount) {
+        finishProfile();
+        current = Result{};
+        current.profile = profile.name();
+        current.framesInFlight = profile.framesInFlight;
+        current.imageCount = imageCount;
+        pending.clear();
+        latencies.clear();
+        measuring = true;
+    }
+
+    void frameStarted(uint64_t frameValue) {
+        if (!measuring) {
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        if (current.frames == 0) {
+            firstFrame = now;
+        }
+        current.frames++;
+        pending.push_back({ frameValue, now });
+    }
+
+    void frameCompleted(uint64_t completedValue) {
+        Clock::time_point now = Clock::now();
+        while (!pending.empty() && pending.front().value <= completedValue) {
+            latencies.push_back(std::chrono::duration<double, std::milli>(now - pending.front().started).count());
+            pending.pop_front();
+        }
+    }
+
+    // 디바이스가 idle인 상태에서 부른다. 남은 프레임은 지금 끝난 것으로 치고 결과를 저장한다.
+    void finishProfile() {
+        if (!measuring) {
+            return;
+        }
+        measuring = false;
+        frameCompleted(UINT64_MAX);
+        if (current.frames == 0) {
+            return;
+        }
+
+        double seconds = std::chrono::duration<double>(Clock::now() - firstFrame).count();
+        current.fps = seconds > 0.0 ? current.frames / seconds : 0.0;
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            double sum = 0.0;
+            for (double latency : latencies) {
+                sum += latency;
+            }
+            size_t p99 = std::min(latencies.size() - 1, static_cast<size_t>(std::ceil(latencies.size() * 0.99)) - 1);
+            current.meanMs = sum / latencies.size();
+            current.medianMs = latencies[latencies.size() / 2];
+            current.p99Ms = latencies[p99];
+        }
+        results.push_back(current);
+    }
+
+    // ex) latency profile low: 1 frame in flight, 2 images | 300 frames 512 fps | input to GPU done mean 1.9 median 1.8 p99 2.6 ms
+    void printReport(std::ostream& out) const {
+        for (const Result& result : results) {
+            out << "latency profile " << result.profile << ": " << result.framesInFlight << " frame"
+                << (result.framesInFlight == 1 ? "" : "s") << " in flight, " << result.imageCount << " images | "
+                << result.frames << " frames " << result.fps << " fps | input to GPU done mean " << result.meanMs
+                << " median " << result.medianMs << " p99 " << result.p99Ms << " ms\n";
+        }
+    }
+
+private:
+    struct Pending {
+        uint64_t value = 0;
+        Clock::time_point started;
+    };
+
+    bool measuring = false;
+    Result current;
+    Clock::time_point firstFrame;
+    std::deque<Pending> pending;
+    std::vector<double> latencies;
+    std::vector<Result> results;
+};
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// 파일을 읽기 전용으로 메모리에 매핑한다.
+// ifstream으로 읽으면 파일 크기만큼 힙을 할당하고 커널 버퍼에서 한 번 더 복사해야 하지만
+// 매핑하면 페이지 캐시를 그대로 가리키기 때문에 복사도 없고 실제로 접근한 페이지만 메모리에 올라온다.
+// 매핑된 주소는 페이지 단위로 정렬돼 있어서 uint32_t 배열 등으로 바로 해석해도 정렬 문제가 없다.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path) {
+        open(path);
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            mappedData = other.mappedData;
+            mappedSize = other.mappedSize;
+#ifdef _WIN32
+            fileHandle = other.fileHandle;
+            mappingHandle = other.mappingHandle;
+            other.fileHandle = INVALID_HANDLE_VALUE;
+            other.mappingHandle = nullptr;
+#endif
+            other.mappedData = nullptr;
+            other.mappedSize = 0;
+        }
+        return *this;
+    }
+
+    void open(const std::string& path) {
+        close();
+
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open file " + path + "!");
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            close();
+            throw std::runtime_error("failed to query size of " + path + "!");
+        }
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+        if (mappedSize != 0) {
+            mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mappingHandle == nullptr) {
+                close();
+                throw std::runtime_error("failed to map file " + path + "!");
+            }
+
+            mappedData = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+            if (mappedData == nullptr) {
+                close();
+                throw std::runtime_error("failed to map file " + path + "!");
+            }
+        }
+#else
+        int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0) {
+            throw std::runtime_error("failed to open file " + path + "!");
+        }
+
+        struct stat fileStat;
+        if (fstat(fileDescriptor, &fileStat) != 0) {
+            ::close(fileDescriptor);
+            throw std::runtime_error("failed to query size of " + path + "!");
+        }
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+
+        if (mappedSize != 0) {
+            void* data = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            if (data == MAP_FAILED) {
+                ::close(fileDescriptor);
+                mappedSize = 0;
+                throw std::runtime_error("failed to map file " + path + "!");
+            }
+            mappedData = data;
+        }
+
+        ::close(fileDescriptor); // 매핑은 파일 디스크립터를 닫아도 유지된다.
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (mappedData != nullptr) {
+            UnmapViewOfFile(mappedData);
+        }
+        if (mappingHandle != nullptr) {
+            CloseHandle(mappingHandle);
+            mappingHandle = nullptr;
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle(fileHandle);
+            fileHandle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (mappedData != nullptr) {
+            munmap(mappedData, mappedSize);
+        }
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    const void* data() const {
+        return mappedData;
+    }
+
+    size_t size() const {
+        return mappedSize;
+    }
+
+    bool isOpen() const {
+        return mappedData != nullptr;
+    }
+
+private:
+    void* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,164 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <vector>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+#include "TransferQueue.h"
+
+
+// device local 메모리에 올라간 정점 버퍼 + 인덱스 버퍼 한 쌍
+//
+// HOST_VISIBLE 메모리에 정점 버퍼를 두면 외장 GPU는 매 드로우마다 PCIe 너머의 시스템 메모리를 읽어야 한다.
+// 그래서 데이터를 한 번 HOST_VISIBLE staging 버퍼에 쓰고, 전송 큐에서 DEVICE_LOCAL 버퍼로 복사한 뒤
+// staging 버퍼는 복사가 끝나면 버린다.
+//
+// 복사는 TransferQueue에 제출되고, 그래픽스 큐는 다음 프레임 제출 때 타임라인 세마포어로 복사가 끝나길 기다린다.
+// 따라서 upload 직후에 바로 bind/draw를 기록해도 된다. (그 프레임의 제출이 handoff를 가져가기만 하면 된다)
+class MeshBuffer {
+public:
+    // 인덱스는 16비트나 32비트만 된다. 정점이 65536개 이하면 16비트를 써야 인덱스 대역폭이 절반이 된다.
+    template<typename VertexType, typename IndexType>
+    void upload(GpuAllocator& allocator, TransferQueue& transferQueue,
+        const std::vector<VertexType>& vertices, const std::vector<IndexType>& indices) {
+        static_assert(std::is_same<IndexType, uint16_t>::value || std::is_same<IndexType, uint32_t>::value,
+            "index type must be uint16_t or uint32_t");
+
+        upload(allocator, transferQueue,
+            vertices.data(), vertices.size() * sizeof(VertexType),
+            indices.data(), static_cast<uint32_t>(indices.size()),
+            sizeof(IndexType) == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+    }
+
+    void upload(GpuAllocator& allocator, TransferQueue& transferQueue,
+        const void* vertexData, VkDeviceSize vertexBytes, const void* indexData, uint32_t indexCount, VkIndexType indexType) {
+        if (vertexBytes == 0 || indexCount == 0) {
+            throw std::runtime_error("mesh buffer: nothing to upload!");
+        }
+
+        VkDeviceSize indexBytes = static_cast<VkDeviceSize>(indexCount) * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+        VkDeviceSize indexOffset = (vertexBytes + 3) & ~VkDeviceSize(3); // vkCmdCopyBuffer의 srcOffset은 정렬 제약이 없지만 보기 좋게 4바이트로 맞춘다.
+
+        // staging 버퍼 하나에 정점과 인덱스를 이어서 쓴다.
+        VkBufferCreateInfo stagingInfo{};
+        stagingInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        stagingInfo.size = indexOffset + indexBytes;
+        stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        stagingInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        stagingBuffer = allocator.createBuffer(stagingInfo,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingAllocation);
+        // HOST_COHERENT라서 memcpy 뒤에 vkFlushMappedMemoryRanges를 부를 필요가 없다.
+
+        char* staging = static_cast<char*>(stagingAllocation.mapped);
+        std::memcpy(staging, vertexData, static_cast<size_t>(vertexBytes));
+        std::memcpy(staging + indexOffset, indexData, static_cast<size_t>(indexBytes));
+
+        uploadValue = uploadFrom(allocator, transferQueue, stagingBuffer, 0, vertexBytes, indexOffset, indexCount, indexType);
+    }
+
+    // 이미 GPU가 읽을 수 있는 버퍼(staging ring의 slice, 외부에서 import한 메모리 등)에 데이터가 들어있을 때
+    // 그 버퍼에서 바로 device local 버퍼로 복사한다. source는 리턴된 타임라인 값에 전송 큐가 도달할 때까지 살아있어야 한다.
+    uint64_t uploadFrom(GpuAllocator& allocator, TransferQueue& transferQueue, VkBuffer source,
+        VkDeviceSize vertexSourceOffset, VkDeviceSize vertexBytes, VkDeviceSize indexSourceOffset, uint32_t indexCount, VkIndexType indexType) {
+        if (vertexBytes == 0 || indexCount == 0) {
+            throw std::runtime_error("mesh buffer: nothing to upload!");
+        }
+
+        this->indexCount = indexCount;
+        this->indexType = indexType;
+        VkDeviceSize indexBytes = static_cast<VkDeviceSize>(indexCount) * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+
+        VkBufferCreateInfo vertexInfo{};
+        vertexInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        vertexInfo.size = vertexBytes;
+        vertexInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        vertexInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // 큐 사이의 소유권은 TransferQueue가 넘겨준다.
+        vertexBuffer = allocator.createBuffer(vertexInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexAllocation);
+
+        VkBufferCreateInfo indexInfo = vertexInfo;
+        indexInfo.size = indexBytes;
+        indexInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        indexBuffer = allocator.createBuffer(indexInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexAllocation);
+
+        TransferQueue::Ownership ownership;
+        ownership.buffers.push_back(bufferBarrier(vertexBuffer, vertexBytes, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT));
+        ownership.buffers.push_back(bufferBarrier(indexBuffer, indexBytes, VK_ACCESS_INDEX_READ_BIT));
+        ownership.dstStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+        VkBuffer vertexDestination = vertexBuffer;
+        VkBuffer indexDestination = indexBuffer;
+        return transferQueue.submit([=](VkCommandBuffer commandBuffer) {
+            VkBufferCopy vertexCopy{ vertexSourceOffset, 0, vertexBytes };
+            vkCmdCopyBuffer(commandBuffer, source, vertexDestination, 1, &vertexCopy);
+
+            VkBufferCopy indexCopy{ indexSourceOffset, 0, indexBytes };
+            vkCmdCopyBuffer(commandBuffer, source, indexDestination, 1, &indexCopy);
+        }, ownership);
+    }
+
+    // 복사가 끝났으면 staging 버퍼를 반환한다. 업로드를 기다린 프레임이 끝난 뒤에 FramePacer.deferDestroy로 부른다.
+    void releaseStaging(GpuAllocator& allocator, const TransferQueue& transferQueue) {
+        if (stagingBuffer != VK_NULL_HANDLE && transferQueue.isComplete(uploadValue)) {
+            allocator.destroyBuffer(stagingBuffer, stagingAllocation);
+            stagingBuffer = VK_NULL_HANDLE;
+        }
+    }
+
+    void bind(VkCommandBuffer commandBuffer) const {
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+    }
+
+    // firstInstance는 INSTANCE rate 바인딩에서 몇 번째 데이터부터 읽을지 정한다.
+    void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const {
+        vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);
+    }
+
+    // 디바이스가 idle인 상태에서 불러야 한다.
+    void destroy(GpuAllocator& allocator) {
+        if (stagingBuffer != VK_NULL_HANDLE) {
+            allocator.destroyBuffer(stagingBuffer, stagingAllocation);
+            stagingBuffer = VK_NULL_HANDLE;
+        }
+        if (vertexBuffer != VK_NULL_HANDLE) {
+            allocator.destroyBuffer(vertexBuffer, vertexAllocation);
+            vertexBuffer = VK_NULL_HANDLE;
+        }
+        if (indexBuffer != VK_NULL_HANDLE) {
+            allocator.destroyBuffer(indexBuffer, indexAllocation);
+            indexBuffer = VK_NULL_HANDLE;
+        }
+    }
+
+    uint32_t getIndexCount() const {
+        return indexCount;
+    }
+
+private:
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    GpuAllocation vertexAllocation;
+    GpuAllocation indexAllocation;
+    GpuAllocation stagingAllocation;
+
+    uint32_t indexCount = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    uint64_t uploadValue = 0; // 복사가 끝나면 전송 큐의 타임라인 세마포어가 도달하는 값
+
+    static VkBufferMemoryBarrier bufferBarrier(VkBuffer buffer, VkDeviceSize size, VkAccessFlags dstAccessMask) {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = size;
+        return barrier;
+    }
+};
@@ -0,0 +1,420 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+#include "MappedFile.h"
+#include "GpuAllocator.h"
+#include "TransferQueue.h"
+#include "StagingRing.h"
+#include "MeshBuffer.h"
+#include "VertexLayout.h"
+
+
+// GPU 버퍼 모양 그대로 저장된 메시 파일 (.bin)
+//
+// 텍스트 메시 포맷은 실행할 때마다 파싱해야 하지만 이 파일은 정점/인덱스 데이터가 GPU 버퍼에 들어갈 바이트 그대로
+// 들어있어서 매핑한 뒤 복사만 하면 된다. CPU가 하는 일은 헤더 검사뿐이라 로딩 시간은 디스크 속도에 묶인다.
+//      Header(72) | 패딩 | 정점 데이터 | 패딩 | 인덱스 데이터 | 패딩
+// Header는 리틀 엔디안으로 이 순서대로 들어있다. (version 2)
+//      magic(4) | version(4) | headerSize(4) | layoutHash(4) | vertexStride(4) | vertexCount(4) | indexType(4) | indexCount(4)
+//      | vertexOffset(8) | vertexBytes(8) | indexOffset(8) | indexBytes(8) | contentHash(8)
+// 정점, 인덱스 구간은 payloadAlignment(4096)에 맞춰 시작하고 끝나기 때문에 매핑된 주소를 그대로
+// VK_EXT_external_memory_host로 import 할 수 있다. (minImportedHostPointerAlignment는 보통 4096)
+//
+// 헤더에는 정점 구조체의 stride와 VertexLayout에서 만든 attribute 해시가 들어있어서
+// Vertex 구조체가 바뀌면 예전 파일은 버리고 다시 만든다. 바이트 순서는 리틀 엔디안만 가정한다.
+// 정점, 인덱스 바이트의 해시(contentHash)도 들어있어서 원본 파일이 없는 메시(내장 사각형)는 load에 기대하는 해시를 넘겨서
+// 데이터가 바뀌었으면 예전 파일을 버린다. 임포트한 메시는 원본 파일의 수정 시각으로 판단한다.
+//
+// GPU로 올리는 방법은 가능한 것 중 앞의 것을 쓴다.
+//      1. external memory host: 매핑된 파일 페이지를 VkDeviceMemory로 import해서 거기서 바로 복사 (CPU 복사 0번)
+//      2. staging ring: 매핑에서 링 버퍼의 slice로 memcpy 한 번 (페이로드가 링의 프레임 구간에 들어갈 때)
+//      3. 전용 staging 버퍼: MeshBuffer::upload처럼 staging 버퍼를 따로 만들어서 memcpy 한 번
+// 드라이버에 따라 읽기 전용 파일 매핑은 import를 거부하기도 하는데, 그러면 조용히 다음 방법으로 넘어간다.
+class MeshCache {
+public:
+    static const uint32_t magic = 0x434d4b56; // "VKMC"
+    static const uint32_t version = 2; // 2: contentHash 추가
+    static const uint64_t payloadAlignment = 4096;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t layoutHash; // VertexLayout::attributeDescriptions로 만든 해시
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        uint32_t indexType; // VkIndexType
+        uint32_t indexCount;
+        uint64_t vertexOffset; // 파일 처음부터의 오프셋
+        uint64_t vertexBytes;
+        uint64_t indexOffset;
+        uint64_t indexBytes;
+        uint64_t contentHash; // 정점 바이트와 인덱스 바이트의 FNV-1a 해시
+    };
+    static_assert(sizeof(Header) == 72, "mesh cache header must stay 72 bytes");
+
+    // 디바이스가 VK_EXT_external_memory_host를 지원하는지. 지원하면 createLogicalDevice에서 켜준다.
+    static bool isExternalMemoryHostSupported(VkPhysicalDevice physicalDevice) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        for (const auto& extension : extensions) {
+            if (std::strcmp(extension.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename VertexType>
+    static uint32_t layoutHash() {
+        constexpr auto attributes = VertexLayout::attributeDescriptions<VertexType>(0);
+
+        uint32_t hash = 2166136261u; // FNV-1a
+        auto mix = [&hash](uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 16777619u;
+            }
+        };
+        mix(static_cast<uint32_t>(sizeof(VertexType)));
+        for (const auto& attribute : attributes) {
+            mix(attribute.location);
+            mix(static_cast<uint32_t>(attribute.format));
+            mix(attribute.offset);
+        }
+        return hash;
+    }
+
+    // GPU 버퍼에 들어가는 바이트 그대로의 해시. write가 헤더에 넣고 load가 기대값과 비교한다.
+    template<typename VertexType, typename IndexType>
+    static uint64_t contentHash(const std::vector<VertexType>& vertices, const std::vector<IndexType>& indices) {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        mix(vertices.data(), vertices.size() * sizeof(VertexType));
+        mix(indices.data(), indices.size() * sizeof(IndexType));
+        return hash;
+    }
+
+    // externalMemoryHostEnabled는 디바이스를 만들 때 VK_EXT_external_memory_host를 켰는지
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, bool externalMemoryHostEnabled) {
+        this->device = device;
+        getHostPointerProperties = nullptr;
+
+        if (externalMemoryHostEnabled) {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+            hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 properties{};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &hostProperties;
+            vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+            importAlignment = hostProperties.minImportedHostPointerAlignment;
+            if (importAlignment != 0 && payloadAlignment % importAlignment == 0) {
+                getHostPointerProperties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+                    vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT"));
+            }
+        }
+    }
+
+    // path의 파일을 MeshBuffer로 올린다. 파일이 없거나 Vertex 구조체가 바뀌었거나 깨졌으면 false
+    // expectedContentHash가 0이 아니면 파일의 contentHash가 같을 때만 쓴다. (메시 데이터가 바뀌었으면 false)
+    // 복사는 전송 큐에 제출만 하고 기다리지 않는다. 매핑은 releaseSource가 복사 완료를 확인한 뒤에 닫는다.
+    template<typename VertexType>
+    bool load(const std::string& path, MeshBuffer& meshBuffer, GpuAllocator& allocator, TransferQueue& transferQueue, StagingRing& stagingRing,
+        uint64_t expectedContentHash = 0) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (!open(path, sizeof(VertexType), layoutHash<VertexType>(), expectedContentHash)) {
+            return false;
+        }
+
+        const char* base = static_cast<const char*>(file.data());
+        VkIndexType indexType = static_cast<VkIndexType>(header.indexType);
+        const char* method = "external memory host";
+
+        if (!uploadFromImport(meshBuffer, allocator, transferQueue)) {
+            VkDeviceSize indexOffset = (header.vertexBytes + 3) & ~VkDeviceSize(3);
+            VkDeviceSize totalBytes = indexOffset + header.indexBytes;
+
+            StagingRing::Slice slice;
+            if (totalBytes <= stagingRing.bytesPerFrame()) {
+                slice = stagingRing.allocate(totalBytes, StagingRing::Usage::CopySource);
+            }
+
+            if (slice.isValid()) {
+                char* destination = static_cast<char*>(slice.data);
+                std::memcpy(destination, base + header.vertexOffset, static_cast<size_t>(header.vertexBytes));
+                std::memcpy(destination + indexOffset, base + header.indexOffset, static_cast<size_t>(header.indexBytes));
+                stagingRing.flush();
+
+                uploadValue = meshBuffer.uploadFrom(allocator, transferQueue, slice.buffer,
+                    slice.offset, header.vertexBytes, slice.offset + indexOffset, header.indexCount, indexType);
+                stagingRing.holdForTransfer(uploadValue);
+                method = "staging ring";
+            }
+            else {
+                meshBuffer.upload(allocator, transferQueue, base + header.vertexOffset, header.vertexBytes,
+                    base + header.indexOffset, header.indexCount, indexType);
+                method = "staging buffer";
+            }
+            file.close(); // memcpy가 끝났으니 매핑은 더 이상 필요 없다.
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        std::cout << "mesh cache: loaded " << header.vertexCount << " vertices, " << header.indexCount << " indices from "
+            << path << " via " << method << " in " << elapsedMs << " ms\n";
+        return true;
+    }
+
+    // 전송 큐의 복사가 끝났으면 import한 메모리와 파일 매핑을 정리한다. 업로드를 기다린 프레임이 끝난 뒤에 FramePacer.deferDestroy로 부른다.
+    void releaseSource(const TransferQueue& transferQueue) {
+        if (importedBuffer != VK_NULL_HANDLE && transferQueue.isComplete(uploadValue)) {
+            destroyImport();
+            file.close();
+        }
+    }
+
+    // 디바이스가 idle인 상태에서 불러야 한다.
+    void destroy() {
+        destroyImport();
+        file.close();
+    }
+
+    // GPU 버퍼에 들어가는 모양 그대로 파일에 쓴다. 임시 파일에 다 쓴 뒤 rename으로 교체한다.
+    template<typename VertexType, typename IndexType>
+    static bool write(const std::string& path, const std::vector<VertexType>& vertices, const std::vector<IndexType>& indices) {
+        static_assert(std::is_same<IndexType, uint16_t>::value || std::is_same<IndexType, uint32_t>::value,
+            "index type must be uint16_t or uint32_t");
+
+        Header header{};
+        header.magic = magic;
+        header.version = version;
+        header.headerSize = sizeof(Header);
+        header.layoutHash = layoutHash<VertexType>();
+        header.vertexStride = sizeof(VertexType);
+        header.vertexCount = static_cast<uint32_t>(vertices.size());
+        header.indexType = sizeof(IndexType) == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        header.indexCount = static_cast<uint32_t>(indices.size());
+        header.vertexBytes = vertices.size() * sizeof(VertexType);
+        header.indexBytes = indices.size() * sizeof(IndexType);
+        header.contentHash = contentHash(vertices, indices);
+        header.vertexOffset = alignUp(sizeof(Header));
+        header.indexOffset = header.vertexOffset + alignUp(header.vertexBytes);
+        uint64_t fileSize = header.indexOffset + alignUp(header.indexBytes);
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                std::cerr << "mesh cache: failed to open " << tempPath << "\n";
+                return false;
+            }
+
+            std::vector<char> padding(payloadAlignment, 0);
+            auto pad = [&](uint64_t position, uint64_t target) {
+                out.write(padding.data(), static_cast<std::streamsize>(target - position));
+            };
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            pad(sizeof(Header), header.vertexOffset);
+            out.write(reinterpret_cast<const char*>(vertices.data()), static_cast<std::streamsize>(header.vertexBytes));
+            pad(header.vertexOffset + header.vertexBytes, header.indexOffset);
+            out.write(reinterpret_cast<const char*>(indices.data()), static_cast<std::streamsize>(header.indexBytes));
+            pad(header.indexOffset + header.indexBytes, fileSize); // import할 때 마지막 페이지까지 파일 안에 있어야 한다.
+
+            if (!out.good()) {
+                std::cerr << "mesh cache: failed to write " << tempPath << "\n";
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::cerr << "mesh cache: failed to replace " << path << ": " << error.message() << "\n";
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+
+        std::cout << "mesh cache: wrote " << fileSize << " bytes to " << path << "\n";
+        return true;
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    PFN_vkGetMemoryHostPointerPropertiesEXT getHostPointerProperties = nullptr; // nullptr이면 import를 쓰지 않는다.
+    VkDeviceSize importAlignment = 0;
+
+    MappedFile file;
+    Header header{};
+
+    VkBuffer importedBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory importedMemory = VK_NULL_HANDLE;
+    uint64_t uploadValue = 0;
+
+    static uint64_t alignUp(uint64_t value) {
+        return (value + payloadAlignment - 1) & ~(payloadAlignment - 1);
+    }
+
+    bool open(const std::string& path, uint32_t expectedStride, uint32_t expectedLayoutHash, uint64_t expectedContentHash) {
+        std::error_code error;
+        if (!std::filesystem::exists(path, error)) {
+            return false; // 첫 실행이면 없는게 정상이다.
+        }
+
+        try {
+            file.open(path);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << "mesh cache: " << e.what() << "\n";
+            return false;
+        }
+
+        const char* reason = validate(expectedStride, expectedLayoutHash, expectedContentHash);
+        if (reason != nullptr) {
+            std::cerr << "mesh cache: ignoring " << path << ": " << reason << "\n";
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // 문제가 없으면 nullptr, 있으면 이유
+    const char* validate(uint32_t expectedStride, uint32_t expectedLayoutHash, uint64_t expectedContentHash) {
+        uint64_t fileSize = file.size();
+        if (fileSize < sizeof(Header)) {
+            return "file is too small";
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (header.magic != magic || header.headerSize != sizeof(Header)) {
+            return "not a mesh cache file";
+        }
+        if (header.version != version) {
+            return "different format version";
+        }
+        if (header.vertexStride != expectedStride || header.layoutHash != expectedLayoutHash) {
+            return "vertex layout changed";
+        }
+        if (expectedContentHash != 0 && header.contentHash != expectedContentHash) {
+            return "mesh data changed";
+        }
+
+        uint64_t indexSize = header.indexType == VK_INDEX_TYPE_UINT16 ? 2 : (header.indexType == VK_INDEX_TYPE_UINT32 ? 4 : 0);
+        if (indexSize == 0 || header.vertexCount == 0 || header.indexCount == 0
+            || header.vertexBytes != uint64_t(header.vertexCount) * header.vertexStride
+            || header.indexBytes != uint64_t(header.indexCount) * indexSize) {
+            return "inconsistent sizes";
+        }
+
+        // 오버플로우가 나지 않도록 더하지 않고 빼서 비교한다.
+        if (header.vertexOffset % payloadAlignment != 0 || header.indexOffset % payloadAlignment != 0
+            || header.vertexOffset < sizeof(Header) || header.indexOffset < header.vertexOffset || header.indexOffset > fileSize
+            || header.vertexBytes > header.indexOffset - header.vertexOffset
+            || alignUp(header.indexBytes) > fileSize - header.indexOffset) {
+            return "payload out of bounds";
+        }
+        return nullptr;
+    }
+
+    // 매핑된 파일의 정점~인덱스 구간을 통째로 import해서 복사 원본으로 쓴다.
+    // GpuAllocator의 블록에서 잘라 쓸 수 없는 외부 메모리라서 여기서 직접 vkAllocateMemory한다.
+    bool uploadFromImport(MeshBuffer& meshBuffer, GpuAllocator& allocator, TransferQueue& transferQueue) {
+        if (getHostPointerProperties == nullptr) {
+            return false;
+        }
+
+        const char* hostPointer = static_cast<const char*>(file.data()) + header.vertexOffset;
+        VkDeviceSize importSize = header.indexOffset + alignUp(header.indexBytes) - header.vertexOffset;
+        // 매핑의 시작은 페이지 정렬이고 구간은 4096의 배수라서 importAlignment(4096의 약수)도 만족한다.
+
+        VkMemoryHostPointerPropertiesEXT pointerProperties{};
+        pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+        if (getHostPointerProperties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, hostPointer, &pointerProperties) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkExternalMemoryBufferCreateInfo externalInfo{};
+        externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+        externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = &externalInfo;
+        bufferInfo.size = importSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &importedBuffer) != VK_SUCCESS) {
+            importedBuffer = VK_NULL_HANDLE;
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, importedBuffer, &requirements);
+        uint32_t typeBits = requirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+        if (typeBits == 0 || requirements.size > importSize) {
+            // import한 메모리는 파일 구간 크기(importSize)보다 키울 수 없으니 버퍼가 더 많이 요구하면 바인딩할 수 없다.
+            destroyImport();
+            return false;
+        }
+        uint32_t memoryType = 0;
+        while ((typeBits & (1u << memoryType)) == 0) {
+            memoryType++;
+        }
+
+        VkImportMemoryHostPointerInfoEXT importInfo{};
+        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+        importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        importInfo.pHostPointer = const_cast<char*>(hostPointer); // GPU는 복사 원본으로 읽기만 한다.
+
+        VkMemoryAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.pNext = &importInfo;
+        allocateInfo.allocationSize = importSize;
+        allocateInfo.memoryTypeIndex = memoryType;
+        if (vkAllocateMemory(device, &allocateInfo, nullptr, &importedMemory) != VK_SUCCESS) {
+            importedMemory = VK_NULL_HANDLE;
+            destroyImport();
+            return false; // 읽기 전용 매핑의 pinning을 거부하는 드라이버도 있다.
+        }
+        if (vkBindBufferMemory(device, importedBuffer, importedMemory, 0) != VK_SUCCESS) {
+            destroyImport();
+            return false;
+        }
+
+        uploadValue = meshBuffer.uploadFrom(allocator, transferQueue, importedBuffer,
+            0, header.vertexBytes, header.indexOffset - header.vertexOffset, header.indexCount, static_cast<VkIndexType>(header.indexType));
+        return true;
+    }
+
+    void destroyImport() {
+        if (importedBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, importedBuffer, nullptr);
+            importedBuffer = VK_NULL_HANDLE;
+        }
+        if (importedMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(device, importedMemory, nullptr);
+            importedMemory = VK_NULL_HANDLE;
+        }
+    }
+};
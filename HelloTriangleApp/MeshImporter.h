@@ -0,0 +1,1151 @@
+﻿#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <future>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+#include "WorkerPool.h"
+
+
+// OBJ, glTF 2.0(.gltf, .glb) 메시 임포터
+//
+// 파일은 MappedFile로 매핑해서 읽기 때문에 파일 크기만큼 힙에 복사하지 않는다.
+//      OBJ: 줄 경계에 맞춰 파일을 여러 조각으로 나누고 조각마다 다른 스레드에서 파싱한 뒤 인덱스를 이어 붙인다.
+//           음수 인덱스(-1 = 바로 앞 정점)는 조각 안에서의 상대 위치로 적어뒀다가 조각의 시작 정점 번호가 정해지면 고친다.
+//      glTF: JSON은 작으니 한 스레드에서 읽고, 데이터가 큰 primitive들을 스레드마다 나눠서 변환한다.
+//            노드 계층의 변환(matrix 또는 TRS)은 위치에 미리 곱해둔다.
+//
+// 결과는 위치, 색, 인덱스(삼각형 리스트)만 남긴다. Vertex로 압축하는 것은 부르는 쪽의 몫이다.
+namespace MeshImporter {
+
+struct ImportedMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors; // positions와 같은 개수. 파일에 색이 없으면 흰색
+    std::vector<uint32_t> indices;
+    uint64_t sourceBytes = 0; // 읽은 파일 크기의 합 (처리량을 출력할 때 쓴다)
+};
+
+// 숫자 파싱
+//
+// strtod는 로캘을 확인하고 errno를 건드리느라 느리다. 대부분의 메시 파일의 숫자는 19자리 이하의 10진수라서
+// 정수 가수와 10의 거듭제곱으로 나눠 읽은 뒤, 둘 다 double로 정확히 표현되는 범위면 곱셈/나눗셈 한 번으로 끝낸다.
+// (Clinger의 fast path: 가수 <= 2^53, |지수| <= 22면 결과가 정확히 반올림된다)
+// 그 밖의 경우(아주 긴 숫자, 큰 지수, inf/nan)만 strtod로 넘긴다.
+namespace detail {
+
+// 8자리 숫자를 한 번에 읽는다. (SWAR: 64비트 레지스터 하나를 8바이트 벡터처럼 쓴다. 리틀 엔디안 가정)
+inline bool isEightDigits(uint64_t value) {
+    return (((value & 0xF0F0F0F0F0F0F0F0ull) | (((value + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+inline uint32_t parseEightDigits(uint64_t value) {
+    value -= 0x3030303030303030ull;
+    value = (value * 10) + (value >> 8); // 이웃한 두 자리씩 합친다.
+    value = (((value & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+        + (((value >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return static_cast<uint32_t>(value);
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// [p, end)에서 float 하나를 읽고 다음 위치를 돌려준다. 숫자가 아니면 nullptr
+inline const char* parseFloat(const char* p, const char* end, float& out) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+    int digits = 0; // 가수에 들어간 유효 숫자 수 (앞의 0은 세지 않는다)
+    bool anyDigit = false;
+
+    auto readDigits = [&](bool fraction) {
+        while (p < end) {
+            if (digits <= 11 && end - p >= 8) {
+                uint64_t chunk;
+                std::memcpy(&chunk, p, 8);
+                if (isEightDigits(chunk)) {
+                    mantissa = mantissa * 100000000ull + parseEightDigits(chunk);
+                    digits += mantissa != 0 ? 8 : 0;
+                    exponent -= fraction ? 8 : 0;
+                    anyDigit = true;
+                    p += 8;
+                    continue;
+                }
+            }
+            if (!isDigit(*p)) {
+                break;
+            }
+            anyDigit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0 ? 1 : 0;
+                exponent -= fraction ? 1 : 0;
+            }
+            else if (!fraction) {
+                exponent++; // 더 이상 가수에 못 넣는 정수 자리는 지수로 보낸다.
+            }
+            else if (*p != '0') {
+                digits = 20; // 잘려나가는 0이 아닌 소수 자리가 있으면 fast path를 쓰지 않는다.
+            }
+            p++;
+        }
+    };
+
+    readDigits(false);
+    if (p < end && *p == '.') {
+        p++;
+        readDigits(true);
+    }
+    if (!anyDigit) {
+        // inf, nan 등은 거의 안 나오니 느린 길로 보낸다.
+        char buffer[64];
+        size_t length = std::min<size_t>(static_cast<size_t>(end - start), sizeof(buffer) - 1);
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        char* parsedEnd = nullptr;
+        double value = std::strtod(buffer, &parsedEnd);
+        if (parsedEnd == buffer) {
+            return nullptr;
+        }
+        out = static_cast<float>(value);
+        return start + (parsedEnd - buffer);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* exponentStart = p;
+        p++;
+        bool exponentNegative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponentNegative = *p == '-';
+            p++;
+        }
+        if (p < end && isDigit(*p)) {
+            int64_t value = 0;
+            while (p < end && isDigit(*p)) {
+                if (value < 100000) {
+                    value = value * 10 + (*p - '0');
+                }
+                p++;
+            }
+            exponent += exponentNegative ? -value : value;
+        }
+        else {
+            p = exponentStart; // "1e" 같은 경우 e는 숫자의 일부가 아니다.
+        }
+    }
+
+    double value;
+    if (digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+    }
+    else {
+        char buffer[128];
+        size_t length = static_cast<size_t>(p - start);
+        if (length >= sizeof(buffer)) {
+            std::string copy(start, p);
+            value = std::strtod(copy.c_str(), nullptr);
+        }
+        else {
+            std::memcpy(buffer, start, length);
+            buffer[length] = '\0';
+            value = std::strtod(buffer, nullptr);
+        }
+        out = static_cast<float>(value);
+        return p;
+    }
+
+    out = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+inline const char* parseInt(const char* p, const char* end, int64_t& out) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= end || !isDigit(*p)) {
+        return nullptr;
+    }
+    int64_t value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+inline const char* nextLine(const char* p, const char* end) {
+    const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p)); // 대부분의 libc에서 SIMD로 구현돼 있다.
+    return newline ? static_cast<const char*>(newline) + 1 : end;
+}
+
+inline std::string lowerExtension(const std::string& path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    return extension;
+}
+
+} // namespace detail
+
+
+// OBJ
+namespace detail {
+
+// 조각 안에서 음수 인덱스로 가리킨 정점은 조각의 첫 정점 기준 상대 번호로 적어둔다.
+// 상대 번호는 앞 조각을 가리키면 음수가 될 수 있어서 아래 31비트에 2의 보수로 넣는다.
+const uint32_t relativeIndexBit = 0x80000000u;
+const size_t maxObjVertices = 1u << 30;
+
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    bool hasColors = false;
+    std::vector<uint32_t> indices;
+    size_t lineCount = 0;
+    size_t errorLine = 0; // 조각 안에서의 줄 번호
+    std::string error;
+};
+
+inline void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk) {
+    std::vector<uint32_t> polygon;
+    const glm::vec3 white(1.0f, 1.0f, 1.0f);
+
+    for (const char* line = begin; line < end; line = nextLine(line, end)) {
+        chunk.lineCount++;
+        const char* p = skipSpaces(line, end);
+        if (p + 1 >= end || (p[1] != ' ' && p[1] != '\t')) {
+            continue; // 빈 줄, 주석, vt, vn, usemtl 등은 넘어간다.
+        }
+
+        if (*p == 'v') {
+            glm::vec3 position;
+            glm::vec3 color = white;
+            p = skipSpaces(p + 1, end);
+            for (int axis = 0; axis < 3 && p; axis++) {
+                p = parseFloat(p, end, position[axis]);
+                p = p ? skipSpaces(p, end) : p;
+            }
+            if (!p) {
+                chunk.error = "malformed vertex";
+                chunk.errorLine = chunk.lineCount;
+                return;
+            }
+
+            // 일부 툴은 "v x y z r g b"로 정점 색을 넣는다. "v x y z w"면 색이 없는 것으로 본다.
+            if (p < end && *p != '\n' && *p != '#') {
+                for (int channel = 0; channel < 3 && p; channel++) {
+                    p = parseFloat(p, end, color[channel]);
+                    p = p ? skipSpaces(p, end) : p;
+                }
+                if (p) {
+                    chunk.hasColors = true;
+                }
+                else {
+                    color = white;
+                }
+            }
+
+            chunk.positions.push_back(position);
+            chunk.colors.push_back(color);
+        }
+        else if (*p == 'f') {
+            polygon.clear();
+            p = skipSpaces(p + 1, end);
+            while (p < end && *p != '\n' && *p != '#') {
+                int64_t index;
+                p = parseInt(p, end, index);
+                if (!p || index == 0) {
+                    chunk.error = "malformed face";
+                    chunk.errorLine = chunk.lineCount;
+                    return;
+                }
+
+                if (index > 0) {
+                    polygon.push_back(static_cast<uint32_t>(std::min<int64_t>(index - 1, relativeIndexBit - 1)));
+                }
+                else {
+                    int64_t relative = static_cast<int64_t>(chunk.positions.size()) + index;
+                    polygon.push_back(relativeIndexBit | (static_cast<uint32_t>(relative) & ~relativeIndexBit));
+                }
+
+                // v/vt/vn 중 위치만 쓴다.
+                while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+                    p++;
+                }
+                p = skipSpaces(p, end);
+            }
+
+            // 볼록 다각형이라고 보고 fan으로 삼각형을 만든다.
+            for (size_t i = 2; i < polygon.size(); i++) {
+                chunk.indices.push_back(polygon[0]);
+                chunk.indices.push_back(polygon[i - 1]);
+                chunk.indices.push_back(polygon[i]);
+            }
+        }
+    }
+}
+
+// tasks[i]()를 pool에서 모두 실행하고 끝날 때까지 기다린다. 작업 중에 던진 예외는 여기서 다시 던져진다.
+template<typename Task>
+void runParallel(uint32_t threadCount, size_t taskCount, Task task) {
+    if (taskCount <= 1 || threadCount <= 1) {
+        for (size_t i = 0; i < taskCount; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    WorkerPool pool;
+    pool.start(static_cast<uint32_t>(std::min<size_t>(threadCount, taskCount)));
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < taskCount; i++) {
+        results.push_back(pool.submit([&task, i] { task(i); }));
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+}
+
+inline ImportedMesh importObj(const std::string& path, uint32_t threadCount) {
+    MappedFile file(path);
+    const char* data = static_cast<const char*>(file.data());
+    const char* end = data + file.size();
+
+    // 조각은 스레드 수의 4배쯤 만들어서 조각마다 걸리는 시간이 달라도 스레드가 놀지 않게 한다.
+    const size_t minimumChunkBytes = 1 << 20;
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(file.size() / minimumChunkBytes, size_t(threadCount) * 4));
+    size_t chunkBytes = file.size() / chunkCount + 1;
+
+    std::vector<const char*> boundaries = { data };
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* split = std::max(boundaries.back(), data + std::min(file.size(), i * chunkBytes));
+        boundaries.push_back(nextLine(split, end)); // 줄 중간에서 자르지 않는다.
+    }
+    boundaries.push_back(end);
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    runParallel(threadCount, chunkCount, [&](size_t i) {
+        parseObjChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+    });
+
+    // 조각들의 시작 정점/인덱스 번호 (prefix sum)
+    std::vector<size_t> positionBase(chunkCount + 1, 0);
+    std::vector<size_t> indexBase(chunkCount + 1, 0);
+    bool hasColors = false;
+    size_t lineBase = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!chunks[i].error.empty()) {
+            throw std::runtime_error("obj: " + chunks[i].error + " at line " + std::to_string(lineBase + chunks[i].errorLine) + " of " + path);
+        }
+        lineBase += chunks[i].lineCount;
+        positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+        indexBase[i + 1] = indexBase[i] + chunks[i].indices.size();
+        hasColors = hasColors || chunks[i].hasColors;
+    }
+    if (positionBase[chunkCount] >= maxObjVertices) {
+        throw std::runtime_error("obj: too many vertices in " + path);
+    }
+
+    ImportedMesh mesh;
+    mesh.sourceBytes = file.size();
+    mesh.positions.resize(positionBase[chunkCount]);
+    mesh.colors.resize(positionBase[chunkCount], glm::vec3(1.0f, 1.0f, 1.0f));
+    mesh.indices.resize(indexBase[chunkCount]);
+    const int64_t vertexCount = static_cast<int64_t>(positionBase[chunkCount]);
+
+    // 이어 붙이는 것도 조각마다 나눠서 한다.
+    std::vector<char> outOfRange(chunkCount, 0);
+    runParallel(threadCount, chunkCount, [&](size_t i) {
+        ObjChunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + positionBase[i]);
+        if (hasColors) {
+            std::copy(chunk.colors.begin(), chunk.colors.end(), mesh.colors.begin() + positionBase[i]);
+        }
+
+        uint32_t* destination = mesh.indices.data() + indexBase[i];
+        const int64_t base = static_cast<int64_t>(positionBase[i]);
+        for (size_t k = 0; k < chunk.indices.size(); k++) {
+            uint32_t index = chunk.indices[k];
+            int64_t absolute = index;
+            if (index & relativeIndexBit) {
+                int32_t relative = static_cast<int32_t>(index << 1) >> 1; // 31비트 2의 보수를 부호 확장
+                absolute = base + relative;
+            }
+            if (absolute < 0 || absolute >= vertexCount) {
+                outOfRange[i] = 1;
+                absolute = 0;
+            }
+            destination[k] = static_cast<uint32_t>(absolute);
+        }
+        chunk = ObjChunk(); // 다 옮겼으면 메모리를 바로 돌려준다.
+    });
+
+    if (std::find(outOfRange.begin(), outOfRange.end(), 1) != outOfRange.end()) {
+        throw std::runtime_error("obj: face index out of range in " + path);
+    }
+    return mesh;
+}
+
+} // namespace detail
+
+
+// glTF
+namespace detail {
+
+// glTF에 필요한 만큼만 구현한 JSON DOM
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue* find(const char* key) const {
+        for (const auto& member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double numberOr(const char* key, double fallback) const {
+        const JsonValue* value = find(key);
+        return value && value->type == Type::Number ? value->number : fallback;
+    }
+
+    int64_t indexOr(const char* key, int64_t fallback) const {
+        return static_cast<int64_t>(numberOr(key, static_cast<double>(fallback)));
+    }
+
+    // key의 배열에서 index번째 원소. 없으면 glTF 파일이 잘못된 것이라 예외를 던진다.
+    const JsonValue& element(const char* key, int64_t index) const {
+        const JsonValue* list = find(key);
+        if (!list || list->type != Type::Array || index < 0 || index >= static_cast<int64_t>(list->array.size())) {
+            throw std::runtime_error(std::string("gltf: invalid reference to ") + key + "[" + std::to_string(index) + "]");
+        }
+        return list->array[static_cast<size_t>(index)];
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* begin, const char* end) : p(begin), end(end) {}
+
+    JsonValue parse() {
+        JsonValue value = parseValue(0);
+        skipWhitespace();
+        if (p != end) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    [[noreturn]] void fail(const char* reason) {
+        throw std::runtime_error(std::string("gltf: invalid JSON: ") + reason);
+    }
+
+    void skipWhitespace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    void expect(char c) {
+        skipWhitespace();
+        if (p >= end || *p != c) {
+            fail("unexpected character");
+        }
+        p++;
+    }
+
+    bool consume(char c) {
+        skipWhitespace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue parseValue(int depth) {
+        if (depth > 64) {
+            fail("nesting too deep");
+        }
+        skipWhitespace();
+        if (p >= end) {
+            fail("unexpected end");
+        }
+
+        JsonValue value;
+        if (*p == '{') {
+            p++;
+            value.type = JsonValue::Type::Object;
+            if (consume('}')) {
+                return value;
+            }
+            do {
+                skipWhitespace();
+                std::string key = parseString();
+                expect(':');
+                value.object.emplace_back(std::move(key), parseValue(depth + 1));
+            } while (consume(','));
+            expect('}');
+        }
+        else if (*p == '[') {
+            p++;
+            value.type = JsonValue::Type::Array;
+            if (consume(']')) {
+                return value;
+            }
+            do {
+                value.array.push_back(parseValue(depth + 1));
+            } while (consume(','));
+            expect(']');
+        }
+        else if (*p == '"') {
+            value.type = JsonValue::Type::String;
+            value.string = parseString();
+        }
+        else if (matchWord("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+        }
+        else if (matchWord("false")) {
+            value.type = JsonValue::Type::Bool;
+        }
+        else if (!matchWord("null")) {
+            // 인덱스나 바이트 오프셋은 float로는 정밀도가 모자라서 정수면 정수로 읽는다.
+            int64_t integer = 0;
+            const char* integerEnd = parseInt(p, end, integer);
+            float number;
+            const char* numberEnd = parseFloat(p, end, number);
+            if (!numberEnd) {
+                fail("unexpected token");
+            }
+            value.type = JsonValue::Type::Number;
+            value.number = integerEnd == numberEnd ? static_cast<double>(integer) : number;
+            p = numberEnd;
+        }
+        return value;
+    }
+
+    bool matchWord(const char* word) {
+        size_t length = std::strlen(word);
+        if (static_cast<size_t>(end - p) >= length && std::memcmp(p, word, length) == 0) {
+            p += length;
+            return true;
+        }
+        return false;
+    }
+
+    std::string parseString() {
+        if (p >= end || *p != '"') {
+            fail("expected string");
+        }
+        p++;
+
+        std::string result;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                result.push_back(*p++);
+                continue;
+            }
+            if (++p >= end) {
+                fail("unterminated escape");
+            }
+            char escaped = *p++;
+            switch (escaped) {
+            case 'b': result.push_back('\b'); break;
+            case 'f': result.push_back('\f'); break;
+            case 'n': result.push_back('\n'); break;
+            case 'r': result.push_back('\r'); break;
+            case 't': result.push_back('\t'); break;
+            case 'u': appendUtf8(result, parseCodePoint()); break;
+            default: result.push_back(escaped); break; // \" \\ \/
+            }
+        }
+        if (p >= end) {
+            fail("unterminated string");
+        }
+        p++;
+        return result;
+    }
+
+    uint32_t parseHex4() {
+        if (end - p < 4) {
+            fail("bad unicode escape");
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= static_cast<uint32_t>(c - '0');
+            }
+            else if (c >= 'a' && c <= 'f') {
+                value |= static_cast<uint32_t>(c - 'a' + 10);
+            }
+            else if (c >= 'A' && c <= 'F') {
+                value |= static_cast<uint32_t>(c - 'A' + 10);
+            }
+            else {
+                fail("bad unicode escape");
+            }
+        }
+        return value;
+    }
+
+    uint32_t parseCodePoint() {
+        uint32_t value = parseHex4();
+        if (value >= 0xD800 && value <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            p += 2; // 서로게이트 쌍
+            uint32_t low = parseHex4();
+            value = 0x10000 + ((value - 0xD800) << 10) + (low - 0xDC00);
+        }
+        return value;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+};
+
+inline std::vector<char> decodeBase64(const std::string& text, size_t start) {
+    auto decode = [](char c) -> int {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+' || c == '-') return 62;
+        if (c == '/' || c == '_') return 63;
+        return -1;
+    };
+
+    std::vector<char> out;
+    out.reserve((text.size() - start) / 4 * 3);
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (size_t i = start; i < text.size() && text[i] != '='; i++) {
+        int value = decode(text[i]);
+        if (value < 0) {
+            throw std::runtime_error("gltf: invalid base64 data uri");
+        }
+        bits = (bits << 6) | static_cast<uint32_t>(value);
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            out.push_back(static_cast<char>((bits >> bitCount) & 0xFF));
+        }
+    }
+    return out;
+}
+
+inline std::string percentDecode(const std::string& uri) {
+    std::string out;
+    for (size_t i = 0; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            out.push_back(static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        }
+        else {
+            out.push_back(uri[i]);
+        }
+    }
+    return out;
+}
+
+struct BufferData {
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// 열 우선(column-major) 4x4 행렬. glTF의 matrix와 같은 순서
+struct Matrix {
+    double m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    Matrix operator*(const Matrix& other) const {
+        Matrix result;
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                double sum = 0.0;
+                for (int k = 0; k < 4; k++) {
+                    sum += m[k * 4 + row] * other.m[column * 4 + k];
+                }
+                result.m[column * 4 + row] = sum;
+            }
+        }
+        return result;
+    }
+
+    glm::vec3 transformPoint(const glm::vec3& point) const {
+        return glm::vec3(
+            static_cast<float>(m[0] * point.x + m[4] * point.y + m[8] * point.z + m[12]),
+            static_cast<float>(m[1] * point.x + m[5] * point.y + m[9] * point.z + m[13]),
+            static_cast<float>(m[2] * point.x + m[6] * point.y + m[10] * point.z + m[14]));
+    }
+
+    // 노드의 matrix, 없으면 T * R * S
+    static Matrix fromNode(const JsonValue& node) {
+        Matrix result;
+        if (const JsonValue* matrix = node.find("matrix")) {
+            for (size_t i = 0; i < 16 && i < matrix->array.size(); i++) {
+                result.m[i] = matrix->array[i].number;
+            }
+            return result;
+        }
+
+        auto read = [&node](const char* key, size_t count, double* out) {
+            const JsonValue* value = node.find(key);
+            for (size_t i = 0; value && i < count && i < value->array.size(); i++) {
+                out[i] = value->array[i].number;
+            }
+        };
+        double t[3] = { 0, 0, 0 };
+        double r[4] = { 0, 0, 0, 1 }; // 쿼터니언 x, y, z, w
+        double s[3] = { 1, 1, 1 };
+        read("translation", 3, t);
+        read("rotation", 4, r);
+        read("scale", 3, s);
+
+        double x = r[0], y = r[1], z = r[2], w = r[3];
+        double rotation[9] = {
+            1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+            2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+            2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y),
+        };
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                result.m[column * 4 + row] = rotation[column * 3 + row] * s[column];
+            }
+        }
+        result.m[12] = t[0];
+        result.m[13] = t[1];
+        result.m[14] = t[2];
+        return result;
+    }
+};
+
+// accessor 하나가 가리키는 데이터. 범위 검사는 만들 때 끝낸다.
+struct AccessorView {
+    const char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+    bool normalized = false;
+
+    float component(size_t element, uint32_t index) const {
+        const char* p = data + element * stride;
+        switch (componentType) {
+        case 5120: { int8_t v; std::memcpy(&v, p + index, 1); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+        case 5121: { uint8_t v; std::memcpy(&v, p + index, 1); return normalized ? v / 255.0f : v; }
+        case 5122: { int16_t v; std::memcpy(&v, p + index * 2, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+        case 5123: { uint16_t v; std::memcpy(&v, p + index * 2, 2); return normalized ? v / 65535.0f : v; }
+        case 5125: { uint32_t v; std::memcpy(&v, p + index * 4, 4); return static_cast<float>(v); }
+        default: { float v; std::memcpy(&v, p + index * 4, 4); return v; }
+        }
+    }
+
+    uint32_t index(size_t element) const {
+        const char* p = data + element * stride;
+        switch (componentType) {
+        case 5121: { uint8_t v; std::memcpy(&v, p, 1); return v; }
+        case 5123: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+        default: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+        }
+    }
+};
+
+inline AccessorView accessorView(const JsonValue& document, const std::vector<BufferData>& buffers, int64_t accessorIndex) {
+    const JsonValue& accessor = document.element("accessors", accessorIndex);
+    if (accessor.find("sparse")) {
+        throw std::runtime_error("gltf: sparse accessors are not supported");
+    }
+    if (!accessor.find("bufferView")) {
+        throw std::runtime_error("gltf: accessors without a bufferView are not supported");
+    }
+
+    AccessorView view;
+    view.count = static_cast<size_t>(accessor.indexOr("count", 0));
+    view.componentType = static_cast<uint32_t>(accessor.indexOr("componentType", 0));
+    const JsonValue* normalized = accessor.find("normalized");
+    view.normalized = normalized && normalized->boolean;
+
+    const JsonValue* type = accessor.find("type");
+    std::string typeName = type ? type->string : "";
+    view.components = typeName == "SCALAR" ? 1 : typeName == "VEC2" ? 2 : typeName == "VEC3" ? 3 : typeName == "VEC4" ? 4 : 0;
+
+    size_t componentSize = 0;
+    switch (view.componentType) {
+    case 5120: case 5121: componentSize = 1; break;
+    case 5122: case 5123: componentSize = 2; break;
+    case 5125: case 5126: componentSize = 4; break;
+    }
+    if (view.components == 0 || componentSize == 0) {
+        throw std::runtime_error("gltf: unsupported accessor type " + typeName);
+    }
+
+    const JsonValue& bufferView = document.element("bufferViews", accessor.indexOr("bufferView", -1));
+    const BufferData& buffer = buffers.at(static_cast<size_t>(bufferView.indexOr("buffer", -1)));
+    size_t viewOffset = static_cast<size_t>(bufferView.indexOr("byteOffset", 0));
+    size_t viewLength = static_cast<size_t>(bufferView.indexOr("byteLength", 0));
+    size_t elementSize = componentSize * view.components;
+    view.stride = static_cast<size_t>(bufferView.indexOr("byteStride", 0));
+    if (view.stride == 0) {
+        view.stride = elementSize;
+    }
+
+    size_t accessorOffset = static_cast<size_t>(accessor.indexOr("byteOffset", 0));
+    if (viewOffset > buffer.size || viewLength > buffer.size - viewOffset
+        || (view.count > 0 && (accessorOffset > viewLength || elementSize > viewLength - accessorOffset
+            || view.count - 1 > (viewLength - accessorOffset - elementSize) / view.stride))) { // 곱하면 넘칠 수 있어서 나눠서 비교한다.
+        throw std::runtime_error("gltf: accessor " + std::to_string(accessorIndex) + " is out of bounds");
+    }
+
+    view.data = buffer.data + viewOffset + accessorOffset;
+    return view;
+}
+
+// primitive 하나를 어디에 얼마나 쓸지 미리 계산해두고 변환은 스레드마다 나눠서 한다.
+struct DrawItem {
+    const JsonValue* primitive = nullptr;
+    Matrix world;
+    uint32_t mode = 4;
+    size_t vertexCount = 0;
+    size_t sourceIndexCount = 0;
+    size_t vertexBase = 0;
+    size_t indexBase = 0;
+    size_t indexCount = 0; // 삼각형 리스트로 바꾼 뒤의 인덱스 수
+};
+
+inline void collectNode(const JsonValue& document, int64_t nodeIndex, const Matrix& parent, int depth, std::vector<DrawItem>& items) {
+    if (depth > 64) {
+        throw std::runtime_error("gltf: node hierarchy is too deep (cycle?)");
+    }
+    const JsonValue& node = document.element("nodes", nodeIndex);
+    Matrix world = parent * Matrix::fromNode(node);
+
+    if (node.find("mesh")) {
+        const JsonValue& mesh = document.element("meshes", node.indexOr("mesh", -1));
+        if (const JsonValue* primitives = mesh.find("primitives")) {
+            for (const JsonValue& primitive : primitives->array) {
+                DrawItem item;
+                item.primitive = &primitive;
+                item.world = world;
+                items.push_back(item);
+            }
+        }
+    }
+    if (const JsonValue* children = node.find("children")) {
+        for (const JsonValue& child : children->array) {
+            collectNode(document, static_cast<int64_t>(child.number), world, depth + 1, items);
+        }
+    }
+}
+
+inline void convertPrimitive(const JsonValue& document, const std::vector<BufferData>& buffers, const DrawItem& item,
+    ImportedMesh& mesh, bool& outOfRange) {
+    const JsonValue& attributes = *item.primitive->find("attributes");
+    AccessorView positions = accessorView(document, buffers, attributes.indexOr("POSITION", -1));
+    if (positions.components != 3) {
+        throw std::runtime_error("gltf: POSITION must be VEC3");
+    }
+
+    glm::vec3* outPositions = mesh.positions.data() + item.vertexBase;
+    glm::vec3* outColors = mesh.colors.data() + item.vertexBase;
+    for (size_t i = 0; i < item.vertexCount; i++) {
+        glm::vec3 position(positions.component(i, 0), positions.component(i, 1), positions.component(i, 2));
+        outPositions[i] = item.world.transformPoint(position);
+    }
+
+    if (attributes.find("COLOR_0")) {
+        AccessorView colors = accessorView(document, buffers, attributes.indexOr("COLOR_0", -1));
+        for (size_t i = 0; i < item.vertexCount && i < colors.count && colors.components >= 3; i++) {
+            outColors[i] = glm::vec3(colors.component(i, 0), colors.component(i, 1), colors.component(i, 2));
+        }
+    }
+
+    AccessorView indices;
+    bool indexed = item.primitive->find("indices") != nullptr;
+    if (indexed) {
+        indices = accessorView(document, buffers, item.primitive->indexOr("indices", -1));
+    }
+    auto sourceIndex = [&](size_t i) -> uint32_t {
+        uint32_t index = indexed ? indices.index(i) : static_cast<uint32_t>(i);
+        if (index >= item.vertexCount) {
+            outOfRange = true;
+            return 0;
+        }
+        return static_cast<uint32_t>(item.vertexBase) + index;
+    };
+
+    uint32_t* out = mesh.indices.data() + item.indexBase;
+    size_t triangleCount = item.indexCount / 3;
+    for (size_t t = 0; t < triangleCount; t++) {
+        size_t a, b, c;
+        if (item.mode == 5) { // TRIANGLE_STRIP: 홀수 번째 삼각형은 감는 방향을 뒤집어준다.
+            a = t % 2 == 0 ? t : t + 1;
+            b = t % 2 == 0 ? t + 1 : t;
+            c = t + 2;
+        }
+        else if (item.mode == 6) { // TRIANGLE_FAN
+            a = 0;
+            b = t + 1;
+            c = t + 2;
+        }
+        else {
+            a = t * 3;
+            b = t * 3 + 1;
+            c = t * 3 + 2;
+        }
+        out[t * 3 + 0] = sourceIndex(a);
+        out[t * 3 + 1] = sourceIndex(b);
+        out[t * 3 + 2] = sourceIndex(c);
+    }
+}
+
+inline ImportedMesh importGltf(const std::string& path, uint32_t threadCount) {
+    ImportedMesh mesh;
+    MappedFile file(path);
+    mesh.sourceBytes = file.size();
+    const char* data = static_cast<const char*>(file.data());
+
+    const char* jsonBegin = data;
+    const char* jsonEnd = data + file.size();
+    BufferData binaryChunk;
+
+    // .glb: header(magic, version, length) | JSON chunk | BIN chunk
+    if (file.size() >= 12 && std::memcmp(data, "glTF", 4) == 0) {
+        uint32_t header[3];
+        std::memcpy(header, data, sizeof(header));
+        if (header[1] != 2 || header[2] > file.size()) {
+            throw std::runtime_error("gltf: unsupported or truncated glb " + path);
+        }
+
+        size_t offset = 12;
+        bool foundJson = false;
+        while (offset + 8 <= header[2]) {
+            uint32_t chunk[2]; // length, type
+            std::memcpy(chunk, data + offset, sizeof(chunk));
+            offset += 8;
+            if (chunk[0] > header[2] - offset) {
+                throw std::runtime_error("gltf: truncated glb chunk in " + path);
+            }
+            if (chunk[1] == 0x4E4F534A && !foundJson) { // "JSON"
+                jsonBegin = data + offset;
+                jsonEnd = jsonBegin + chunk[0];
+                foundJson = true;
+            }
+            else if (chunk[1] == 0x004E4942 && binaryChunk.data == nullptr) { // "BIN\0"
+                binaryChunk.data = data + offset;
+                binaryChunk.size = chunk[0];
+            }
+            offset += (chunk[0] + 3) & ~3u;
+        }
+        if (!foundJson) {
+            throw std::runtime_error("gltf: glb without a JSON chunk " + path);
+        }
+    }
+
+    // JSON chunk는 공백으로 패딩돼 있다.
+    while (jsonEnd > jsonBegin && (jsonEnd[-1] == ' ' || jsonEnd[-1] == '\0')) {
+        jsonEnd--;
+    }
+    JsonValue document = JsonParser(jsonBegin, jsonEnd).parse();
+
+    if (const JsonValue* required = document.find("extensionsRequired")) {
+        if (!required->array.empty()) {
+            throw std::runtime_error("gltf: required extension " + required->array[0].string + " is not supported");
+        }
+    }
+
+    // buffer: uri가 없으면 glb의 BIN chunk, data: uri면 base64, 아니면 gltf 파일 옆의 파일
+    std::vector<BufferData> buffers;
+    std::vector<std::vector<char>> decodedBuffers;
+    std::vector<MappedFile> externalFiles;
+    if (const JsonValue* bufferList = document.find("buffers")) {
+        // 벡터가 재할당되면 앞에서 받아둔 data() 포인터가 무효가 되므로 미리 잡아둔다.
+        decodedBuffers.reserve(bufferList->array.size());
+        externalFiles.reserve(bufferList->array.size());
+        for (const JsonValue& buffer : bufferList->array) {
+            BufferData bufferData;
+            const JsonValue* uri = buffer.find("uri");
+            if (!uri) {
+                bufferData = binaryChunk;
+            }
+            else if (uri->string.compare(0, 5, "data:") == 0) {
+                size_t comma = uri->string.find(";base64,");
+                if (comma == std::string::npos) {
+                    throw std::runtime_error("gltf: only base64 data uris are supported");
+                }
+                decodedBuffers.push_back(decodeBase64(uri->string, comma + 8));
+                bufferData.data = decodedBuffers.back().data();
+                bufferData.size = decodedBuffers.back().size();
+            }
+            else {
+                std::filesystem::path bufferPath = std::filesystem::path(path).parent_path() / percentDecode(uri->string);
+                externalFiles.emplace_back(bufferPath.string());
+                bufferData.data = static_cast<const char*>(externalFiles.back().data());
+                bufferData.size = externalFiles.back().size();
+                mesh.sourceBytes += bufferData.size;
+            }
+
+            size_t declaredLength = static_cast<size_t>(buffer.indexOr("byteLength", 0));
+            if (bufferData.data == nullptr || declaredLength > bufferData.size) {
+                throw std::runtime_error("gltf: buffer data is missing or shorter than byteLength in " + path);
+            }
+            bufferData.size = declaredLength;
+            buffers.push_back(bufferData);
+        }
+    }
+
+    // 씬의 노드를 돌면서 그릴 primitive를 모은다. 씬이 없으면 모든 메시를 단위 행렬로 그린다.
+    std::vector<DrawItem> items;
+    if (document.find("scenes")) {
+        const JsonValue& scene = document.element("scenes", document.indexOr("scene", 0));
+        if (const JsonValue* nodes = scene.find("nodes")) {
+            for (const JsonValue& node : nodes->array) {
+                collectNode(document, static_cast<int64_t>(node.number), Matrix(), 0, items);
+            }
+        }
+    }
+    else if (const JsonValue* meshes = document.find("meshes")) {
+        for (const JsonValue& meshValue : meshes->array) {
+            if (const JsonValue* primitives = meshValue.find("primitives")) {
+                for (const JsonValue& primitive : primitives->array) {
+                    DrawItem item;
+                    item.primitive = &primitive;
+                    items.push_back(item);
+                }
+            }
+        }
+    }
+
+    // 출력 위치를 정한다. 점, 선 primitive와 POSITION이 없는 primitive는 건너뛴다.
+    size_t vertexTotal = 0;
+    size_t indexTotal = 0;
+    std::vector<DrawItem> drawable;
+    for (DrawItem& item : items) {
+        item.mode = static_cast<uint32_t>(item.primitive->indexOr("mode", 4));
+        const JsonValue* attributes = item.primitive->find("attributes");
+        if ((item.mode != 4 && item.mode != 5 && item.mode != 6) || !attributes || !attributes->find("POSITION")) {
+            continue;
+        }
+
+        item.vertexCount = static_cast<size_t>(document.element("accessors", attributes->indexOr("POSITION", -1)).indexOr("count", 0));
+        item.sourceIndexCount = item.primitive->find("indices")
+            ? static_cast<size_t>(document.element("accessors", item.primitive->indexOr("indices", -1)).indexOr("count", 0))
+            : item.vertexCount;
+        item.indexCount = item.mode == 4 ? item.sourceIndexCount / 3 * 3
+            : (item.sourceIndexCount >= 3 ? (item.sourceIndexCount - 2) * 3 : 0);
+
+        item.vertexBase = vertexTotal;
+        item.indexBase = indexTotal;
+        vertexTotal += item.vertexCount;
+        indexTotal += item.indexCount;
+        drawable.push_back(item);
+    }
+    if (vertexTotal > UINT32_MAX) {
+        throw std::runtime_error("gltf: too many vertices in " + path);
+    }
+
+    mesh.positions.resize(vertexTotal);
+    mesh.colors.resize(vertexTotal, glm::vec3(1.0f, 1.0f, 1.0f));
+    mesh.indices.resize(indexTotal);
+
+    std::vector<char> outOfRange(drawable.size(), 0);
+    runParallel(threadCount, drawable.size(), [&](size_t i) {
+        bool bad = false;
+        convertPrimitive(document, buffers, drawable[i], mesh, bad);
+        outOfRange[i] = bad ? 1 : 0;
+    });
+
+    if (std::find(outOfRange.begin(), outOfRange.end(), 1) != outOfRange.end()) {
+        throw std::runtime_error("gltf: index out of range in " + path);
+    }
+    return mesh;
+}
+
+} // namespace detail
+
+
+// 확장자로 포맷을 고른다. (.obj, .gltf, .glb) threadCount는 파싱에 쓸 스레드 수
+inline ImportedMesh importFile(const std::string& path, uint32_t threadCount) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::string extension = detail::lowerExtension(path);
+    ImportedMesh mesh;
+    if (extension == ".obj") {
+        mesh = detail::importObj(path, std::max(threadCount, 1u));
+    }
+    else if (extension == ".gltf" || extension == ".glb") {
+        mesh = detail::importGltf(path, std::max(threadCount, 1u));
+    }
+    else {
+        throw std::runtime_error("unsupported mesh format: " + path);
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    std::cout << "mesh importer: " << path << ": " << mesh.positions.size() << " vertices, " << mesh.indices.size() / 3
+        << " triangles in " << elapsedMs << " ms (" << (mesh.sourceBytes / 1048576.0) / (elapsedMs / 1000.0) << " MiB/s)\n";
+    return mesh;
+}
+
+} // namespace MeshImporter
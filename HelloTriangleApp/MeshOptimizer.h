@@ -0,0 +1,420 @@
+﻿#pragma once
+
+#include <vector>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "WorkerPool.h"
+
+
+// 인덱스 메시를 GPU가 그리기 좋은 순서로 바꾸는 CPU 전처리 단계
+//
+// 순서대로 다음 네 단계를 거친다.
+//      1. weld: 바이트까지 똑같은 정점을 해시로 찾아 하나로 합친다. (인덱스 없는 삼각형 수프 -> 인덱스 메시)
+//      2. vertex cache: 삼각형 순서를 바꿔서 post-transform 캐시에 남아있는 정점을 최대한 다시 쓰게 한다. (Tipsify)
+//      3. overdraw: 캐시 효율을 크게 해치지 않는 선에서 삼각형을 클러스터로 나누고, 바깥을 향하는 클러스터부터 그린다.
+//      4. vertex fetch: 정점을 처음 쓰이는 순서대로 다시 배치해서 정점 버퍼를 앞에서부터 차례로 읽게 한다.
+//
+// 캐시 효율은 두 가지 지표로 본다.
+//      ACMR(average cache miss ratio): 삼각형 하나당 vertex shader가 실행되는 횟수. 0.5 ~ 3.0, 작을수록 좋다.
+//      ATVR(average transformed vertex ratio): 정점 하나당 vertex shader가 실행되는 횟수. 최소 1.0
+// 실제 GPU의 캐시는 FIFO도 아니고 크기도 제각각이지만 FIFO로 흉내낸 값의 경향은 잘 맞는다.
+namespace MeshOptimizer {
+
+template<typename VertexType>
+struct Mesh {
+    std::vector<VertexType> vertices;
+    std::vector<uint32_t> indices; // 삼각형 리스트
+};
+
+struct CacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+struct Options {
+    uint32_t cacheSize = 16; // 시뮬레이션할 FIFO 캐시 크기. 최근 GPU들은 대략 16 ~ 32
+    float overdrawThreshold = 1.05f; // overdraw를 위해 ACMR이 이 배수만큼 나빠지는 것까지는 허용한다.
+};
+
+struct Report {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t triangleCount = 0;
+    uint32_t clusterCount = 0; // overdraw 단계에서 나눈 클러스터 수
+    CacheStats before;
+    CacheStats after;
+    double milliseconds = 0.0;
+};
+
+// FIFO 캐시를 시뮬레이션한다. 캐시에 들어간 시각을 정점마다 기록해두면 캐시 배열 없이도 FIFO를 흉내낼 수 있다.
+inline CacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    CacheStats stats;
+    if (indices.empty() || vertexCount == 0) {
+        return stats;
+    }
+
+    std::vector<uint32_t> insertedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+
+    for (uint32_t index : indices) {
+        if (time - insertedAt[index] > cacheSize) {
+            insertedAt[index] = time++;
+            misses++;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            uniqueVertices++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+    return stats;
+}
+
+// 1. 같은 정점을 합친다. 정점을 바이트 단위로 비교하기 때문에 VertexType에 패딩이 있으면 안된다.
+// indices가 비어있으면 vertices를 삼각형 수프(정점 3개가 삼각형 하나)로 본다.
+template<typename VertexType>
+void weldVertices(Mesh<VertexType>& mesh) {
+    static_assert(std::is_trivially_copyable<VertexType>::value, "vertices are compared byte by byte");
+
+    std::vector<uint32_t>& indices = mesh.indices;
+    const std::vector<VertexType>& source = mesh.vertices;
+    if (indices.empty()) {
+        indices.resize(source.size());
+        std::iota(indices.begin(), indices.end(), 0u);
+    }
+
+    // open addressing 해시 테이블. 크기는 2의 거듭제곱이고 절반 이상 차지 않게 잡는다.
+    size_t tableSize = 1;
+    while (tableSize < source.size() * 2) {
+        tableSize <<= 1;
+    }
+    const uint32_t empty = UINT32_MAX;
+    std::vector<uint32_t> table(tableSize, empty);
+
+    std::vector<VertexType> welded;
+    welded.reserve(source.size());
+    std::vector<uint32_t> remap(source.size(), empty);
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == empty) {
+            const VertexType& vertex = source[index];
+
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+            for (size_t i = 0; i < sizeof(VertexType); i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+
+            size_t slot = static_cast<size_t>(hash) & (tableSize - 1);
+            while (table[slot] != empty && std::memcmp(&welded[table[slot]], &vertex, sizeof(VertexType)) != 0) {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            if (table[slot] == empty) {
+                table[slot] = static_cast<uint32_t>(welded.size());
+                welded.push_back(vertex);
+            }
+            remap[index] = table[slot];
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices = std::move(welded);
+}
+
+// 2. Tipsify (Sander, Nehab, Barczak. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007)
+// 정점 하나를 중심으로 그 정점을 쓰는 삼각형을 전부 내보내고(fan), 다음 중심은 캐시에 아직 남아있을 이웃 중에서 고른다.
+// 갈 곳이 없으면(dead end) 최근에 쓴 정점들, 그것도 없으면 아직 안 쓴 정점 중 가장 앞의 것으로 건너뛴다.
+// 건너뛴 지점의 삼각형 번호를 hardBoundaries에 남긴다. (overdraw 단계가 클러스터를 나누는 데 쓴다)
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize,
+    std::vector<uint32_t>* hardBoundaries = nullptr) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // 정점 -> 삼각형 인접 리스트 (CSR)
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indices) {
+        liveTriangles[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd; // 최근에 쓴 정점들
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0; // 아직 안 쓴 정점을 찾을 때 여기서부터 찾는다.
+    while (cursor < vertexCount && liveTriangles[cursor] == 0) {
+        cursor++;
+    }
+    int64_t fanning = cursor < vertexCount ? static_cast<int64_t>(cursor) : -1;
+    if (hardBoundaries) {
+        hardBoundaries->push_back(0);
+    }
+
+    while (fanning >= 0) {
+        uint32_t center = static_cast<uint32_t>(fanning);
+        candidates.clear();
+
+        for (uint32_t k = adjacencyOffsets[center]; k < adjacencyOffsets[center + 1]; k++) {
+            uint32_t triangle = adjacency[k];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // 캐시에 남아있으면서, 남은 삼각형을 다 내보내도 캐시에서 밀려나지 않을 이웃 중 가장 오래된 것
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next == -1) {
+            while (!deadEnd.empty()) {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0) {
+                    next = v;
+                    break;
+                }
+            }
+        }
+        if (next == -1) {
+            while (cursor < vertexCount && liveTriangles[cursor] == 0) {
+                cursor++;
+            }
+            if (cursor < vertexCount) {
+                next = static_cast<int64_t>(cursor);
+                if (hardBoundaries) {
+                    hardBoundaries->push_back(static_cast<uint32_t>(output.size() / 3)); // 캐시가 사실상 비워지는 지점
+                }
+            }
+        }
+        fanning = next;
+    }
+
+    indices = std::move(output);
+}
+
+// 3. 캐시 효율을 threshold 배수까지만 희생하면서 삼각형을 클러스터로 나누고
+// 메시 중심에서 바깥쪽을 향하는 클러스터부터 그린다. 바깥을 향한 면이 먼저 깊이 버퍼를 채우면
+// 뒤에 가려지는 면들은 early-z에서 버려진다.
+// optimizeVertexCache가 돌려준 hardBoundaries를 넘기면 그 지점에서는 항상 자른다.
+inline uint32_t optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<uint32_t>& hardBoundaries, uint32_t cacheSize, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return 0;
+    }
+
+    const float targetAcmr = analyzeVertexCache(indices, positions.size(), cacheSize).acmr * threshold;
+
+    // 클러스터 경계 찾기: 클러스터를 시작할 때 캐시가 비어있다고 보고, 지금까지의 ACMR이 목표보다 좋아지면 자른다.
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> insertedAt(positions.size(), 0);
+    uint32_t time = cacheSize + 1;
+    size_t nextHard = 0;
+    size_t clusterMisses = 0;
+    size_t clusterTriangles = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        bool hard = nextHard < hardBoundaries.size() && hardBoundaries[nextHard] == t;
+        if (hard) {
+            nextHard++;
+        }
+        if (t == 0 || hard || (clusterTriangles > 0 && clusterMisses <= targetAcmr * clusterTriangles)) {
+            clusterStarts.push_back(static_cast<uint32_t>(t));
+            time += cacheSize + 1; // 캐시를 비운다.
+            clusterMisses = 0;
+            clusterTriangles = 0;
+        }
+
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            uint32_t v = indices[t * 3 + corner];
+            if (time - insertedAt[v] > cacheSize) {
+                insertedAt[v] = time++;
+                clusterMisses++;
+            }
+        }
+        clusterTriangles++;
+    }
+    clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    // 메시 중심 (면적 가중)
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec3& a = positions[indices[t * 3 + 0]];
+        const glm::vec3& b = positions[indices[t * 3 + 1]];
+        const glm::vec3& c = positions[indices[t * 3 + 2]];
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCenter = meshCenter + (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    meshCenter = meshArea > 0.0f ? meshCenter * (1.0f / meshArea) : glm::vec3(0.0f);
+
+    // 클러스터마다 (클러스터 중심 - 메시 중심) · 클러스터 평균 법선. 클수록 바깥을 향한다.
+    const size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<float> sortKeys(clusterCount, 0.0f);
+    for (size_t i = 0; i < clusterCount; i++) {
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = clusterStarts[i]; t < clusterStarts[i + 1]; t++) {
+            const glm::vec3& a = positions[indices[t * 3 + 0]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& c = positions[indices[t * 3 + 2]];
+            glm::vec3 areaNormal = glm::cross(b - a, c - a); // 길이가 면적의 두 배
+            float triangleArea = glm::length(areaNormal);
+            center = center + (a + b + c) * (triangleArea / 3.0f);
+            normal = normal + areaNormal;
+            area += triangleArea;
+        }
+        float normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f) {
+            sortKeys[i] = glm::dot(center * (1.0f / area) - meshCenter, normal * (1.0f / normalLength));
+        }
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (uint32_t cluster : order) {
+        output.insert(output.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+    }
+    indices = std::move(output);
+
+    return static_cast<uint32_t>(clusterCount);
+}
+
+// 4. 정점을 인덱스 버퍼에서 처음 쓰이는 순서로 다시 배치한다. 쓰이지 않는 정점은 버린다.
+template<typename VertexType>
+void optimizeVertexFetch(Mesh<VertexType>& mesh) {
+    const uint32_t unused = UINT32_MAX;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<VertexType> reordered;
+    reordered.reserve(mesh.vertices.size());
+
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices = std::move(reordered);
+}
+
+// 네 단계를 전부 거친다. positionOf는 정점에서 glm::vec3 위치를 꺼내는 함수 (2D 메시면 z = 0)
+template<typename VertexType, typename PositionOf>
+Report optimize(Mesh<VertexType>& mesh, PositionOf positionOf, const Options& options) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    Report report;
+    report.verticesBefore = mesh.vertices.size();
+    report.before = mesh.indices.empty()
+        ? CacheStats{ 3.0f, 1.0f } // 인덱스가 없으면 모든 정점이 매번 새로 변환된다.
+        : analyzeVertexCache(mesh.indices, mesh.vertices.size(), options.cacheSize);
+
+    weldVertices(mesh);
+
+    std::vector<uint32_t> hardBoundaries;
+    optimizeVertexCache(mesh.indices, mesh.vertices.size(), options.cacheSize, &hardBoundaries);
+
+    std::vector<glm::vec3> positions;
+    positions.reserve(mesh.vertices.size());
+    for (const VertexType& vertex : mesh.vertices) {
+        positions.push_back(positionOf(vertex));
+    }
+    report.clusterCount = optimizeOverdraw(mesh.indices, positions, hardBoundaries, options.cacheSize, options.overdrawThreshold);
+
+    optimizeVertexFetch(mesh);
+
+    report.verticesAfter = mesh.vertices.size();
+    report.triangleCount = mesh.indices.size() / 3;
+    report.after = analyzeVertexCache(mesh.indices, mesh.vertices.size(), options.cacheSize);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    report.milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return report;
+}
+
+// 메시 하나는 한 스레드에서 처리하고 메시들을 WorkerPool에 나눠준다. 메시끼리 공유하는 상태가 없어서 잠글 것이 없다.
+// pool이 nullptr이면 호출한 스레드에서 순서대로 처리한다.
+template<typename VertexType, typename PositionOf>
+std::vector<Report> optimizeAll(std::vector<Mesh<VertexType>>& meshes, PositionOf positionOf, const Options& options, WorkerPool* pool) {
+    std::vector<Report> reports(meshes.size());
+
+    if (pool == nullptr) {
+        for (size_t i = 0; i < meshes.size(); i++) {
+            reports[i] = optimize(meshes[i], positionOf, options);
+        }
+        return reports;
+    }
+
+    std::vector<std::future<Report>> results;
+    results.reserve(meshes.size());
+    for (Mesh<VertexType>& mesh : meshes) {
+        Mesh<VertexType>* target = &mesh;
+        results.push_back(pool->submit([target, positionOf, options] { return optimize(*target, positionOf, options); }));
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        reports[i] = results[i].get(); // 작업 중에 던진 예외는 여기서 다시 던져진다.
+    }
+    return reports;
+}
+
+} // namespace MeshOptimizer
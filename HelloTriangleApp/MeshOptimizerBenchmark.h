@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+#include "MeshOptimizer.h"
+#include "WorkerPool.h"
+#include "BenchmarkReport.h"
+
+
+// --mesh-benchmark: MeshOptimizer를 합성 메시 여러 개에 돌려서 최적화 결과와 속도를 보고, 한 스레드와 여러 스레드의 결과가 같은지 확인한다.
+// 정점 구조체는 앱이 정하니 makeVertex(u, v)로 격자 위의 정점을 만들고, positionOf는 MeshOptimizer::optimizeAll에 그대로 넘긴다.
+namespace MeshOptimizerBenchmark {
+
+// 격자를 삼각형 수프로 풀어서(정점 중복) 삼각형 순서까지 섞은, 최적화 전의 최악에 가까운 메시를 만든다.
+template<typename VertexType, typename MakeVertex>
+MeshOptimizer::Mesh<VertexType> makeSyntheticMesh(uint32_t gridSize, uint32_t seed, MakeVertex makeVertex) {
+    struct Triangle { VertexType corners[3]; };
+    std::vector<Triangle> triangles;
+    triangles.reserve(size_t(gridSize) * gridSize * 2);
+
+    auto corner = [gridSize, &makeVertex](uint32_t x, uint32_t y) {
+        return makeVertex(static_cast<float>(x) / gridSize, static_cast<float>(y) / gridSize);
+    };
+
+    for (uint32_t y = 0; y < gridSize; y++) {
+        for (uint32_t x = 0; x < gridSize; x++) {
+            triangles.push_back({ { corner(x, y), corner(x + 1, y), corner(x + 1, y + 1) } });
+            triangles.push_back({ { corner(x, y), corner(x + 1, y + 1), corner(x, y + 1) } });
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+
+    MeshOptimizer::Mesh<VertexType> mesh;
+    mesh.vertices.reserve(triangles.size() * 3);
+    for (const Triangle& triangle : triangles) {
+        mesh.vertices.insert(mesh.vertices.end(), triangle.corners, triangle.corners + 3);
+    }
+    return mesh;
+}
+
+template<typename VertexType, typename MakeVertex, typename PositionOf>
+bool run(uint32_t threadCount, MakeVertex makeVertex, PositionOf positionOf) {
+    const uint32_t meshCount = 16;
+    const uint32_t gridSize = 256; // 메시 하나당 삼각형 131072개
+    MeshOptimizer::Options optimizerOptions;
+    BenchmarkReport report("mesh benchmark");
+
+    std::vector<MeshOptimizer::Mesh<VertexType>> serialMeshes;
+    for (uint32_t i = 0; i < meshCount; i++) {
+        serialMeshes.push_back(makeSyntheticMesh<VertexType>(gridSize, i, makeVertex));
+    }
+    std::vector<MeshOptimizer::Mesh<VertexType>> parallelMeshes = serialMeshes;
+
+    std::vector<MeshOptimizer::Report> reports;
+    double serialMs = BenchmarkReport::measure([&] {
+        reports = MeshOptimizer::optimizeAll(serialMeshes, positionOf, optimizerOptions, nullptr);
+    });
+
+    WorkerPool pool;
+    pool.start(threadCount);
+    double parallelMs = BenchmarkReport::measure([&] {
+        MeshOptimizer::optimizeAll(parallelMeshes, positionOf, optimizerOptions, &pool);
+    });
+    pool.stop();
+
+    bool passed = true;
+    size_t totalTriangles = 0;
+    for (uint32_t i = 0; i < meshCount; i++) {
+        const MeshOptimizer::Report& meshReport = reports[i];
+        totalTriangles += meshReport.triangleCount;
+        // 최적화는 결정적이라서 스레드 수와 상관없이 결과가 같아야 한다.
+        passed = passed && serialMeshes[i].indices == parallelMeshes[i].indices
+            && meshReport.after.acmr < meshReport.before.acmr && meshReport.triangleCount == size_t(gridSize) * gridSize * 2;
+    }
+
+    const MeshOptimizer::Report& first = reports[0];
+    report.line() << meshCount << " meshes x " << first.triangleCount << " triangles, vertices "
+        << first.verticesBefore << " -> " << first.verticesAfter << ", ACMR " << first.before.acmr << " -> " << first.after.acmr
+        << ", ATVR " << first.before.atvr << " -> " << first.after.atvr << ", " << first.clusterCount << " overdraw clusters\n";
+
+    report.line() << "1 thread " << serialMs << " ms (" << totalTriangles / serialMs / 1000.0 << " M triangles/s), "
+        << threadCount << " threads " << parallelMs << " ms (" << totalTriangles / parallelMs / 1000.0 << " M triangles/s)";
+    report.result(passed);
+
+    return report.passed();
+}
+
+} // namespace MeshOptimizerBenchmark
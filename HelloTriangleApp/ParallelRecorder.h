@@ -0,0 +1,148 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+
+#include "JobSystem.h"
+
+
+// 렌더 패스 안의 드로우 콜들을 여러 스레드에서 secondary command buffer로 나눠 기록하는 도구
+//
+// 커맨드 풀은 외부 동기화 대상이라 한 풀을 두 스레드가 동시에 쓰면 안 된다. 그래서 (프레임 슬롯, 조각)마다 풀을 하나씩 두고
+// 조각 하나는 한 작업이 통째로 기록한다. 어느 워커가 그 작업을 집어가든 그 순간 그 풀을 쓰는 스레드는 하나뿐이다.
+//      record(slot, ...): 슬롯의 풀들을 통째로 리셋 -> 조각마다 secondary 기록 -> 다 끝나면 돌려줌
+// 스레드를 따로 띄우지 않고 앱의 JobSystem에 조각들을 작업으로 넘긴다. 기다리는 동안 호출한 스레드도 조각을 기록한다.
+// (스레드 풀을 따로 두면 JobSystem, 파이프라인 빌드 워커와 합쳐 코어 수보다 많은 스레드가 서로 CPU를 뺏는다)
+// 돌려받은 커맨드 버퍼들은 VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS로 시작한 렌더 패스 안에서 vkCmdExecuteCommands로 실행한다.
+// 풀을 리셋하려면 그 슬롯의 이전 제출이 끝나 있어야 하니 drawFrame이 슬롯의 이전 프레임을 기다린(framePacer.beginFrame) 뒤에 부른다.
+// 상태(파이프라인, 뷰포트, 정점 버퍼 등)는 primary에서 secondary로 상속되지 않으므로 조각마다 다시 바인딩해야 한다.
+class ParallelRecorder {
+public:
+    // 조각(secondary)의 범위를 기록하는 함수. [first, first + count)의 오브젝트를 그린다. 여러 스레드에서 동시에 불린다.
+    using RecordRange = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+    // partitionCount는 조각 수다. 1 이하면 아무것도 만들지 않고 isEnabled가 false가 된다.
+    // jobs는 record를 부르는 동안 살아 있어야 한다. record는 jobs의 start를 부른 스레드(메인 스레드)에서 부른다.
+    void create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameSlots, uint32_t partitionCount, JobSystem& jobs) {
+        this->device = device;
+        this->jobs = &jobs;
+        if (partitionCount <= 1) {
+            return;
+        }
+        this->partitionCount = partitionCount;
+        slots.resize(frameSlots);
+
+        for (Slot& slot : slots) {
+            slot.pools.resize(partitionCount);
+            slot.commandBuffers.resize(partitionCount);
+            for (uint32_t i = 0; i < partitionCount; i++) {
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                // 버퍼를 하나씩 리셋하지 않고 vkResetCommandPool로 풀 전체를 리셋하니 RESET_COMMAND_BUFFER_BIT는 필요 없다.
+                poolInfo.queueFamilyIndex = queueFamilyIndex;
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &slot.pools[i]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create recording command pool!");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = slot.pools[i];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+                if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffers[i]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate secondary command buffer!");
+                }
+            }
+        }
+    }
+
+    bool isEnabled() const {
+        return partitionCount > 1;
+    }
+
+    uint32_t getPartitionCount() const {
+        return partitionCount;
+    }
+
+    // objectCount개의 오브젝트를 조각으로 나눠 기록하고 기록된 secondary들을 순서대로 돌려준다.
+    // 조각 하나가 minimumPerPartition보다 작아지면 조각 수를 줄인다. (작업을 나눠주는 비용이 기록하는 비용보다 커지기 때문에)
+    // 조각 중 하나라도 예외를 던지면 나머지가 끝나길 기다린 뒤에 그 예외를 다시 던진다. (JobSystem::wait)
+    const std::vector<VkCommandBuffer>& record(uint32_t slot, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+        uint32_t objectCount, uint32_t minimumPerPartition, const RecordRange& recordRange) {
+        Slot& frame = slots[slot];
+        minimumPerPartition = std::max(minimumPerPartition, 1u);
+        uint32_t used = std::max(1u, std::min(partitionCount, (objectCount + minimumPerPartition - 1) / minimumPerPartition));
+        uint32_t perPartition = (objectCount + used - 1) / used;
+
+        for (uint32_t i = 0; i < partitionCount; i++) {
+            vkResetCommandPool(device, frame.pools[i], 0);
+        }
+
+        VkCommandBufferInheritanceInfo inheritance{};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.renderPass = renderPass;
+        inheritance.subpass = subpass;
+        inheritance.framebuffer = framebuffer; // 몰라도 되지만 알려주면 드라이버가 최적화할 여지가 생긴다.
+
+        auto recordPartition = [&](uint32_t i) {
+            uint32_t first = std::min(objectCount, i * perPartition);
+            uint32_t count = std::min(objectCount - first, perPartition);
+            VkCommandBuffer commandBuffer = frame.commandBuffers[i];
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            // RENDER_PASS_CONTINUE_BIT: 이 secondary는 렌더 패스 안에서 실행된다. 그래서 inheritance의 렌더 패스를 따라야 한다.
+            beginInfo.pInheritanceInfo = &inheritance;
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+            if (count > 0) {
+                recordRange(commandBuffer, first, count);
+            }
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+        };
+
+        JobSystem::Counter recorded;
+        jobs->parallelFor(&recorded, used, 1, [&recordPartition](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                recordPartition(i);
+            }
+        });
+        jobs->wait(recorded); // 다른 스레드가 아직 frame과 inheritance를 쓰고 있으니 다 끝나기 전에 나가면 안 된다.
+
+        executed.assign(frame.commandBuffers.begin(), frame.commandBuffers.begin() + used);
+        return executed;
+    }
+
+    // 디바이스가 idle인 상태에서 부른다. 커맨드 버퍼는 풀과 같이 해제된다.
+    void destroy() {
+        for (Slot& slot : slots) {
+            for (VkCommandPool pool : slot.pools) {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+        }
+        slots.clear();
+        partitionCount = 1;
+    }
+
+private:
+    struct Slot {
+        std::vector<VkCommandPool> pools; // [partition]
+        std::vector<VkCommandBuffer> commandBuffers; // [partition], 풀마다 secondary 하나
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t partitionCount = 1;
+    std::vector<Slot> slots; // [frame slot]
+    std::vector<VkCommandBuffer> executed;
+    JobSystem* jobs = nullptr;
+};
@@ -0,0 +1,164 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <string>
+#include <future>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+
+#include "PipelineCache.h"
+#include "WorkerPool.h"
+
+
+// 그래픽스 파이프라인 하나를 만드는데 필요한 state를 값으로 들고있는 구조체
+// VkGraphicsPipelineCreateInfo는 온통 포인터로 다른 구조체를 가리키기 때문에 다른 스레드로 넘기기 전에
+// 가리키는 대상까지 전부 복사해둬야 한다. 포인터들은 실제로 빌드하는 스레드에서 build() 직전에 다시 연결해준다.
+// 셰이더 모듈, 파이프라인 레이아웃, 렌더패스 핸들은 빌드가 끝날 때(future를 받을 때)까지 호출자가 살려둬야 한다.
+struct GraphicsPipelineDesc {
+    std::string name;
+
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkViewport viewport{};
+    VkRect2D scissor{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    std::vector<VkDynamicState> dynamicStates;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+};
+
+
+// 파이프라인 description들을 모아서 워커 스레드들에서 동시에 컴파일하는 서비스
+// 모든 워커는 하나의 VkPipelineCache를 공유한다. 파이프라인 캐시는 EXTERNALLY_SYNCHRONIZED로 만들지 않는 이상
+// 드라이버가 내부적으로 동기화 해주기 때문에 여러 스레드에서 동시에 써도 안전하다.
+class PipelineBuildService {
+public:
+    // feedbackEnabled: VkPipelineCreationFeedbackCreateInfo를 체인에 붙여도 되는지 (isCreationFeedbackCore 혹은 익스텐션을 켰을 때)
+    void start(VkDevice device, PipelineCache* pipelineCache, uint32_t threadCount, bool feedbackEnabled) {
+        this->device = device;
+        this->pipelineCache = pipelineCache;
+        this->feedbackEnabled = feedbackEnabled;
+        workers.start(threadCount);
+    }
+
+    // creation feedback은 Vulkan 1.3부터 core고 그 전에는 VK_EXT_pipeline_creation_feedback을 켜야 쓸 수 있다.
+    static bool isCreationFeedbackCore(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        return VK_API_VERSION_MAJOR(properties.apiVersion) > 1 || VK_API_VERSION_MINOR(properties.apiVersion) >= 3;
+    }
+
+    static bool isCreationFeedbackExtensionSupported(VkPhysicalDevice physicalDevice) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        for (const auto& extension : extensions) {
+            if (std::strcmp(extension.extensionName, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void stop() {
+        workers.stop();
+    }
+
+    // 각 description마다 하나씩 future를 돌려준다. 실패하면 future.get()에서 예외가 다시 던져진다.
+    std::vector<std::future<VkPipeline>> submit(const std::vector<GraphicsPipelineDesc>& descs) {
+        std::vector<std::future<VkPipeline>> pipelines;
+        pipelines.reserve(descs.size());
+
+        for (const auto& desc : descs) {
+            pipelines.push_back(workers.submit([this, desc] { return build(desc); }));
+        }
+
+        return pipelines;
+    }
+
+    uint32_t threadCount() const {
+        return workers.threadCount();
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    PipelineCache* pipelineCache = nullptr;
+    bool feedbackEnabled = false;
+    WorkerPool workers;
+
+    VkPipeline build(const GraphicsPipelineDesc& desc) {
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+        vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &desc.viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &desc.scissor;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending = desc.colorBlending;
+        colorBlending.attachmentCount = static_cast<uint32_t>(desc.colorBlendAttachments.size());
+        colorBlending.pAttachments = desc.colorBlendAttachments.data();
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(desc.dynamicStates.size());
+        dynamicState.pDynamicStates = desc.dynamicStates.data();
+
+        VkPipelineCreationFeedback creationFeedback{};
+        VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+        feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+        // creation feedback을 붙여두면 드라이버가 파이프라인 캐시에서 hit가 났는지 알려준다.
+        // 1.3 미만이고 익스텐션도 켜지 않은 디바이스에 붙이면 invalid usage라서 그때는 체인을 비워둔다.
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = feedbackEnabled ? &feedbackInfo : nullptr;
+        pipelineInfo.stageCount = static_cast<uint32_t>(desc.shaderStages.size());
+        pipelineInfo.pStages = desc.shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &desc.inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &desc.rasterizer;
+        pipelineInfo.pMultisampleState = &desc.multisampling;
+        pipelineInfo.pDepthStencilState = nullptr;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = desc.dynamicStates.empty() ? nullptr : &dynamicState;
+        pipelineInfo.layout = desc.layout;
+        pipelineInfo.renderPass = desc.renderPass;
+        pipelineInfo.subpass = desc.subpass;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        auto compileStart = std::chrono::high_resolution_clock::now();
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline " + desc.name + "!");
+        }
+
+        auto compileEnd = std::chrono::high_resolution_clock::now();
+        pipelineCache->recordCreation(desc.name.c_str(),
+            std::chrono::duration<double, std::milli>(compileEnd - compileStart).count(), creationFeedback, feedbackEnabled);
+
+        return pipeline;
+    }
+};
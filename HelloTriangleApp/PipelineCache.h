@@ -0,0 +1,181 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+
+
+// VkPipelineCache를 디스크에 저장하고 다음 실행때 다시 불러오는 래퍼
+//
+// 파이프라인 캐시가 없으면 vkCreateGraphicsPipelines는 매번 SPIR-V로부터 드라이버 내부 ISA까지 전부 다시 컴파일한다.
+// 캐시 데이터를 파일로 남겨두면 두 번째 실행부터는 드라이버가 컴파일 결과를 재사용 할 수 있다.
+//
+// 캐시 데이터의 앞부분에는 VkPipelineCacheHeaderVersionOne 헤더가 들어있다.
+//      headerSize(4) | headerVersion(4) | vendorID(4) | deviceID(4) | pipelineCacheUUID(16)
+// 드라이버가 바뀌거나 GPU가 바뀌면 캐시는 쓸모가 없어지기 때문에(최악의 경우 드라이버가 크래시 날 수도 있다)
+// VkPhysicalDeviceProperties와 헤더를 비교해서 맞지 않는 캐시는 버리고 빈 캐시로 시작한다.
+class PipelineCache {
+public:
+    void create(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, const std::string& path) {
+        this->device = device;
+        this->path = path;
+        this->deviceProperties = deviceProperties;
+
+        std::vector<char> initialData = loadFromDisk();
+        loadedFromDisk = !initialData.empty();
+
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = initialData.size();
+        createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+        // flags에 VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT를 주지 않았기 때문에
+        // 여러 스레드에서 동시에 같은 캐시로 파이프라인을 만들어도 드라이버가 알아서 동기화해준다.
+
+        if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+
+        std::cout << "pipeline cache: " << (loadedFromDisk ? "loaded " : "starting empty, ")
+            << initialData.size() << " bytes from " << path << "\n";
+    }
+
+    // 파이프라인 생성에 걸린 시간과 VkPipelineCreationFeedback을 기록한다.
+    // feedbackRequested는 생성할 때 feedback을 체인에 붙였는지다. 붙이지 않았거나(디바이스가 지원하지 않음) 드라이버가
+    // VALID_BIT를 채워주지 않았으면 hit인지 알 수 없으니 걸린 시간만 남긴다. (0으로 초기화된 flags를 miss로 읽으면 틀린 답이 된다)
+    void recordCreation(const char* name, double milliseconds, const VkPipelineCreationFeedback& feedback, bool feedbackRequested) {
+        bool feedbackValid = feedbackRequested && (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT) != 0;
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (!feedbackValid) {
+            unknownCount++;
+            std::cout << "pipeline cache: " << name << " created in " << milliseconds << " ms (no creation feedback)\n";
+            return;
+        }
+
+        bool hit = (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) != 0;
+        if (hit) {
+            hitCount++;
+            hitMilliseconds += milliseconds;
+        }
+        else {
+            missCount++;
+            missMilliseconds += milliseconds;
+        }
+
+        std::cout << "pipeline cache: " << name << (hit ? " hit" : " miss") << " in " << milliseconds << " ms\n";
+    }
+
+    // cleanup에서 호출된다. 캐시 데이터를 임시 파일에 다 쓴 뒤에 rename으로 교체하기 때문에
+    // 쓰는 도중에 프로세스가 죽어도 이전 캐시 파일이 깨지지 않는다.
+    void save() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            std::cerr << "pipeline cache: nothing to save\n";
+            return;
+        }
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS) {
+            std::cerr << "pipeline cache: failed to read cache data\n";
+            return;
+        }
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "pipeline cache: failed to open " << tempPath << "\n";
+                return;
+            }
+            file.write(data.data(), dataSize);
+            if (!file.good()) {
+                std::cerr << "pipeline cache: failed to write " << tempPath << "\n";
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error); // 같은 볼륨 안에서의 rename은 원자적으로 교체된다.
+        if (error) {
+            std::cerr << "pipeline cache: failed to replace " << path << ": " << error.message() << "\n";
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+
+        std::cout << "pipeline cache: saved " << dataSize << " bytes to " << path
+            << " (hits: " << hitCount << " / " << hitMilliseconds << " ms, misses: " << missCount << " / " << missMilliseconds << " ms"
+            << (unknownCount > 0 ? ", without feedback: " + std::to_string(unknownCount) : std::string()) << ")\n";
+    }
+
+    void destroy() {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+
+    VkPipelineCache handle() const {
+        return cache;
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties deviceProperties{};
+    std::string path;
+    bool loadedFromDisk = false;
+
+    std::mutex statsMutex;
+    uint32_t hitCount = 0;
+    uint32_t missCount = 0;
+    uint32_t unknownCount = 0; // feedback이 없어서 hit인지 알 수 없었던 생성
+    double hitMilliseconds = 0.0;
+    double missMilliseconds = 0.0;
+
+    std::vector<char> loadFromDisk() {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open()) {
+            return {}; // 첫 실행이면 캐시 파일이 없는게 정상이다.
+        }
+
+        size_t fileSize = (size_t)file.tellg();
+        std::vector<char> data(fileSize);
+
+        file.seekg(0);
+        file.read(data.data(), fileSize);
+
+        if (!isCompatible(data)) {
+            std::cerr << "pipeline cache: " << path << " was created by a different device or driver, ignoring it\n";
+            return {};
+        }
+
+        return data;
+    }
+
+    bool isCompatible(const std::vector<char>& data) const {
+        const size_t headerSize = 16 + VK_UUID_SIZE;
+        if (data.size() < headerSize) {
+            return false;
+        }
+
+        uint32_t header[4];
+        std::memcpy(header, data.data(), sizeof(header));
+        // 구조체 패딩에 기대지 않으려고 필드를 하나씩 꺼내서 비교한다.
+
+        uint8_t cacheUUID[VK_UUID_SIZE];
+        std::memcpy(cacheUUID, data.data() + 16, VK_UUID_SIZE);
+
+        return header[0] >= headerSize
+            && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && header[2] == deviceProperties.vendorID
+            && header[3] == deviceProperties.deviceID
+            && std::memcmp(cacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+};
@@ -0,0 +1,591 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+
+// 패스들이 어떤 이미지를 읽고 쓰는지만 선언하면 실행 순서에 맞는 배리어, 레이아웃 전환, 임시 이미지의 메모리 배치를 계산해주는 렌더 그래프
+//
+// compile은 디바이스를 건드리지 않는 순수한 CPU 계산이라서 GPU 없이도 그래프를 컴파일해서 결과를 검사할 수 있다. (--render-graph-test)
+//      1. 컬링: 출력(swapchain 같은 가져온 이미지, markOutput한 이미지)에서 거꾸로 올라가며 결과에 기여하지 않는 패스를 뺀다.
+//      2. 배리어: 선언한 순서대로 이미지마다 마지막 상태(레이아웃, 쓴 스테이지, 읽은 스테이지)를 따라가며 필요한 것만 만든다.
+//         같은 레이아웃으로 이미 보이게 된 스테이지에서 다시 읽으면 배리어가 없다. 패스 하나에 필요한 배리어는 한 번의
+//         vkCmdPipelineBarrier로 모은다. (BarrierBatch)
+//      3. 별칭(aliasing): 임시 이미지는 처음 쓰는 패스부터 마지막으로 쓰는 패스까지만 살아 있으니 수명이 겹치지 않는 이미지끼리는
+//         같은 메모리를 쓴다. 큰 것부터 겹치지 않는 가장 낮은 오프셋에 놓는다. 앞선 주인이 쓰던 메모리를 넘겨받는 첫 사용에는
+//         앞선 주인의 마지막 사용을 기다리는 의존성을 넣는다.
+// 디바이스에서는 heapSize만큼 메모리를 한 번 할당해서 임시 이미지마다 placement.offset에 바인딩하고 execute로 기록한다.
+class RenderGraph {
+public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+
+    // 패스가 이미지를 어떻게 쓰는지. 스테이지, 접근, 레이아웃은 여기서 정해진다.
+    enum class Access {
+        ColorAttachmentWrite,
+        DepthAttachmentWrite,
+        DepthAttachmentRead,
+        FragmentShaderRead,
+        ComputeShaderRead,
+        ComputeShaderWrite,
+        TransferRead,
+        TransferWrite,
+    };
+
+    // size, alignment가 0이면 포맷과 크기로 어림한다. 디바이스에서는 vkGetImageMemoryRequirements 값을 넣는다.
+    struct ImageDesc {
+        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        VkExtent2D extent = { 0, 0 };
+        VkDeviceSize size = 0;
+        VkDeviceSize alignment = 0;
+    };
+
+    struct Barrier {
+        ResourceId resource = 0;
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkAccessFlags srcAccessMask = 0;
+        VkAccessFlags dstAccessMask = 0;
+    };
+
+    // vkCmdPipelineBarrier 한 번에 들어갈 배리어들
+    struct BarrierBatch {
+        VkPipelineStageFlags srcStageMask = 0;
+        VkPipelineStageFlags dstStageMask = 0;
+        std::vector<Barrier> barriers;
+    };
+
+    struct CompiledPass {
+        PassId pass = 0;
+        BarrierBatch before; // 패스를 기록하기 전에 넣는다.
+    };
+
+    // 임시 이미지의 메모리 위치와 수명. 수명은 compiled.passes 안의 인덱스다.
+    struct Placement {
+        bool used = false; // 살아남은 패스가 쓰는지. 안 쓰면 만들 필요도 없다.
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t firstPass = 0;
+        uint32_t lastPass = 0;
+    };
+
+    struct Compiled {
+        std::vector<CompiledPass> passes;
+        BarrierBatch after; // 가져온 이미지를 finalLayout으로 돌려놓는다.
+        std::vector<Placement> placements; // [resource], 가져온 이미지는 비어 있다.
+        VkDeviceSize heapSize = 0;
+        VkDeviceSize unaliasedSize = 0; // 별칭 없이 따로 할당했다면 필요한 크기
+        uint32_t culledPassCount = 0;
+        uint32_t barrierCount = 0;
+        uint32_t batchCount = 0; // 비어 있지 않은 BarrierBatch 수 = vkCmdPipelineBarrier 호출 수
+    };
+
+    // 그래프가 메모리를 소유하는 임시 이미지. 첫 사용 전의 내용은 정의되지 않는다.
+    ResourceId createImage(const std::string& name, const ImageDesc& desc) {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        resources.push_back(resource);
+        return static_cast<ResourceId>(resources.size() - 1);
+    }
+
+    // 밖에서 만든 이미지(swapchain 이미지 등). initialLayout의 내용을 이어받고 그래프가 끝나면 finalLayout으로 돌려놓는다.
+    // initialStages는 이 이미지가 준비됐다는 걸 기다리는 스테이지다. swapchain 이미지면 acquire 세마포어를 기다리는 스테이지
+    // (보통 COLOR_ATTACHMENT_OUTPUT)를 넘긴다. 첫 배리어가 여기서 이어져야 레이아웃 전환이 acquire 뒤로 밀린다.
+    // (TOP_OF_PIPE에서 시작하면 세마포어 대기보다 먼저 전환이 일어날 수 있다)
+    // 출력이면 이 이미지를 쓰는 패스는 컬링되지 않는다.
+    ResourceId importImage(const std::string& name, VkFormat format, VkImageLayout initialLayout, VkImageLayout finalLayout,
+        VkPipelineStageFlags initialStages = 0, bool output = true) {
+        Resource resource;
+        resource.name = name;
+        resource.desc.format = format;
+        resource.imported = true;
+        resource.initialLayout = initialLayout;
+        resource.finalLayout = finalLayout;
+        resource.initialStages = initialStages;
+        resource.output = output;
+        resources.push_back(resource);
+        return static_cast<ResourceId>(resources.size() - 1);
+    }
+
+    // 결과를 CPU로 읽어가는 등 그래프 밖에서 쓰는 임시 이미지를 출력으로 만든다.
+    void markOutput(ResourceId resource) {
+        resources.at(resource).output = true;
+    }
+
+    // execute는 패스의 명령들을 기록하는 함수다. CPU에서 컴파일만 할 때는 비워둔다.
+    PassId addPass(const std::string& name, std::function<void(VkCommandBuffer)> execute = {}) {
+        Pass pass;
+        pass.name = name;
+        pass.execute = std::move(execute);
+        passes.push_back(std::move(pass));
+        return static_cast<PassId>(passes.size() - 1);
+    }
+
+    // 쓰는 이미지가 없어도(타임스탬프, 읽어가기 등) 컬링하지 않는다.
+    void keepAlive(PassId pass) {
+        passes.at(pass).keepAlive = true;
+    }
+
+    void read(PassId pass, ResourceId resource, Access access) {
+        if (accessInfo(access).write) {
+            throw std::runtime_error("render graph read declared with a write access!");
+        }
+        use(pass, resource, access);
+    }
+
+    void write(PassId pass, ResourceId resource, Access access) {
+        if (!accessInfo(access).write) {
+            throw std::runtime_error("render graph write declared with a read access!");
+        }
+        use(pass, resource, access);
+    }
+
+    const std::string& passName(PassId pass) const {
+        return passes.at(pass).name;
+    }
+
+    const std::string& resourceName(ResourceId resource) const {
+        return resources.at(resource).name;
+    }
+
+    Compiled compile() const {
+        Compiled compiled;
+        std::vector<bool> live = cullPasses();
+        for (PassId i = 0; i < passes.size(); i++) {
+            if (live[i]) {
+                compiled.passes.push_back({ i, {} });
+            }
+            else {
+                compiled.culledPassCount++;
+            }
+        }
+
+        placeTransients(compiled);
+        computeBarriers(compiled);
+
+        for (const CompiledPass& pass : compiled.passes) {
+            countBatch(compiled, pass.before);
+        }
+        countBatch(compiled, compiled.after);
+        return compiled;
+    }
+
+    // 컴파일한 그래프를 기록한다. imageOf는 리소스에 해당하는 VkImage를 돌려준다.
+    void execute(VkCommandBuffer commandBuffer, const Compiled& compiled, const std::function<VkImage(ResourceId)>& imageOf) const {
+        for (const CompiledPass& pass : compiled.passes) {
+            recordBarriers(commandBuffer, pass.before, imageOf);
+            if (passes[pass.pass].execute) {
+                passes[pass.pass].execute(commandBuffer);
+            }
+        }
+        recordBarriers(commandBuffer, compiled.after, imageOf);
+    }
+
+    // ex)   pass 1 lighting: 3 barriers (albedo COLOR_ATTACHMENT -> SHADER_READ_ONLY, ...)
+    void describe(const Compiled& compiled, std::ostream& out) const {
+        for (uint32_t i = 0; i < compiled.passes.size(); i++) {
+            const CompiledPass& pass = compiled.passes[i];
+            out << "  pass " << i << " " << passes[pass.pass].name << ": ";
+            describeBatch(pass.before, out);
+        }
+        out << "  end: ";
+        describeBatch(compiled.after, out);
+        for (ResourceId id = 0; id < resources.size(); id++) {
+            const Placement& placement = compiled.placements[id];
+            if (placement.used) {
+                out << "  " << resources[id].name << ": offset " << placement.offset << ", " << placement.size << " bytes, passes "
+                    << placement.firstPass << ".." << placement.lastPass << "\n";
+            }
+        }
+        out << "  " << compiled.culledPassCount << " passes culled, " << compiled.barrierCount << " barriers in " << compiled.batchCount
+            << " batches, transient memory " << compiled.heapSize << " / " << compiled.unaliasedSize << " bytes\n";
+    }
+
+    // 접근 방식의 스테이지, 접근 플래그, 레이아웃
+    struct AccessInfo {
+        VkPipelineStageFlags stageMask = 0;
+        VkAccessFlags accessMask = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool write = false;
+    };
+
+    static AccessInfo accessInfo(Access access) {
+        const VkPipelineStageFlags fragmentTests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        switch (access) {
+        case Access::ColorAttachmentWrite:
+            return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+        case Access::DepthAttachmentWrite:
+            return { fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+        case Access::DepthAttachmentRead:
+            return { fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false };
+        case Access::FragmentShaderRead:
+            return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        case Access::ComputeShaderRead:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        case Access::ComputeShaderWrite:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+        case Access::TransferRead:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+        case Access::TransferWrite:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+        }
+        throw std::runtime_error("unknown render graph access!");
+    }
+
+    // 포맷 하나의 텍셀 크기. 어림값이라 타일링, 압축은 고려하지 않는다.
+    static VkDeviceSize bytesPerTexel(VkFormat format) {
+        switch (format) {
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    static const char* layoutName(VkImageLayout layout) {
+        switch (layout) {
+        case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+        case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "DEPTH_READ_ONLY";
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+        default: return "OTHER";
+        }
+    }
+
+    static VkImageAspectFlags aspectOf(VkFormat format) {
+        switch (format) {
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+private:
+    struct Resource {
+        std::string name;
+        ImageDesc desc;
+        bool imported = false;
+        bool output = false;
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags initialStages = 0; // 가져온 이미지의 첫 배리어가 기다릴 스테이지
+    };
+
+    struct Use {
+        ResourceId resource = 0;
+        AccessInfo info;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(VkCommandBuffer)> execute;
+        std::vector<Use> uses;
+        bool keepAlive = false;
+    };
+
+    // 컴파일하면서 따라가는 이미지 하나의 상태
+    struct State {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0; // 마지막으로 쓴(레이아웃 전환 포함) 스테이지
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0; // 마지막 쓰기 이후에 읽은 스테이지
+        VkPipelineStageFlags visibleStages = 0; // 마지막 쓰기를 이미 기다린 스테이지. 여기서 다시 읽으면 배리어가 없다.
+        bool touched = false;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+
+    // 한 패스가 같은 이미지를 여러 번 선언하면(같은 레이아웃으로 프래그먼트 셰이더와 컴퓨트 셰이더에서 읽기 등) 하나로 합친다.
+    // 레이아웃은 하나여야 한다. (깊이 읽기 + 쓰기처럼 레이아웃이 다르면 예외를 던진다)
+    void use(PassId passId, ResourceId resource, Access access) {
+        Pass& pass = passes.at(passId);
+        resources.at(resource);
+        AccessInfo info = accessInfo(access);
+        for (Use& existing : pass.uses) {
+            if (existing.resource == resource) {
+                if (existing.info.layout != info.layout) {
+                    throw std::runtime_error("render graph pass uses an image in two layouts!");
+                }
+                existing.info.stageMask |= info.stageMask;
+                existing.info.accessMask |= info.accessMask;
+                existing.info.write = existing.info.write || info.write;
+                return;
+            }
+        }
+        pass.uses.push_back({ resource, info });
+    }
+
+    // 뒤에서부터 보면서 출력이나 이미 살아남은 패스가 읽는 이미지를 쓰는 패스만 살린다.
+    // 쓰기만 하는 패스가 앞선 쓰기를 덮어쓰는지는 알 수 없으니(LOAD_OP_LOAD일 수 있다) 쓰기가 필요를 지우지는 않는다.
+    std::vector<bool> cullPasses() const {
+        std::vector<bool> needed(resources.size(), false);
+        for (ResourceId id = 0; id < resources.size(); id++) {
+            needed[id] = resources[id].output;
+        }
+
+        std::vector<bool> live(passes.size(), false);
+        for (size_t i = passes.size(); i-- > 0;) {
+            const Pass& pass = passes[i];
+            bool isLive = pass.keepAlive;
+            for (const Use& use : pass.uses) {
+                isLive = isLive || (use.info.write && needed[use.resource]);
+            }
+            if (!isLive) {
+                continue;
+            }
+            live[i] = true;
+            for (const Use& use : pass.uses) {
+                if (!use.info.write || resources[use.resource].imported) {
+                    needed[use.resource] = true; // 가져온 이미지를 읽고 쓰는 패스는 이전 내용에 기대고 있을 수 있다.
+                }
+            }
+        }
+        return live;
+    }
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // 큰 것부터, 수명이 겹치는 이미 놓인 이미지들과 메모리가 겹치지 않는 가장 낮은 오프셋에 놓는다.
+    void placeTransients(Compiled& compiled) const {
+        compiled.placements.assign(resources.size(), Placement{});
+        std::vector<VkDeviceSize> alignments(resources.size(), 1);
+        for (uint32_t order = 0; order < compiled.passes.size(); order++) {
+            for (const Use& use : passes[compiled.passes[order].pass].uses) {
+                const Resource& resource = resources[use.resource];
+                Placement& placement = compiled.placements[use.resource];
+                if (resource.imported) {
+                    continue;
+                }
+                if (!placement.used) {
+                    placement.used = true;
+                    placement.firstPass = order;
+                    VkDeviceSize alignment = resource.desc.alignment != 0 ? resource.desc.alignment : 4096;
+                    placement.size = resource.desc.size != 0 ? resource.desc.size
+                        : alignUp(VkDeviceSize(resource.desc.extent.width) * resource.desc.extent.height * bytesPerTexel(resource.desc.format), alignment);
+                    alignments[use.resource] = alignment;
+                }
+                placement.lastPass = order;
+            }
+        }
+
+        std::vector<ResourceId> order;
+        for (ResourceId id = 0; id < resources.size(); id++) {
+            if (compiled.placements[id].used) {
+                order.push_back(id);
+                compiled.unaliasedSize += compiled.placements[id].size;
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](ResourceId a, ResourceId b) {
+            return compiled.placements[a].size > compiled.placements[b].size;
+        });
+
+        std::vector<ResourceId> placed;
+        for (ResourceId id : order) {
+            Placement& placement = compiled.placements[id];
+            std::vector<const Placement*> overlapping;
+            for (ResourceId other : placed) {
+                const Placement& otherPlacement = compiled.placements[other];
+                if (otherPlacement.firstPass <= placement.lastPass && placement.firstPass <= otherPlacement.lastPass) {
+                    overlapping.push_back(&otherPlacement);
+                }
+            }
+
+            // 후보는 0과 겹치는 이미지들의 끝이다. 그중 어느 것과도 메모리가 겹치지 않는 가장 낮은 곳을 고른다.
+            std::vector<VkDeviceSize> candidates = { 0 };
+            for (const Placement* other : overlapping) {
+                candidates.push_back(alignUp(other->offset + other->size, alignments[id]));
+            }
+            std::sort(candidates.begin(), candidates.end());
+            for (VkDeviceSize candidate : candidates) {
+                bool fits = true;
+                for (const Placement* other : overlapping) {
+                    fits = fits && (candidate + placement.size <= other->offset || other->offset + other->size <= candidate);
+                }
+                if (fits) {
+                    placement.offset = candidate;
+                    break;
+                }
+            }
+            compiled.heapSize = std::max(compiled.heapSize, placement.offset + placement.size);
+            placed.push_back(id);
+        }
+    }
+
+    void computeBarriers(Compiled& compiled) const {
+        std::vector<State> states(resources.size());
+        for (ResourceId id = 0; id < resources.size(); id++) {
+            states[id].layout = resources[id].initialLayout;
+            states[id].writeStages = resources[id].initialStages; // 그래프 밖의 쓰기(acquire 등)처럼 다룬다. 메모리는 세마포어가 보이게 해준다.
+        }
+
+        for (uint32_t order = 0; order < compiled.passes.size(); order++) {
+            CompiledPass& compiledPass = compiled.passes[order];
+            for (const Use& use : passes[compiledPass.pass].uses) {
+                State& state = states[use.resource];
+                if (!state.touched) {
+                    state.touched = true;
+                    if (!resources[use.resource].imported) {
+                        inheritAliasedMemory(compiled, use.resource, order, states);
+                    }
+                }
+                transition(compiledPass.before, use, state);
+            }
+        }
+
+        // 가져온 이미지를 다음 사용자(present 등)가 기대하는 레이아웃으로 돌려놓는다.
+        for (ResourceId id = 0; id < resources.size(); id++) {
+            const Resource& resource = resources[id];
+            State& state = states[id];
+            if (!resource.imported || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) {
+                continue;
+            }
+            addBarrier(compiled.after, id, state.writeStages | state.readStages, state.writeAccess, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                state.layout, resource.finalLayout);
+            state.layout = resource.finalLayout;
+        }
+    }
+
+    // 이 이미지가 처음 쓰는 메모리를 앞서 쓰고 끝난 이미지들이 있으면 그 마지막 사용이 끝난 뒤에 쓰도록 의존성을 넘겨받는다.
+    void inheritAliasedMemory(const Compiled& compiled, ResourceId id, uint32_t order, std::vector<State>& states) const {
+        const Placement& placement = compiled.placements[id];
+        State inherited;
+        for (ResourceId other = 0; other < resources.size(); other++) {
+            const Placement& otherPlacement = compiled.placements[other];
+            if (other == id || !otherPlacement.used || otherPlacement.lastPass >= order) {
+                continue;
+            }
+            bool sharesMemory = otherPlacement.offset < placement.offset + placement.size && placement.offset < otherPlacement.offset + otherPlacement.size;
+            if (sharesMemory) {
+                inherited.writeStages |= states[other].writeStages | states[other].readStages;
+                inherited.writeAccess |= states[other].writeAccess;
+            }
+        }
+        State& state = states[id];
+        state.writeStages = inherited.writeStages;
+        state.writeAccess = inherited.writeAccess;
+        state.layout = VK_IMAGE_LAYOUT_UNDEFINED; // 앞선 내용은 버린다.
+    }
+
+    // use를 위해 필요한 배리어를 batch에 넣고 state를 use 뒤의 상태로 바꾼다.
+    static void transition(BarrierBatch& batch, const Use& use, State& state) {
+        const AccessInfo& info = use.info;
+        bool layoutChange = state.layout != info.layout;
+        VkPipelineStageFlags previousStages = state.writeStages | state.readStages;
+
+        if (layoutChange) {
+            // 레이아웃 전환은 쓰기라서 앞선 읽기, 쓰기를 모두 기다린다. (처음 쓰는 임시 이미지는 앞선 내용을 버린다)
+            addBarrier(batch, use.resource, previousStages, state.writeAccess, info.stageMask, info.accessMask, state.layout, info.layout);
+            state.layout = info.layout;
+            state.writeStages = info.stageMask;
+            state.writeAccess = info.write ? info.accessMask : 0;
+            state.readStages = info.write ? 0 : info.stageMask;
+            state.visibleStages = info.stageMask;
+            return;
+        }
+
+        if (info.write) {
+            // 쓰기 뒤 쓰기(WAW)와 읽기 뒤 쓰기(WAR). 앞선 쓰기가 없고 읽기만 있었다면 실행 의존성만 있으면 된다.
+            if (previousStages != 0) {
+                addBarrier(batch, use.resource, previousStages, state.writeAccess, info.stageMask, info.accessMask, state.layout, info.layout);
+            }
+            state.writeStages = info.stageMask;
+            state.writeAccess = info.accessMask;
+            state.readStages = 0;
+            state.visibleStages = 0;
+            return;
+        }
+
+        // 쓰기 뒤 읽기(RAW). 이미 기다린 스테이지에서 다시 읽는 거라면 배리어가 필요 없다.
+        if (state.writeStages != 0 && (info.stageMask & ~state.visibleStages) != 0) {
+            addBarrier(batch, use.resource, state.writeStages, state.writeAccess, info.stageMask, info.accessMask, state.layout, info.layout);
+            state.visibleStages |= info.stageMask;
+        }
+        state.readStages |= info.stageMask;
+    }
+
+    static void addBarrier(BarrierBatch& batch, ResourceId resource, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+        VkPipelineStageFlags dstStages, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) {
+        batch.srcStageMask |= srcStages != 0 ? srcStages : VkPipelineStageFlags(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT); // 기다릴 것이 없으면 TOP_OF_PIPE
+        batch.dstStageMask |= dstStages;
+        Barrier barrier;
+        barrier.resource = resource;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        batch.barriers.push_back(barrier);
+    }
+
+    static void countBatch(Compiled& compiled, const BarrierBatch& batch) {
+        if (!batch.barriers.empty()) {
+            compiled.batchCount++;
+            compiled.barrierCount += static_cast<uint32_t>(batch.barriers.size());
+        }
+    }
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, const std::function<VkImage(ResourceId)>& imageOf) const {
+        if (batch.barriers.empty()) {
+            return;
+        }
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        imageBarriers.reserve(batch.barriers.size());
+        for (const Barrier& barrier : batch.barriers) {
+            VkImageMemoryBarrier imageBarrier{};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcAccessMask = barrier.srcAccessMask;
+            imageBarrier.dstAccessMask = barrier.dstAccessMask;
+            imageBarrier.oldLayout = barrier.oldLayout;
+            imageBarrier.newLayout = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = imageOf(barrier.resource);
+            imageBarrier.subresourceRange.aspectMask = aspectOf(resources[barrier.resource].desc.format);
+            imageBarrier.subresourceRange.baseMipLevel = 0;
+            imageBarrier.subresourceRange.levelCount = 1;
+            imageBarrier.subresourceRange.baseArrayLayer = 0;
+            imageBarrier.subresourceRange.layerCount = 1;
+            imageBarriers.push_back(imageBarrier);
+        }
+        vkCmdPipelineBarrier(commandBuffer, batch.srcStageMask, batch.dstStageMask, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+    void describeBatch(const BarrierBatch& batch, std::ostream& out) const {
+        out << batch.barriers.size() << " barriers";
+        const char* separator = " (";
+        for (const Barrier& barrier : batch.barriers) {
+            out << separator << resources[barrier.resource].name << " " << layoutName(barrier.oldLayout) << " -> " << layoutName(barrier.newLayout);
+            separator = ", ";
+        }
+        out << (batch.barriers.empty() ? "\n" : ")\n");
+    }
+};
@@ -0,0 +1,277 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <utility>
+#include <cstdint>
+
+#include "RenderGraph.h"
+#include "BenchmarkReport.h"
+
+
+// --render-graph-test: GPU 없이 RenderGraph를 컴파일해서 컬링, 배리어, 레이아웃, 메모리 별칭이 맞는지 검사한다.
+namespace RenderGraphTest {
+
+// 컴파일한 그래프를 처음부터 따라가면서 검사한다. uses[pass]는 그래프에 선언한 (이미지, 접근) 목록이다.
+//  - 배리어의 oldLayout이 그 시점의 레이아웃과 같고, 패스가 쓰는 레이아웃이 선언과 같은지
+//  - 쓰기 전에는 같은 패스에 그 이미지의 배리어가 있고, 쓰기 뒤의 읽기는 그 스테이지까지 배리어로 기다렸는지
+//  - 수명이 겹치는 임시 이미지끼리 메모리가 겹치지 않는지, 컬링된 패스의 결과를 아무도 쓰지 않는지
+inline bool validate(const RenderGraph::Compiled& compiled, const std::vector<std::vector<std::pair<uint32_t, RenderGraph::Access>>>& uses,
+    const std::vector<VkImageLayout>& initialLayouts, const std::vector<bool>& outputs) {
+    size_t resourceCount = initialLayouts.size();
+    std::vector<VkImageLayout> layouts = initialLayouts;
+    std::vector<bool> accessed(resourceCount, false);
+    std::vector<bool> written(resourceCount, false);
+    std::vector<VkPipelineStageFlags> covered(resourceCount, 0); // 마지막 쓰기 이후 배리어로 기다린 스테이지
+    bool valid = true;
+
+    std::vector<bool> live(uses.size(), false);
+    for (const RenderGraph::CompiledPass& pass : compiled.passes) {
+        live[pass.pass] = true;
+    }
+
+    for (const RenderGraph::CompiledPass& pass : compiled.passes) {
+        std::vector<bool> barrierHere(resourceCount, false);
+        for (const RenderGraph::Barrier& barrier : pass.before.barriers) {
+            valid = valid && (barrier.oldLayout == layouts[barrier.resource] || barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+            layouts[barrier.resource] = barrier.newLayout;
+            covered[barrier.resource] |= pass.before.dstStageMask;
+            barrierHere[barrier.resource] = true;
+        }
+        for (const auto& use : uses[pass.pass]) {
+            RenderGraph::AccessInfo info = RenderGraph::accessInfo(use.second);
+            valid = valid && layouts[use.first] == info.layout;
+            if (info.write) {
+                valid = valid && (!accessed[use.first] || barrierHere[use.first]);
+                written[use.first] = true;
+                covered[use.first] = 0;
+            }
+            else if (written[use.first]) {
+                valid = valid && (covered[use.first] & info.stageMask) == info.stageMask;
+            }
+            accessed[use.first] = true;
+        }
+    }
+
+    for (uint32_t a = 0; a < resourceCount; a++) {
+        const RenderGraph::Placement& first = compiled.placements[a];
+        for (uint32_t b = a + 1; b < resourceCount && first.used; b++) {
+            const RenderGraph::Placement& second = compiled.placements[b];
+            bool livesOverlap = second.used && first.firstPass <= second.lastPass && second.firstPass <= first.lastPass;
+            bool memoryOverlaps = first.offset < second.offset + second.size && second.offset < first.offset + first.size;
+            valid = valid && !(livesOverlap && memoryOverlaps);
+        }
+    }
+    valid = valid && compiled.heapSize <= compiled.unaliasedSize;
+
+    for (size_t culled = 0; culled < uses.size(); culled++) {
+        if (live[culled]) {
+            continue;
+        }
+        for (const auto& use : uses[culled]) {
+            if (!RenderGraph::accessInfo(use.second).write) {
+                continue;
+            }
+            valid = valid && !outputs[use.first];
+            for (size_t later = culled + 1; later < uses.size(); later++) {
+                for (const auto& laterUse : uses[later]) {
+                    valid = valid && !(live[later] && laterUse.first == use.first && !RenderGraph::accessInfo(laterUse.second).write);
+                }
+            }
+        }
+    }
+    return valid;
+}
+
+// RenderGraph를 디바이스 없이 컴파일해서 검사한다.
+// 1) 디퍼드 렌더링 모양의 그래프: 안 쓰이는 디버그 패스가 빠지고, 배리어 수와 메모리 별칭이 예상대로인지
+// 2) 같은 레이아웃, 같은 스테이지에서 두 번 읽으면 두 번째에는 배리어가 없는지
+// 3) 무작위 그래프 여러 개가 validate를 통과하는지, 컴파일에 얼마나 걸리는지
+inline bool run() {
+    using Access = RenderGraph::Access;
+    using Uses = std::vector<std::vector<std::pair<uint32_t, Access>>>;
+    BenchmarkReport report("render graph");
+
+    {
+        RenderGraph graph;
+        Uses uses;
+        auto declare = [&](RenderGraph::PassId pass, RenderGraph::ResourceId resource, Access access, bool write) {
+            if (write) {
+                graph.write(pass, resource, access);
+            }
+            else {
+                graph.read(pass, resource, access);
+            }
+            uses.resize(pass + 1);
+            uses[pass].push_back({ resource, access });
+        };
+
+        VkExtent2D full = { 1920, 1080 };
+        VkExtent2D half = { 960, 540 };
+        RenderGraph::ResourceId swapchain = graph.importImage("swapchain", VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT); // acquire 세마포어를 기다리는 스테이지
+        RenderGraph::ResourceId albedo = graph.createImage("albedo", { VK_FORMAT_R8G8B8A8_UNORM, full });
+        RenderGraph::ResourceId normal = graph.createImage("normal", { VK_FORMAT_R16G16B16A16_SFLOAT, full });
+        RenderGraph::ResourceId depth = graph.createImage("depth", { VK_FORMAT_D32_SFLOAT, full });
+        RenderGraph::ResourceId hdr = graph.createImage("hdr", { VK_FORMAT_R16G16B16A16_SFLOAT, full });
+        RenderGraph::ResourceId bloom = graph.createImage("bloom", { VK_FORMAT_R16G16B16A16_SFLOAT, half });
+        RenderGraph::ResourceId debug = graph.createImage("debug", { VK_FORMAT_R8G8B8A8_UNORM, full });
+
+        RenderGraph::PassId gbuffer = graph.addPass("gbuffer");
+        declare(gbuffer, albedo, Access::ColorAttachmentWrite, true);
+        declare(gbuffer, normal, Access::ColorAttachmentWrite, true);
+        declare(gbuffer, depth, Access::DepthAttachmentWrite, true);
+        RenderGraph::PassId lighting = graph.addPass("lighting");
+        declare(lighting, albedo, Access::FragmentShaderRead, false);
+        declare(lighting, normal, Access::FragmentShaderRead, false);
+        declare(lighting, depth, Access::FragmentShaderRead, false);
+        declare(lighting, hdr, Access::ColorAttachmentWrite, true);
+        RenderGraph::PassId bloomPass = graph.addPass("bloom");
+        declare(bloomPass, hdr, Access::ComputeShaderRead, false);
+        declare(bloomPass, bloom, Access::ComputeShaderWrite, true);
+        RenderGraph::PassId debugView = graph.addPass("debug view");
+        declare(debugView, normal, Access::FragmentShaderRead, false);
+        declare(debugView, debug, Access::ColorAttachmentWrite, true);
+        RenderGraph::PassId tonemap = graph.addPass("tonemap");
+        declare(tonemap, hdr, Access::FragmentShaderRead, false);
+        declare(tonemap, bloom, Access::FragmentShaderRead, false);
+        declare(tonemap, swapchain, Access::ColorAttachmentWrite, true);
+
+        RenderGraph::Compiled compiled = graph.compile();
+        std::vector<VkImageLayout> initialLayouts(7, VK_IMAGE_LAYOUT_UNDEFINED);
+        std::vector<bool> outputs = { true, false, false, false, false, false, false };
+        bool debugCulled = compiled.culledPassCount == 1 && !compiled.placements[debug].used;
+        bool presentAtEnd = compiled.after.barriers.size() == 1 && compiled.after.barriers[0].newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // swapchain의 첫 전환은 TOP_OF_PIPE가 아니라 acquire 세마포어를 기다린 스테이지에서 이어져야 한다.
+        bool afterAcquire = false;
+        for (const RenderGraph::CompiledPass& pass : compiled.passes) {
+            for (const RenderGraph::Barrier& barrier : pass.before.barriers) {
+                if (barrier.resource == swapchain && barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+                    afterAcquire = (pass.before.srcStageMask & VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT) != 0;
+                }
+            }
+        }
+        // bloom은 gbuffer의 이미지들이 끝난 뒤에 생기니 그 메모리를 다시 쓴다.
+        auto sharesMemory = [&](RenderGraph::ResourceId a, RenderGraph::ResourceId b) {
+            const RenderGraph::Placement& first = compiled.placements[a];
+            const RenderGraph::Placement& second = compiled.placements[b];
+            return first.offset < second.offset + second.size && second.offset < first.offset + first.size;
+        };
+        bool aliased = compiled.heapSize < compiled.unaliasedSize
+            && (sharesMemory(bloom, albedo) || sharesMemory(bloom, normal) || sharesMemory(bloom, depth));
+        bool passed = debugCulled && presentAtEnd && afterAcquire && aliased && compiled.batchCount == 5 && compiled.barrierCount == 13
+            && validate(compiled, uses, initialLayouts, outputs);
+        report.line() << "deferred\n";
+        graph.describe(compiled, std::cout);
+        report.line() << "deferred";
+        report.result(passed);
+    }
+
+    {
+        RenderGraph graph;
+        RenderGraph::ResourceId texture = graph.createImage("texture", { VK_FORMAT_R8G8B8A8_UNORM, { 256, 256 } });
+        RenderGraph::ResourceId first = graph.createImage("first", { VK_FORMAT_R8G8B8A8_UNORM, { 256, 256 } });
+        RenderGraph::ResourceId second = graph.createImage("second", { VK_FORMAT_R8G8B8A8_UNORM, { 256, 256 } });
+        graph.markOutput(first);
+        graph.markOutput(second);
+        RenderGraph::PassId produce = graph.addPass("produce");
+        graph.write(produce, texture, Access::ColorAttachmentWrite);
+        RenderGraph::PassId readA = graph.addPass("read a");
+        graph.read(readA, texture, Access::FragmentShaderRead);
+        graph.write(readA, first, Access::ColorAttachmentWrite);
+        RenderGraph::PassId readB = graph.addPass("read b");
+        graph.read(readB, texture, Access::FragmentShaderRead);
+        graph.write(readB, second, Access::ColorAttachmentWrite);
+
+        RenderGraph::Compiled compiled = graph.compile();
+        bool secondReadFree = true;
+        for (const RenderGraph::Barrier& barrier : compiled.passes[2].before.barriers) {
+            secondReadFree = secondReadFree && barrier.resource != texture;
+        }
+        report.line() << "read after read";
+        report.result(compiled.culledPassCount == 0 && secondReadFree);
+    }
+
+    {
+        const uint32_t graphCount = 2000;
+        const uint32_t passCount = 32;
+        const uint32_t resourceCount = 12;
+        const Access accesses[] = { Access::ColorAttachmentWrite, Access::DepthAttachmentWrite, Access::DepthAttachmentRead, Access::FragmentShaderRead,
+            Access::ComputeShaderRead, Access::ComputeShaderWrite, Access::TransferRead, Access::TransferWrite };
+        std::mt19937 random(42);
+        uint32_t failed = 0;
+        uint64_t totalBarriers = 0;
+        uint64_t totalCulled = 0;
+        VkDeviceSize aliasedBytes = 0;
+        VkDeviceSize unaliasedBytes = 0;
+        double compileMs = 0.0;
+
+        for (uint32_t g = 0; g < graphCount; g++) {
+            RenderGraph graph;
+            Uses uses(passCount);
+            std::vector<VkImageLayout> initialLayouts(resourceCount, VK_IMAGE_LAYOUT_UNDEFINED);
+            std::vector<bool> outputs(resourceCount, false);
+
+            // 0번은 swapchain처럼 가져온 출력, 나머지는 크기가 제각각인 임시 이미지
+            graph.importImage("swapchain", VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT); // acquire 세마포어를 기다리는 스테이지
+            outputs[0] = true;
+            for (uint32_t r = 1; r < resourceCount; r++) {
+                uint32_t size = 64u << (random() % 5);
+                graph.createImage("image " + std::to_string(r), { r % 4 == 0 ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT, { size, size } });
+                if (random() % 3 == 0) {
+                    graph.markOutput(r);
+                    outputs[r] = true;
+                }
+            }
+
+            for (uint32_t p = 0; p < passCount; p++) {
+                RenderGraph::PassId pass = graph.addPass("pass " + std::to_string(p));
+                uint32_t useCount = 1 + random() % 3;
+                for (uint32_t u = 0; u < useCount; u++) {
+                    uint32_t resource = random() % resourceCount;
+                    Access access = accesses[random() % 8];
+                    bool depthFormat = resource != 0 && resource % 4 == 0;
+                    bool depthAccess = access == Access::DepthAttachmentWrite || access == Access::DepthAttachmentRead;
+                    bool duplicate = false;
+                    for (const auto& existing : uses[p]) {
+                        duplicate = duplicate || existing.first == resource;
+                    }
+                    if (duplicate || depthFormat != depthAccess) {
+                        continue;
+                    }
+                    if (RenderGraph::accessInfo(access).write) {
+                        graph.write(pass, resource, access);
+                    }
+                    else {
+                        graph.read(pass, resource, access);
+                    }
+                    uses[p].push_back({ resource, access });
+                }
+            }
+
+            RenderGraph::Compiled compiled;
+            compileMs += BenchmarkReport::measure([&] { compiled = graph.compile(); });
+
+            failed += validate(compiled, uses, initialLayouts, outputs) ? 0 : 1;
+            totalBarriers += compiled.barrierCount;
+            totalCulled += compiled.culledPassCount;
+            aliasedBytes += compiled.heapSize;
+            unaliasedBytes += compiled.unaliasedSize;
+        }
+
+        report.line() << graphCount << " random graphs x " << passCount << " passes | " << compileMs * 1000.0 / graphCount
+            << " us/compile | " << double(totalBarriers) / graphCount << " barriers, " << double(totalCulled) / graphCount
+            << " culled passes per graph | transient memory " << (unaliasedBytes > 0 ? 100.0 * aliasedBytes / unaliasedBytes : 0.0)
+            << "% of unaliased";
+        report.result(failed == 0, std::to_string(failed) + " graphs");
+    }
+
+    return report.passed();
+}
+
+} // namespace RenderGraphTest
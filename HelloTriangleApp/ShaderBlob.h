@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+
+#include "MappedFile.h"
+
+
+// SPIR-V 바이너리를 복사 없이 vkCreateShaderModule에 넘겨주기 위한 로더
+//
+// 예전에는 std::vector<char>로 파일을 통째로 읽은 다음 reinterpret_cast<const uint32_t*>로 넘겼는데
+// std::vector<char>의 버퍼는 4바이트 정렬이 보장되지 않는다. (VkShaderModuleCreateInfo::pCode는 uint32_t 정렬이어야 한다)
+// 파일을 매핑하면 페이지 정렬된 주소가 나오기 때문에 정렬 문제도 없고 힙 할당과 복사도 사라진다.
+class ShaderBlob {
+public:
+    static const uint32_t spirvMagic = 0x07230203;
+    static const size_t spirvHeaderWords = 5; // magic, version, generator, bound, schema
+
+    ShaderBlob() = default;
+
+    explicit ShaderBlob(const std::string& path) {
+        load(path);
+    }
+
+    void load(const std::string& path) {
+        file.open(path);
+        validate(path);
+    }
+
+    // 셰이더 모듈을 만든 뒤에는 드라이버가 내용을 복사해 갔기 때문에 매핑을 풀어도 된다.
+    void release() {
+        file.close();
+    }
+
+    bool isLoaded() const {
+        return file.isOpen();
+    }
+
+    const uint32_t* code() const {
+        return static_cast<const uint32_t*>(file.data());
+    }
+
+    size_t size() const {
+        return file.size(); // VkShaderModuleCreateInfo::codeSize처럼 바이트 단위
+    }
+
+private:
+    MappedFile file;
+
+    void validate(const std::string& path) const {
+        if (reinterpret_cast<uintptr_t>(file.data()) % sizeof(uint32_t) != 0) {
+            throw std::runtime_error("SPIR-V blob " + path + " is not 4-byte aligned!");
+        }
+        if (file.size() % sizeof(uint32_t) != 0) {
+            throw std::runtime_error("SPIR-V blob " + path + " is not a whole number of words!");
+        }
+        if (file.size() < spirvHeaderWords * sizeof(uint32_t)) {
+            throw std::runtime_error("SPIR-V blob " + path + " is too small!");
+        }
+        if (code()[0] != spirvMagic) {
+            throw std::runtime_error("SPIR-V blob " + path + " has a bad magic number!");
+        }
+    }
+};
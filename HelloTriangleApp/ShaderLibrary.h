@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+
+// 실행 파일 안에 SPIR-V를 직접 넣어두는 셰이더 라이브러리
+//
+// *.spv.inc 파일은 compile.bat(또는 compile.sh)에서 glslc -mfmt=num으로 만들어진다.
+// -mfmt=num은 SPIR-V 워드를 "0x07230203,0x00010000,..." 형태의 C 초기화 목록으로 출력하기 때문에
+// 배열 선언 안에서 그대로 #include 할 수 있다.
+// 셰이더를 수정하면 compile.bat을 다시 실행한 뒤 빌드하면 된다.
+//
+// 실행 파일에 들어있으니 작업 디렉터리가 어디든 상관이 없고, 시작할 때 파일 I/O도 없다.
+namespace ShaderLibrary {
+
+    alignas(4) constexpr uint32_t vertSpirv[] = {
+#include "vert.spv.inc"
+    };
+
+    alignas(4) constexpr uint32_t fragSpirv[] = {
+#include "frag.spv.inc"
+    };
+
+    alignas(4) constexpr uint32_t instancedVertSpirv[] = {
+#include "instanced_vert.spv.inc"
+    };
+
+    struct EmbeddedShader {
+        const char* name;
+        const uint32_t* code;
+        size_t size; // 바이트 단위 (VkShaderModuleCreateInfo::codeSize)
+    };
+
+    // 이름은 예전에 읽던 파일 이름을 그대로 쓴다.
+    constexpr EmbeddedShader shaders[] = {
+        { "vert.spv", vertSpirv, sizeof(vertSpirv) },
+        { "frag.spv", fragSpirv, sizeof(fragSpirv) },
+        { "instanced_vert.spv", instancedVertSpirv, sizeof(instancedVertSpirv) },
+    };
+
+    static_assert(vertSpirv[0] == 0x07230203, "vert.spv.inc is not SPIR-V, rerun compile.bat");
+    static_assert(fragSpirv[0] == 0x07230203, "frag.spv.inc is not SPIR-V, rerun compile.bat");
+    static_assert(instancedVertSpirv[0] == 0x07230203, "instanced_vert.spv.inc is not SPIR-V, rerun compile.bat");
+
+    // 셰이더가 몇 개 안되니 선형 탐색으로 충분하다.
+    inline const EmbeddedShader* find(const char* name) {
+        for (const EmbeddedShader& shader : shaders) {
+            if (std::strcmp(shader.name, name) == 0) {
+                return &shader;
+            }
+        }
+        return nullptr;
+    }
+}
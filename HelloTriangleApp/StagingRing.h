@@ -0,0 +1,222 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+#include "TransferQueue.h"
+
+
+// 프레임마다 바뀌는 데이터(유니폼, 동적 정점, indirect 명령, 복사 원본)를 위한 영구 매핑된 링 버퍼
+//
+// 업로드할 때마다 staging 버퍼를 만들고 vkMapMemory/vkUnmapMemory를 부르는 대신
+// 버퍼 하나를 in flight 프레임 수만큼의 구간으로 나눠두고 프레임마다 자기 구간에서 앞으로만 잘라 쓴다.
+//      | frame 0 | frame 1 | ...
+// drawFrame에서 framePacer.beginFrame으로 이 슬롯의 이전 프레임을 기다린 뒤에는 GPU가 그 구간을 더 이상 읽지 않으니
+// beginFrame으로 구간의 head를 처음으로 되돌려서 재활용한다.
+//
+// 메모리가 HOST_COHERENT가 아니면 CPU가 쓴 내용을 GPU가 보려면 vkFlushMappedMemoryRanges가 필요한데
+// 할당할 때마다 부르지 않고 제출 직전에 flush를 한 번 불러서 이번 프레임에 쓴 구간 전체를 한 번에 flush한다.
+//
+// 전송 큐가 복사 원본으로 쓰는 구간은 그래픽스 큐의 프레임 타임라인으로는 끝났는지 알 수 없기 때문에
+// holdForTransfer로 전송 큐의 타임라인 값을 남겨두면 beginFrame이 그 값까지 기다린 뒤에 재활용한다.
+class StagingRing {
+public:
+    enum class Usage {
+        Uniform, // minUniformBufferOffsetAlignment
+        Vertex, // 정점, 인덱스 데이터 (4바이트)
+        CopySource, // vkCmdCopyBuffer(ToImage)의 원본 (optimalBufferCopyOffsetAlignment)
+        Indirect, // vkCmdDraw*Indirect의 명령 (4바이트)
+    };
+
+    struct Slice {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0; // buffer 안에서의 오프셋
+        VkDeviceSize size = 0;
+        void* data = nullptr; // 여기에 쓰면 된다. 링이 가득 찼으면 nullptr
+
+        bool isValid() const {
+            return data != nullptr;
+        }
+    };
+
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, GpuAllocator& allocator, const TransferQueue& transferQueue,
+        VkDeviceSize bytesPerFrame, uint32_t frameCount) {
+        this->device = device;
+        this->transferQueue = &transferQueue;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+        alignments[static_cast<size_t>(Usage::Uniform)] = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+        alignments[static_cast<size_t>(Usage::Vertex)] = 4;
+        alignments[static_cast<size_t>(Usage::CopySource)] = std::max<VkDeviceSize>(properties.limits.optimalBufferCopyOffsetAlignment, 4);
+        alignments[static_cast<size_t>(Usage::Indirect)] = 4;
+
+        // 구간의 시작이 어떤 정렬도 깨지 않도록 구간 크기를 가장 큰 정렬의 배수로 맞춘다.
+        VkDeviceSize partitionAlignment = nonCoherentAtomSize;
+        for (VkDeviceSize alignment : alignments) {
+            partitionAlignment = std::max(partitionAlignment, alignment);
+        }
+        partitionSize = alignUp(bytesPerFrame, partitionAlignment);
+
+        allocateBuffer(allocator, frameCount);
+        frames.assign(frameCount, Frame{});
+        currentFrame = 0;
+    }
+
+    // 구간 크기는 그대로 두고 구간 수(in flight 프레임 수)만 바꾼다. 디바이스가 idle인 상태에서 부른다.
+    // 남아 있는 구간의 통계(high-water mark, 넘친 횟수)는 그대로 이어진다.
+    void resize(GpuAllocator& allocator, uint32_t frameCount) {
+        destroy(allocator);
+        allocateBuffer(allocator, frameCount);
+        frames.resize(frameCount);
+        for (Frame& frame : frames) {
+            frame.head = 0;
+            frame.flushedHead = 0;
+            frame.transferValue = 0;
+        }
+        currentFrame = 0;
+    }
+
+    // drawFrame에서 framePacer.beginFrame으로 frameIndex 슬롯의 이전 프레임을 기다린 직후에 부른다.
+    void beginFrame(uint32_t frameIndex) {
+        currentFrame = frameIndex;
+        Frame& frame = frames[currentFrame];
+        if (frame.transferValue != 0) {
+            transferQueue->wait(frame.transferValue); // 보통은 그래픽스 큐가 이미 handoff로 기다렸기 때문에 바로 리턴한다.
+            frame.transferValue = 0;
+        }
+        frame.head = 0;
+        frame.flushedHead = 0;
+    }
+
+    // 이번 프레임 구간에서 잘라간 slice를 전송 큐의 복사 원본으로 제출했으면 그 타임라인 값을 넘긴다.
+    void holdForTransfer(uint64_t transferValue) {
+        Frame& frame = frames[currentFrame];
+        frame.transferValue = std::max(frame.transferValue, transferValue);
+    }
+
+    Slice allocate(VkDeviceSize size, Usage usage) {
+        Frame& frame = frames[currentFrame];
+
+        VkDeviceSize begin = alignUp(frame.head, alignments[static_cast<size_t>(usage)]);
+        if (size == 0 || begin + size > partitionSize) {
+            frame.overflowCount++;
+            totalOverflowCount++;
+            return {}; // 호출하는 쪽에서 GpuAllocator로 따로 staging 버퍼를 만들거나 다음 프레임으로 미룬다.
+        }
+
+        frame.head = begin + size;
+        frame.highWaterMark = std::max(frame.highWaterMark, frame.head);
+
+        Slice slice;
+        slice.buffer = buffer;
+        slice.offset = partitionSize * currentFrame + begin;
+        slice.size = size;
+        slice.data = static_cast<char*>(allocation.mapped) + slice.offset;
+        return slice;
+    }
+
+    // 이번 프레임에 새로 쓴 구간을 한 번의 vkFlushMappedMemoryRanges로 flush한다. 제출 직전에 부른다.
+    // coherent 메모리면 아무것도 하지 않는다.
+    void flush() {
+        Frame& frame = frames[currentFrame];
+        if (coherent || frame.head == frame.flushedHead) {
+            return;
+        }
+
+        // flush 범위는 VkDeviceMemory 기준으로 nonCoherentAtomSize에 맞아야 한다.
+        VkDeviceSize memoryBegin = allocation.offset + partitionSize * currentFrame + frame.flushedHead;
+        VkDeviceSize memoryEnd = allocation.offset + partitionSize * currentFrame + frame.head;
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = memoryBegin / nonCoherentAtomSize * nonCoherentAtomSize;
+        range.size = alignUp(memoryEnd, nonCoherentAtomSize) - range.offset;
+        if (allocation.isDedicated() && range.offset + range.size > allocation.size) {
+            range.size = VK_WHOLE_SIZE; // 전용 할당의 끝은 atom 배수가 아닐 수 있다.
+        }
+        // 블록 안의 할당이면 블록 크기가 atom의 배수라서 반올림해도 블록을 넘지 않는다. 이웃 할당까지 flush돼도 문제는 없다.
+
+        if (vkFlushMappedMemoryRanges(device, 1, &range) != VK_SUCCESS) {
+            throw std::runtime_error("failed to flush staging ring!");
+        }
+        frame.flushedHead = frame.head;
+        flushCount++;
+    }
+
+    // 구간 크기를 정하는 데 쓴다. 가장 많이 쓴 프레임의 사용량과 넘친 횟수를 보여준다.
+    void printStats(std::ostream& out) const {
+        VkDeviceSize highWaterMark = 0;
+        for (const Frame& frame : frames) {
+            highWaterMark = std::max(highWaterMark, frame.highWaterMark);
+        }
+
+        out << "staging ring: high-water mark " << (highWaterMark >> 10) << " KiB of " << (partitionSize >> 10)
+            << " KiB per frame x " << frames.size() << " frames, " << totalOverflowCount << " overflows, "
+            << (coherent ? "coherent" : std::to_string(flushCount) + " flushes") << "\n";
+    }
+
+    void destroy(GpuAllocator& allocator) {
+        if (buffer != VK_NULL_HANDLE) {
+            allocator.destroyBuffer(buffer, allocation);
+            buffer = VK_NULL_HANDLE;
+        }
+    }
+
+    VkBuffer handle() const {
+        return buffer;
+    }
+
+    VkDeviceSize bytesPerFrame() const {
+        return partitionSize;
+    }
+
+private:
+    void allocateBuffer(GpuAllocator& allocator, uint32_t frameCount) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = partitionSize * frameCount;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+            | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        buffer = allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, allocation);
+        coherent = (allocator.memoryPropertyFlags(allocation.memoryType) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    struct Frame {
+        VkDeviceSize head = 0; // 구간 안에서 다음 할당이 시작될 위치
+        VkDeviceSize flushedHead = 0; // 여기까지는 이미 flush됐다.
+        VkDeviceSize highWaterMark = 0;
+        uint32_t overflowCount = 0;
+        uint64_t transferValue = 0; // 0이 아니면 전송 큐가 이 값에 도달해야 구간을 재활용할 수 있다.
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    const TransferQueue* transferQueue = nullptr;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    GpuAllocation allocation;
+    bool coherent = true;
+
+    VkDeviceSize partitionSize = 0;
+    VkDeviceSize nonCoherentAtomSize = 1;
+    VkDeviceSize alignments[4] = { 1, 1, 1, 1 };
+
+    std::vector<Frame> frames;
+    uint32_t currentFrame = 0;
+    uint32_t totalOverflowCount = 0;
+    uint64_t flushCount = 0;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment; // minUniformBufferOffsetAlignment 등은 2의 거듭제곱이지만 나눗셈으로 안전하게
+    }
+};
@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+
+
+// 시작 단계(initWindow, initVulkan 안의 create*** 함수들)마다 걸린 시간을 기록하는 프로파일러
+// 기록된 구간들은 chrome://tracing 이나 https://ui.perfetto.dev 에서 열 수 있는 Chrome trace JSON으로 저장하고
+// 한 줄 요약도 출력해서 릴리즈마다 cold start 시간이 늘어나지 않았는지 추적할 수 있게 한다.
+class StartupProfiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Span {
+        std::string name;
+        uint32_t threadIndex;
+        int64_t startMicroseconds; // 프로파일러가 만들어진 시점 기준
+        int64_t durationMicroseconds;
+    };
+
+    StartupProfiler() : origin(Clock::now()) {}
+
+    // 함수를 실행하면서 걸린 시간을 name으로 기록한다. 예외가 나도 구간은 남긴다.
+    template<typename Function>
+    void measure(const std::string& name, Function&& function) {
+        Clock::time_point start = Clock::now();
+        try {
+            function();
+        }
+        catch (...) {
+            record(name + " (failed)", start, Clock::now());
+            throw;
+        }
+        record(name, start, Clock::now());
+    }
+
+    // 여러 스레드에서 동시에 불려도 된다.
+    void record(const std::string& name, Clock::time_point start, Clock::time_point end) {
+        std::lock_guard<std::mutex> lock(spanMutex);
+
+        Span span;
+        span.name = name;
+        span.threadIndex = threadIndexOf(std::this_thread::get_id());
+        span.startMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count();
+        span.durationMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        spans.push_back(span);
+    }
+
+    // 프로파일러가 만들어진 시점(프로그램 시작)부터 지금까지를 하나의 구간으로 기록한다. ex) time-to-first-frame
+    void recordSinceStart(const std::string& name) {
+        record(name, origin, Clock::now());
+    }
+
+    void writeChromeTrace(const std::string& path) {
+        std::lock_guard<std::mutex> lock(spanMutex);
+
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "startup trace: failed to open " << path << "\n";
+            return;
+        }
+
+        // "X"(complete) 이벤트는 시작 시간과 길이를 한 번에 기록한다. 단위는 마이크로초
+        file << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < spans.size(); i++) {
+            const Span& span = spans[i];
+            file << "{\"name\":\"" << escape(span.name) << "\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1"
+                << ",\"tid\":" << span.threadIndex
+                << ",\"ts\":" << span.startMicroseconds
+                << ",\"dur\":" << span.durationMicroseconds << "}"
+                << (i + 1 < spans.size() ? ",\n" : "\n");
+        }
+        file << "],\"displayTimeUnit\":\"ms\"}\n";
+
+        std::cout << "startup trace: wrote " << spans.size() << " spans to " << path << "\n";
+    }
+
+    // ex) startup: 412.3 ms | createInstance 35.1 | pickPhysicalDevice 2.0 | ...
+    // total은 첫 구간의 시작부터 마지막 구간의 끝까지의 wall time이라 병렬로 실행된 구간이 있어도 겹쳐서 세지 않는다.
+    void printSummary(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(spanMutex);
+
+        int64_t first = INT64_MAX;
+        int64_t last = 0;
+        for (const Span& span : spans) {
+            first = std::min(first, span.startMicroseconds);
+            last = std::max(last, span.startMicroseconds + span.durationMicroseconds);
+        }
+        if (spans.empty()) {
+            first = 0;
+        }
+
+        out << "startup: " << (last - first) / 1000.0 << " ms";
+        for (const Span& span : spans) {
+            out << " | " << span.name << " " << span.durationMicroseconds / 1000.0;
+        }
+        out << "\n";
+    }
+
+private:
+    Clock::time_point origin;
+    std::mutex spanMutex;
+    std::vector<Span> spans;
+    std::map<std::thread::id, uint32_t> threadIndices;
+
+    uint32_t threadIndexOf(std::thread::id id) {
+        auto found = threadIndices.find(id);
+        if (found != threadIndices.end()) {
+            return found->second;
+        }
+        uint32_t index = static_cast<uint32_t>(threadIndices.size());
+        threadIndices.emplace(id, index);
+        return index;
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+};
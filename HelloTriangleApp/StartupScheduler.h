@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+#include "StartupProfiler.h"
+
+
+// 시작 단계들 사이의 의존성을 보고 서로 의존하지 않는 단계는 다른 스레드에서 동시에 실행하는 스케줄러
+//
+// ex) GLFW 윈도우 생성, VkInstance 생성, SPIR-V 로딩은 서로 관계가 없으니 동시에 실행되고
+//     surface 생성은 윈도우와 인스턴스가 둘 다 준비된 다음에야 실행된다.
+//
+// GLFW의 윈도우 관련 함수들(glfwInit, glfwCreateWindow, glfwGetFramebufferSize...)은 메인 스레드에서만 불러야 하기 때문에
+// 그런 단계는 MainThread로 등록하면 run()을 호출한 스레드에서 실행된다. 나머지는 AnyThread로 등록하면 별도의 스레드에서 실행된다.
+class StartupScheduler {
+public:
+    enum class Affinity {
+        MainThread,
+        AnyThread
+    };
+
+    void addStage(const std::string& name, const std::vector<std::string>& dependencies, Affinity affinity, std::function<void()> function) {
+        if (stageIndices.count(name) != 0) {
+            throw std::runtime_error("startup stage registered twice: " + name);
+        }
+
+        Stage stage;
+        stage.name = name;
+        stage.dependencyNames = dependencies;
+        stage.affinity = affinity;
+        stage.function = std::move(function);
+
+        stageIndices[name] = stages.size();
+        stages.push_back(std::move(stage));
+    }
+
+    // 모든 단계가 끝날 때까지 블락된다. 어떤 단계에서 예외가 나면 새로운 단계는 더 이상 시작하지 않고
+    // 이미 실행중인 단계들이 끝나기를 기다린 다음 처음 발생한 예외를 다시 던진다.
+    void run(StartupProfiler& profiler) {
+        this->profiler = &profiler;
+        resolveDependencies();
+
+        std::unique_lock<std::mutex> lock(schedulerMutex);
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (stages[i].remainingDependencies == 0) {
+                dispatch(i);
+            }
+        }
+
+        while (true) {
+            schedulerCondition.wait(lock, [this] { return !mainThreadQueue.empty() || runningCount == 0; });
+
+            if (mainThreadQueue.empty()) {
+                break; // 실행중인 단계가 하나도 없으면 끝났거나, 실패했거나, 순환 의존성이 있는 경우다.
+            }
+
+            size_t index = mainThreadQueue.front();
+            mainThreadQueue.pop_front();
+
+            if (failure) {
+                runningCount--; // 이미 실패했으니 큐에 남은 메인 스레드 단계는 실행하지 않고 버린다.
+                continue;
+            }
+
+            lock.unlock();
+            execute(index);
+            lock.lock();
+        }
+
+        lock.unlock();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        if (completedCount != stages.size()) {
+            throw std::runtime_error("startup stages have a dependency cycle!");
+        }
+    }
+
+private:
+    struct Stage {
+        std::string name;
+        std::vector<std::string> dependencyNames;
+        std::vector<size_t> dependents;
+        Affinity affinity = Affinity::AnyThread;
+        std::function<void()> function;
+        size_t remainingDependencies = 0;
+    };
+
+    std::vector<Stage> stages;
+    std::map<std::string, size_t> stageIndices;
+    StartupProfiler* profiler = nullptr;
+
+    std::mutex schedulerMutex;
+    std::condition_variable schedulerCondition;
+    std::deque<size_t> mainThreadQueue;
+    std::vector<std::thread> workers;
+    size_t runningCount = 0;   // dispatch됐지만 아직 끝나지 않은 단계 수 (메인 스레드 큐에서 기다리는 단계 포함)
+    size_t completedCount = 0;
+    std::exception_ptr failure;
+
+    void resolveDependencies() {
+        for (size_t i = 0; i < stages.size(); i++) {
+            for (const std::string& dependencyName : stages[i].dependencyNames) {
+                auto found = stageIndices.find(dependencyName);
+                if (found == stageIndices.end()) {
+                    throw std::runtime_error("startup stage " + stages[i].name + " depends on unknown stage " + dependencyName);
+                }
+                stages[found->second].dependents.push_back(i);
+            }
+            stages[i].remainingDependencies = stages[i].dependencyNames.size();
+        }
+    }
+
+    // schedulerMutex를 잡은 상태에서 호출된다.
+    void dispatch(size_t index) {
+        runningCount++;
+
+        if (stages[index].affinity == Affinity::MainThread) {
+            mainThreadQueue.push_back(index);
+            schedulerCondition.notify_all();
+        }
+        else {
+            workers.emplace_back([this, index] { execute(index); });
+        }
+    }
+
+    void execute(size_t index) {
+        std::exception_ptr error;
+        try {
+            profiler->measure(stages[index].name, stages[index].function);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        runningCount--;
+
+        if (error) {
+            if (!failure) {
+                failure = error;
+            }
+        }
+        else {
+            completedCount++;
+            if (!failure) {
+                for (size_t dependent : stages[index].dependents) {
+                    if (--stages[dependent].remainingDependencies == 0) {
+                        dispatch(dependent);
+                    }
+                }
+            }
+        }
+
+        schedulerCondition.notify_all();
+    }
+};
@@ -0,0 +1,347 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+
+// vkQueueSubmit에 넘길 대기, signal 세마포어 목록
+// 바이너리 세마포어와 타임라인 세마포어를 섞어서 쓰려면 VkTimelineSemaphoreSubmitInfo에
+// 대기, signal 세마포어 개수만큼 값을 넘겨야 한다. (바이너리 세마포어의 값은 무시된다)
+// VkTimelineSemaphoreSubmitInfo는 submit 하나에 하나만 붙일 수 있어서 대기와 signal을 같이 모아둔다.
+struct QueueSync {
+    std::vector<VkSemaphore> semaphores;
+    std::vector<VkPipelineStageFlags> stages;
+    std::vector<uint64_t> values;
+    std::vector<VkSemaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+
+    void add(VkSemaphore semaphore, VkPipelineStageFlags stage, uint64_t value = 0) {
+        semaphores.push_back(semaphore);
+        stages.push_back(stage);
+        values.push_back(value);
+    }
+
+    void addSignal(VkSemaphore semaphore, uint64_t value = 0) {
+        signalSemaphores.push_back(semaphore);
+        signalValues.push_back(value);
+    }
+
+    // submitInfo는 이 객체보다 먼저 vkQueueSubmit에 넘겨져야 한다. (포인터를 들고 있기 때문에)
+    void apply(VkSubmitInfo& submitInfo) {
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(semaphores.size());
+        submitInfo.pWaitSemaphores = semaphores.data();
+        submitInfo.pWaitDstStageMask = stages.data();
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(values.size());
+        timelineInfo.pWaitSemaphoreValues = values.data();
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+        timelineInfo.pNext = submitInfo.pNext;
+        submitInfo.pNext = &timelineInfo;
+    }
+};
+
+
+// 버퍼, 이미지 업로드를 그래픽스 큐와 병렬로 실행하기 위한 전송 큐
+//
+// 전송 전용 큐 패밀리(DMA 엔진)가 있으면 그 큐에 자체 커맨드 풀로 복사 명령을 보내고,
+// 끝나면 타임라인 세마포어에 값을 signal한다. 그래픽스 큐는 다음 프레임을 제출할 때 그 값을 기다리기 때문에
+// 업로드 때문에 그래픽스 큐가 멈추지 않는다.
+//
+// 전송 큐와 그래픽스 큐의 패밀리가 다르면 EXCLUSIVE 리소스의 소유권을 넘겨줘야 한다.
+//      전송 큐: release 배리어 (srcQueueFamilyIndex = transfer, dstQueueFamilyIndex = graphics)
+//      그래픽스 큐: 같은 내용의 acquire 배리어를 프레임 커맨드 버퍼 맨 앞에 기록 (takeHandoff -> recordAcquireBarriers)
+// 전송 전용 큐가 없는 디바이스에서는 그래픽스 큐에 그대로 제출하고 소유권 이전 대신 일반 배리어를 기록한다.
+// 이때 전송 큐는 그래픽스 큐와 같은 VkQueue이므로 submit은 렌더링 스레드에서 (또는 렌더링이 시작되기 전에) 불러야 한다.
+class TransferQueue {
+public:
+    // submit에 넘기는 리소스들의 소유권 정보
+    // 호출하는 쪽은 buffer/offset/size(이미지는 image/subresourceRange/oldLayout/newLayout)와 dstAccessMask만 채우면 되고
+    // 큐 패밀리 인덱스와 srcAccessMask는 TransferQueue가 채운다.
+    struct Ownership {
+        std::vector<VkBufferMemoryBarrier> buffers;
+        std::vector<VkImageMemoryBarrier> images;
+        VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT; // 그래픽스 큐에서 처음 사용하는 스테이지
+    };
+
+    // 그래픽스 큐가 다음 제출에서 기다려야 할 값과 기록해야 할 acquire 배리어
+    struct Handoff {
+        uint64_t waitValue = 0; // 0이면 기다릴 업로드가 없다.
+        VkPipelineStageFlags dstStageMask = 0;
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+    };
+
+    void create(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsFamily) {
+        this->device = device;
+        this->queue = queue;
+        this->queueFamily = queueFamily;
+        this->graphicsFamily = graphicsFamily;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transfer command pool!");
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transfer timeline semaphore!");
+        }
+    }
+
+    // record로 복사 명령을 기록해서 전송 큐에 제출하고, 완료되면 signal될 타임라인 값을 돌려준다.
+    // 반환값은 staging 버퍼를 언제 해제해도 되는지 확인하는 데(isComplete, wait) 쓰면 된다.
+    uint64_t submit(const std::function<void(VkCommandBuffer)>& record) {
+        return submit(record, Ownership{});
+    }
+
+    uint64_t submit(const std::function<void(VkCommandBuffer)>& record, Ownership ownership) {
+        std::lock_guard<std::mutex> lock(submitMutex);
+
+        VkCommandBuffer commandBuffer = acquireCommandBuffer();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin transfer command buffer!");
+        }
+
+        record(commandBuffer);
+        recordRelease(commandBuffer, ownership);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record transfer command buffer!");
+        }
+
+        uint64_t signalValue = ++lastSubmittedValue;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timeline;
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit transfer command buffer!");
+        }
+
+        inFlight.push_back({ commandBuffer, signalValue });
+
+        pendingHandoff.waitValue = signalValue;
+        pendingHandoff.dstStageMask |= ownership.dstStageMask;
+
+        return signalValue;
+    }
+
+    // 그래픽스 큐에 제출하기 직전에 호출한다. 한 번 가져간 handoff는 다시 나오지 않는다.
+    Handoff takeHandoff() {
+        std::lock_guard<std::mutex> lock(submitMutex);
+
+        Handoff handoff = std::move(pendingHandoff);
+        pendingHandoff = Handoff{};
+        return handoff;
+    }
+
+    // 프레임 커맨드 버퍼의 렌더 패스 시작 전에 기록한다.
+    static void recordAcquireBarriers(VkCommandBuffer commandBuffer, const Handoff& handoff) {
+        if (handoff.bufferAcquires.empty() && handoff.imageAcquires.empty()) {
+            return;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, handoff.dstStageMask, 0,
+            0, nullptr,
+            static_cast<uint32_t>(handoff.bufferAcquires.size()), handoff.bufferAcquires.data(),
+            static_cast<uint32_t>(handoff.imageAcquires.size()), handoff.imageAcquires.data());
+        // acquire 배리어의 srcStageMask, srcAccessMask는 의미가 없다. 실제 의존성은 타임라인 세마포어 대기가 만든다.
+    }
+
+    bool isComplete(uint64_t value) const {
+        uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &completedValue);
+        return completedValue >= value;
+    }
+
+    // CPU에서 업로드가 끝날 때까지 기다린다.
+    void wait(uint64_t value) const {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            throw std::runtime_error("failed to wait for transfer timeline semaphore!");
+        }
+    }
+
+    void destroy() {
+        if (lastSubmittedValue != 0) {
+            wait(lastSubmittedValue);
+        }
+
+        vkDestroySemaphore(device, timeline, nullptr);
+        vkDestroyCommandPool(device, commandPool, nullptr); // 풀을 파괴하면 할당된 커맨드 버퍼도 같이 해제된다.
+        timeline = VK_NULL_HANDLE;
+        commandPool = VK_NULL_HANDLE;
+        inFlight.clear();
+        freeCommandBuffers.clear();
+    }
+
+    VkSemaphore semaphore() const {
+        return timeline;
+    }
+
+    uint32_t familyIndex() const {
+        return queueFamily;
+    }
+
+    // 그래픽스 큐와 다른 패밀리(전송 전용 큐)를 쓰고 있는지
+    bool isDedicated() const {
+        return queueFamily != graphicsFamily;
+    }
+
+private:
+    struct InFlightCommandBuffer {
+        VkCommandBuffer commandBuffer;
+        uint64_t value;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    uint32_t graphicsFamily = 0;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t lastSubmittedValue = 0;
+
+    std::mutex submitMutex; // 커맨드 풀은 외부 동기화가 필요하다.
+    std::vector<InFlightCommandBuffer> inFlight;
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+    Handoff pendingHandoff;
+
+    // 실행이 끝난 커맨드 버퍼를 재활용하고, 없으면 새로 할당한다.
+    VkCommandBuffer acquireCommandBuffer() {
+        uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(device, timeline, &completedValue);
+
+        for (size_t i = 0; i < inFlight.size();) {
+            if (inFlight[i].value <= completedValue) {
+                freeCommandBuffers.push_back(inFlight[i].commandBuffer);
+                inFlight[i] = inFlight.back();
+                inFlight.pop_back();
+            }
+            else {
+                i++;
+            }
+        }
+
+        if (!freeCommandBuffers.empty()) {
+            VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+            freeCommandBuffers.pop_back();
+            vkResetCommandBuffer(commandBuffer, 0);
+            return commandBuffer;
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate transfer command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    // 전송 전용 큐면 소유권 release 배리어를 기록하고 같은 내용의 acquire 배리어를 handoff에 쌓는다.
+    // 같은 큐면 소유권 이전 없이 전송 쓰기 -> 그래픽스 읽기 배리어만 기록한다.
+    void recordRelease(VkCommandBuffer commandBuffer, Ownership& ownership) {
+        if (ownership.buffers.empty() && ownership.images.empty()) {
+            return;
+        }
+
+        bool transferOwnership = isDedicated();
+        std::vector<VkBufferMemoryBarrier> bufferReleases = ownership.buffers;
+        std::vector<VkImageMemoryBarrier> imageReleases = ownership.images;
+
+        for (VkBufferMemoryBarrier& barrier : bufferReleases) {
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.srcQueueFamilyIndex = transferOwnership ? queueFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = transferOwnership ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            if (transferOwnership) {
+                barrier.dstAccessMask = 0; // release 쪽의 dstAccessMask는 무시된다.
+            }
+        }
+        for (VkImageMemoryBarrier& barrier : imageReleases) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.srcQueueFamilyIndex = transferOwnership ? queueFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = transferOwnership ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            if (transferOwnership) {
+                barrier.dstAccessMask = 0;
+            }
+        }
+
+        // 전송 전용 큐는 그래픽스 스테이지를 모르기 때문에 release의 dstStageMask는 BOTTOM_OF_PIPE로 둔다.
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, transferOwnership ? VkPipelineStageFlags(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) : ownership.dstStageMask, 0,
+            0, nullptr,
+            static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+            static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+
+        if (!transferOwnership) {
+            return;
+        }
+
+        // acquire 배리어는 release와 큐 패밀리 인덱스, 레이아웃이 똑같아야 한다.
+        for (VkBufferMemoryBarrier barrier : ownership.buffers) {
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.srcQueueFamilyIndex = queueFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            pendingHandoff.bufferAcquires.push_back(barrier);
+        }
+        for (VkImageMemoryBarrier barrier : ownership.images) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.srcQueueFamilyIndex = queueFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            pendingHandoff.imageAcquires.push_back(barrier);
+        }
+    }
+};
@@ -0,0 +1,311 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_LAYOUT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+// 정점 구조체의 필드로부터 VkVertexInputBindingDescription/VkVertexInputAttributeDescription을 컴파일 타임에 만든다.
+//
+// 정점 타입은 구조체를 정의한 뒤 VertexLayout::Traits를 특수화해서 어떤 필드가 몇 번 location인지만 적는다.
+// 포맷은 필드의 타입에서, 오프셋은 offsetof에서 나오기 때문에 구조체를 바꾸면 디스크립션도 같이 바뀐다.
+//      struct PackedVertex { VertexLayout::half2 pos; VertexLayout::unorm8x4 color; };
+//      namespace VertexLayout {
+//          template<> struct Traits<PackedVertex> {
+//              static constexpr auto fields = VertexLayout::fields(
+//                  VERTEX_FIELD(PackedVertex, pos, 0),
+//                  VERTEX_FIELD(PackedVertex, color, 1));
+//          };
+//      }
+//
+// 셰이더 쪽은 그대로 vec2, vec3로 받으면 된다. SFLOAT16, SNORM, UNORM 포맷은 vertex fetch 단계에서 float로 바뀌고
+// 셰이더가 받는 성분 수가 포맷보다 적으면 남는 성분은 버려진다.
+namespace VertexLayout {
+
+// 압축된 정점 필드 타입들. 값을 넣을 때는 아래의 quantize 함수들을 쓴다.
+struct half2 { uint16_t x, y; }; // IEEE 754 binary16
+struct half4 { uint16_t x, y, z, w; };
+struct snorm16x2 { int16_t x, y; }; // [-1, 1] -> [-32767, 32767]
+struct snorm16x4 { int16_t x, y, z, w; };
+struct unorm8x4 { uint8_t x, y, z, w; }; // [0, 1] -> [0, 255]
+
+// Quantizer가 성분들을 배열처럼 이어서 쓰기 때문에 패딩이 있으면 안된다.
+static_assert(sizeof(half2) == 4 && sizeof(half4) == 8, "unexpected padding");
+static_assert(sizeof(snorm16x2) == 4 && sizeof(snorm16x4) == 8, "unexpected padding");
+static_assert(sizeof(unorm8x4) == 4, "unexpected padding");
+
+// 필드 타입 -> VkFormat, 성분 수
+template<typename T> struct FormatOf; // 지원하지 않는 타입이면 여기서 컴파일 에러가 난다.
+template<> struct FormatOf<float> { static constexpr VkFormat format = VK_FORMAT_R32_SFLOAT; static constexpr uint32_t components = 1; };
+template<> struct FormatOf<glm::vec2> { static constexpr VkFormat format = VK_FORMAT_R32G32_SFLOAT; static constexpr uint32_t components = 2; };
+template<> struct FormatOf<glm::vec3> { static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT; static constexpr uint32_t components = 3; };
+template<> struct FormatOf<glm::vec4> { static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; static constexpr uint32_t components = 4; };
+template<> struct FormatOf<half2> { static constexpr VkFormat format = VK_FORMAT_R16G16_SFLOAT; static constexpr uint32_t components = 2; };
+template<> struct FormatOf<half4> { static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT; static constexpr uint32_t components = 4; };
+template<> struct FormatOf<snorm16x2> { static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM; static constexpr uint32_t components = 2; };
+template<> struct FormatOf<snorm16x4> { static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SNORM; static constexpr uint32_t components = 4; };
+template<> struct FormatOf<unorm8x4> { static constexpr VkFormat format = VK_FORMAT_R8G8B8A8_UNORM; static constexpr uint32_t components = 4; };
+
+struct Field {
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+};
+
+template<typename... Fields>
+constexpr std::array<Field, sizeof...(Fields)> fields(Fields... list) {
+    return { { list... } };
+}
+
+// 정점 타입마다 특수화한다. (위의 예시 참고)
+template<typename VertexType> struct Traits;
+
+#define VERTEX_FIELD(VertexType, member, location) \
+    VertexLayout::Field{ (location), VertexLayout::FormatOf<decltype(VertexType::member)>::format, static_cast<uint32_t>(offsetof(VertexType, member)) }
+
+template<typename VertexType>
+constexpr size_t attributeCount() {
+    return Traits<VertexType>::fields.size();
+}
+
+// 같은 location을 두 번 쓰지 않았는지 컴파일 타임에 확인한다.
+template<typename VertexType>
+constexpr bool hasUniqueLocations() {
+    const auto& list = Traits<VertexType>::fields;
+    for (size_t i = 0; i < list.size(); i++) {
+        for (size_t j = i + 1; j < list.size(); j++) {
+            if (list[i].location == list[j].location) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// inputRate가 VK_VERTEX_INPUT_RATE_INSTANCE면 인스턴스마다 다음 데이터로 넘어간다.
+template<typename VertexType>
+constexpr VkVertexInputBindingDescription bindingDescription(uint32_t binding, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX) {
+    static_assert(hasUniqueLocations<VertexType>(), "vertex layout uses the same location twice");
+    return { binding, static_cast<uint32_t>(sizeof(VertexType)), inputRate };
+}
+
+template<typename VertexType>
+constexpr std::array<VkVertexInputAttributeDescription, attributeCount<VertexType>()> attributeDescriptions(uint32_t binding) {
+    static_assert(hasUniqueLocations<VertexType>(), "vertex layout uses the same location twice");
+    std::array<VkVertexInputAttributeDescription, attributeCount<VertexType>()> descriptions{};
+    for (size_t i = 0; i < descriptions.size(); i++) {
+        const Field& field = Traits<VertexType>::fields[i];
+        descriptions[i] = { field.location, binding, field.format, field.offset };
+    }
+    return descriptions;
+}
+
+
+// float -> 압축 포맷 변환
+//
+// SSE2가 있으면 4개씩 묶어서 변환하고 나머지와 SSE2가 없는 플랫폼은 스칼라 코드로 변환한다.
+// 두 경로는 같은 반올림(round to nearest even)을 쓰기 때문에 결과가 비트 단위로 같다.
+// count는 정점 수가 아니라 float 성분의 개수다.
+
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t result;
+    if (bits >= (127 + 16) << 23) {
+        result = bits > 0x7f800000u ? 0x7e00 : 0x7c00; // NaN은 quiet NaN으로, 너무 큰 값은 inf로
+    }
+    else if (bits < (127 - 14) << 23) {
+        // 결과가 subnormal이면 float 덧셈의 반올림을 그대로 빌려 쓴다.
+        const uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+
+        float absolute;
+        std::memcpy(&absolute, &bits, sizeof(absolute));
+        absolute += magic;
+        std::memcpy(&bits, &absolute, sizeof(bits));
+        result = static_cast<uint16_t>(bits - magicBits);
+    }
+    else {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits = bits - ((127 - 15) << 23) + 0xfff + mantissaOdd; // 지수 bias를 바꾸고 가수를 반올림한다.
+        result = static_cast<uint16_t>(bits >> 13);
+    }
+    return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+inline int16_t floatToSnorm16(float value) {
+    float clamped = value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value); // NaN은 아래 변환에서 0이 되도록 그대로 둔다.
+    if (clamped != clamped) {
+        return 0;
+    }
+    return static_cast<int16_t>(std::nearbyint(clamped * 32767.0f));
+}
+
+inline uint8_t floatToUnorm8(float value) {
+    float clamped = value > 1.0f ? 1.0f : (value < 0.0f ? 0.0f : value);
+    if (clamped != clamped) {
+        return 0;
+    }
+    return static_cast<uint8_t>(std::nearbyint(clamped * 255.0f));
+}
+
+#ifdef VERTEX_LAYOUT_SSE2
+// floatToHalf를 4개씩. 결과는 32비트 레인의 아래 16비트에 들어있고 음수는 부호 확장돼 있어서
+// _mm_packs_epi32로 묶어도 값이 잘리지 않는다.
+inline __m128i floatToHalf4(__m128 value) {
+    const __m128i signMask = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    const __m128i halfMax = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+    __m128 sign = _mm_and_ps(_mm_castsi128_ps(signMask), value);
+    __m128 absolute = _mm_xor_ps(value, sign);
+    __m128i absoluteBits = _mm_castps_si128(absolute);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+    __m128i isRegular = _mm_cmpgt_epi32(halfMax, absoluteBits);
+    __m128i special = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+    __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absoluteBits);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absolute, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absoluteBits, 31 - 13), 31); // 가수가 홀수면 -1
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absoluteBits, normalBias), mantissaOdd), 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    __m128i joined = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, special));
+    return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// NaN은 max/min을 지나면서 경계값이 되지 않도록 먼저 0으로 바꾼다. (스칼라 경로와 같은 결과)
+inline __m128 clampNotNan(__m128 value, __m128 low, __m128 high) {
+    __m128 ordered = _mm_and_ps(value, _mm_cmpord_ps(value, value));
+    return _mm_min_ps(_mm_max_ps(ordered, low), high);
+}
+#endif
+
+inline void quantizeHalf(const float* source, uint16_t* destination, size_t count) {
+    size_t i = 0;
+#ifdef VERTEX_LAYOUT_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = floatToHalf4(_mm_loadu_ps(source + i));
+        __m128i high = floatToHalf4(_mm_loadu_ps(source + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = floatToHalf(source[i]);
+    }
+}
+
+inline void quantizeSnorm16(const float* source, int16_t* destination, size_t count) {
+    size_t i = 0;
+#ifdef VERTEX_LAYOUT_SSE2
+    const __m128 low = _mm_set1_ps(-1.0f);
+    const __m128 high = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        // _mm_cvtps_epi32는 MXCSR의 기본 반올림(round to nearest even)을 쓴다.
+        __m128i first = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i), low, high), scale));
+        __m128i second = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i + 4), low, high), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packs_epi32(first, second));
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = floatToSnorm16(source[i]);
+    }
+}
+
+inline void quantizeUnorm8(const float* source, uint8_t* destination, size_t count) {
+    size_t i = 0;
+#ifdef VERTEX_LAYOUT_SSE2
+    const __m128 low = _mm_setzero_ps();
+    const __m128 high = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i), low, high), scale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i + 4), low, high), scale));
+        __m128i c = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i + 8), low, high), scale));
+        __m128i d = _mm_cvtps_epi32(_mm_mul_ps(clampNotNan(_mm_loadu_ps(source + i + 12), low, high), scale));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), packed);
+    }
+#endif
+    for (; i < count; i++) {
+        destination[i] = floatToUnorm8(source[i]);
+    }
+}
+
+// 필드 타입별로 float 배열을 압축 포맷 배열로 바꾼다. source에는 components개씩 이어진 float가 count개 있어야 한다.
+template<typename FieldType> struct Quantizer;
+template<> struct Quantizer<half2> {
+    static void run(const float* source, half2* destination, size_t count) {
+        quantizeHalf(source, &destination->x, count * 2);
+    }
+};
+template<> struct Quantizer<half4> {
+    static void run(const float* source, half4* destination, size_t count) {
+        quantizeHalf(source, &destination->x, count * 4);
+    }
+};
+template<> struct Quantizer<snorm16x2> {
+    static void run(const float* source, snorm16x2* destination, size_t count) {
+        quantizeSnorm16(source, &destination->x, count * 2);
+    }
+};
+template<> struct Quantizer<snorm16x4> {
+    static void run(const float* source, snorm16x4* destination, size_t count) {
+        quantizeSnorm16(source, &destination->x, count * 4);
+    }
+};
+template<> struct Quantizer<unorm8x4> {
+    static void run(const float* source, unorm8x4* destination, size_t count) {
+        quantizeUnorm8(source, &destination->x, count * 4);
+    }
+};
+
+// 인터리브된 정점 배열의 한 필드를 채운다.
+// 먼저 필드 하나짜리 연속 배열에 SIMD로 한꺼번에 변환한 다음 정점마다 옮겨 담는다.
+// sourceComponents가 필드의 성분 수보다 적으면 (ex: rgb -> unorm8x4) 나머지 성분은 fill로 채운다.
+template<typename VertexType, typename FieldType>
+void quantizeField(std::vector<VertexType>& vertices, FieldType VertexType::* member,
+    const float* source, size_t sourceComponents, float fill = 1.0f) {
+    const size_t components = FormatOf<FieldType>::components;
+    const size_t count = vertices.size();
+
+    std::vector<float> widened;
+    if (sourceComponents != components) {
+        widened.assign(count * components, fill);
+        size_t copied = sourceComponents < components ? sourceComponents : components;
+        for (size_t i = 0; i < count; i++) {
+            std::memcpy(&widened[i * components], &source[i * sourceComponents], copied * sizeof(float));
+        }
+        source = widened.data();
+    }
+
+    std::vector<FieldType> packed(count);
+    Quantizer<FieldType>::run(source, packed.data(), count);
+    for (size_t i = 0; i < count; i++) {
+        vertices[i].*member = packed[i];
+    }
+}
+
+} // namespace VertexLayout
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+
+// 고정된 개수의 스레드가 하나의 작업 큐를 공유하는 간단한 스레드 풀
+// submit으로 넘긴 작업은 아무 스레드에서나 실행되고 결과(혹은 예외)는 std::future로 돌려받는다.
+class WorkerPool {
+public:
+    ~WorkerPool() {
+        stop();
+    }
+
+    void start(uint32_t threadCount) {
+        stopping = false;
+        threadCount = std::max(threadCount, 1u);
+
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    // 큐에 남아있는 작업까지 전부 끝낸 뒤에 스레드를 정리한다.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    template<typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        // std::function은 복사 가능한 callable만 받기 때문에 packaged_task를 shared_ptr로 감싸서 넘긴다.
+        std::future<Result> result = packagedTask->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+        }
+        queueCondition.notify_one();
+
+        return result;
+    }
+
+    uint32_t threadCount() const {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    static uint32_t defaultThreadCount() {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1; // 메인 스레드 몫으로 하나는 남겨둔다.
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return; // stopping이면서 더 이상 할 일이 없을 때만 빠져나간다.
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
@@ -1,3 +1,7 @@
 C:\VulkanSDK\1.3.236.0\Bin\glslc.exe shader.vert -o vert.spv
 C:\VulkanSDK\1.3.236.0\Bin\glslc.exe shader.frag -o frag.spv
+C:\VulkanSDK\1.3.236.0\Bin\glslc.exe instanced.vert -o instanced_vert.spv
+C:\VulkanSDK\1.3.236.0\Bin\glslc.exe shader.vert -mfmt=num -o vert.spv.inc
+C:\VulkanSDK\1.3.236.0\Bin\glslc.exe shader.frag -mfmt=num -o frag.spv.inc
+C:\VulkanSDK\1.3.236.0\Bin\glslc.exe instanced.vert -mfmt=num -o instanced_vert.spv.inc
 pause
\ No newline at end of file
@@ -0,0 +1,10 @@
+#!/bin/sh
+# compile.bat과 같은 일을 한다. glslc가 PATH에 있어야 한다. (Vulkan SDK 또는 shaderc 패키지)
+set -e
+cd "$(dirname "$0")"
+glslc shader.vert -o vert.spv
+glslc shader.frag -o frag.spv
+glslc instanced.vert -o instanced_vert.spv
+glslc shader.vert -mfmt=num -o vert.spv.inc
+glslc shader.frag -mfmt=num -o frag.spv.inc
+glslc instanced.vert -mfmt=num -o instanced_vert.spv.inc
@@ -0,0 +1,20 @@
+#version 450
+
+// 인스턴싱용 정점 셰이더
+// binding 0(location 0, 1)은 정점마다, binding 1(location 2, 3)은 인스턴스마다 읽는다. (VK_VERTEX_INPUT_RATE_INSTANCE)
+// 인스턴스 데이터는 half4 + unorm8x4 = 12바이트라서 행렬 대신 2D 위치와 (cos, sin) * scale만 넣는다.
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec4 inInstanceTransform; // xy: 위치, zw: (cos, sin) * scale
+layout(location = 3) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+
+void main() {
+    vec2 axis = inInstanceTransform.zw;
+    vec2 position = vec2(inPosition.x * axis.x - inPosition.y * axis.y, inPosition.x * axis.y + inPosition.y * axis.x);
+    gl_Position = vec4(position + inInstanceTransform.xy, 0.0, 1.0);
+    fragColor = inColor * inInstanceColor.rgb;
+}